@@ -0,0 +1,264 @@
+#include "affine_math.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define AFFINE_MATH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX intrinsics anywhere, GCC and Clang need per-function targets
+#if defined(AFFINE_MATH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AFFINE_MATH_TARGET_AVX __attribute__((target("avx")))
+#else
+#define AFFINE_MATH_TARGET_AVX
+#endif
+
+namespace AffineMath {
+    namespace {
+        struct Kernels {
+            void (*multiply)(const Affine3x4 &, const Affine3x4 &, Affine3x4 &);
+            void (*chain)(const int *, const Affine3x4 *, const Affine3x4 &, Affine3x4 *, size_t, size_t);
+            void (*palette)(const int *, const Affine3x4 *, const Affine3x4 *, glm::fmat4 *, size_t, size_t);
+        };
+
+        // ---------------------------------------------------------------- scalar
+
+        inline void multiplyScalar(const Affine3x4 &a, const Affine3x4 &b, Affine3x4 &out) {
+            Affine3x4 r;
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 4; j++) {
+                    r.row[i][j] = a.row[i][0] * b.row[0][j] +
+                                  a.row[i][1] * b.row[1][j] +
+                                  a.row[i][2] * b.row[2][j];
+                }
+                r.row[i][3] += a.row[i][3];
+            }
+            out = r;
+        }
+
+        void chainScalar(const int *parent, const Affine3x4 *local, const Affine3x4 &root,
+                         Affine3x4 *global, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                multiplyScalar(parent[i] < 0 ? root : global[parent[i]], local[i], global[i]);
+        }
+
+        void paletteScalar(const int *boneId, const Affine3x4 *global, const Affine3x4 *offset,
+                           glm::fmat4 *palette, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                int bone = boneId[i];
+                if (bone < 0) continue;
+                Affine3x4 m;
+                multiplyScalar(global[i], offset[bone], m);
+                palette[bone] = toMat4(m);
+            }
+        }
+
+        const Kernels scalarKernels = {multiplyScalar, chainScalar, paletteScalar};
+
+#ifdef AFFINE_MATH_X86
+        // ---------------------------------------------------------------- SSE
+
+        // Lane 3 only, picks the translation out of a row
+        inline __m128 translationMask() {
+            return _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+        }
+
+        inline void multiplySSEInline(const Affine3x4 &a, const Affine3x4 &b, __m128 &r0, __m128 &r1, __m128 &r2) {
+            __m128 mask = translationMask();
+            __m128 b0 = _mm_loadu_ps(b.row[0]);
+            __m128 b1 = _mm_loadu_ps(b.row[1]);
+            __m128 b2 = _mm_loadu_ps(b.row[2]);
+            __m128 a0 = _mm_loadu_ps(a.row[0]);
+            __m128 a1 = _mm_loadu_ps(a.row[1]);
+            __m128 a2 = _mm_loadu_ps(a.row[2]);
+
+#define AFFINE_MATH_SSE_ROW(A) \
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(0, 0, 0, 0)), b0), \
+                                  _mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(1, 1, 1, 1)), b1)), \
+                       _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(2, 2, 2, 2)), b2), \
+                                  _mm_and_ps(A, mask)))
+            r0 = AFFINE_MATH_SSE_ROW(a0);
+            r1 = AFFINE_MATH_SSE_ROW(a1);
+            r2 = AFFINE_MATH_SSE_ROW(a2);
+#undef AFFINE_MATH_SSE_ROW
+        }
+
+        void multiplySSE(const Affine3x4 &a, const Affine3x4 &b, Affine3x4 &out) {
+            __m128 r0, r1, r2;
+            multiplySSEInline(a, b, r0, r1, r2);
+            _mm_storeu_ps(out.row[0], r0);
+            _mm_storeu_ps(out.row[1], r1);
+            _mm_storeu_ps(out.row[2], r2);
+        }
+
+        void chainSSE(const int *parent, const Affine3x4 *local, const Affine3x4 &root,
+                      Affine3x4 *global, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                multiplySSE(parent[i] < 0 ? root : global[parent[i]], local[i], global[i]);
+        }
+
+        void paletteSSE(const int *boneId, const Affine3x4 *global, const Affine3x4 *offset,
+                        glm::fmat4 *palette, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                int bone = boneId[i];
+                if (bone < 0) continue;
+                __m128 r0, r1, r2, r3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+                multiplySSEInline(global[i], offset[bone], r0, r1, r2);
+                // Rows of the affine become the columns of the column-major mat4
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                float *dst = &palette[bone][0][0];
+                _mm_storeu_ps(dst, r0);
+                _mm_storeu_ps(dst + 4, r1);
+                _mm_storeu_ps(dst + 8, r2);
+                _mm_storeu_ps(dst + 12, r3);
+            }
+        }
+
+        const Kernels sseKernels = {multiplySSE, chainSSE, paletteSSE};
+
+        // ---------------------------------------------------------------- AVX
+
+        // Rows 0 and 1 are adjacent in memory and computed together in one 256-bit register,
+        // row 2 goes through the 128-bit path.
+        AFFINE_MATH_TARGET_AVX
+        inline void multiplyAVXInline(const Affine3x4 &a, const Affine3x4 &b, __m256 &r01, __m128 &r2) {
+            __m256 mask = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+            __m256 b0 = _mm256_broadcast_ps((const __m128 *) b.row[0]);
+            __m256 b1 = _mm256_broadcast_ps((const __m128 *) b.row[1]);
+            __m256 b2 = _mm256_broadcast_ps((const __m128 *) b.row[2]);
+            __m256 a01 = _mm256_loadu_ps(a.row[0]);
+            r01 = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_permute_ps(a01, _MM_SHUFFLE(0, 0, 0, 0)), b0),
+                                  _mm256_mul_ps(_mm256_permute_ps(a01, _MM_SHUFFLE(1, 1, 1, 1)), b1)),
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_permute_ps(a01, _MM_SHUFFLE(2, 2, 2, 2)), b2),
+                                  _mm256_and_ps(a01, mask)));
+
+            __m128 a2 = _mm_loadu_ps(a.row[2]);
+            r2 = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_permute_ps(a2, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_castps256_ps128(b0)),
+                               _mm_mul_ps(_mm_permute_ps(a2, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_castps256_ps128(b1))),
+                    _mm_add_ps(_mm_mul_ps(_mm_permute_ps(a2, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_castps256_ps128(b2)),
+                               _mm_and_ps(a2, _mm256_castps256_ps128(mask))));
+        }
+
+        AFFINE_MATH_TARGET_AVX
+        void multiplyAVX(const Affine3x4 &a, const Affine3x4 &b, Affine3x4 &out) {
+            __m256 r01;
+            __m128 r2;
+            multiplyAVXInline(a, b, r01, r2);
+            _mm256_storeu_ps(out.row[0], r01);
+            _mm_storeu_ps(out.row[2], r2);
+        }
+
+        AFFINE_MATH_TARGET_AVX
+        void chainAVX(const int *parent, const Affine3x4 *local, const Affine3x4 &root,
+                      Affine3x4 *global, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                multiplyAVX(parent[i] < 0 ? root : global[parent[i]], local[i], global[i]);
+        }
+
+        AFFINE_MATH_TARGET_AVX
+        void paletteAVX(const int *boneId, const Affine3x4 *global, const Affine3x4 *offset,
+                        glm::fmat4 *palette, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                int bone = boneId[i];
+                if (bone < 0) continue;
+                __m256 r01;
+                __m128 r2, r3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+                multiplyAVXInline(global[i], offset[bone], r01, r2);
+                __m128 r0 = _mm256_castps256_ps128(r01);
+                __m128 r1 = _mm256_extractf128_ps(r01, 1);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                float *dst = &palette[bone][0][0];
+                _mm256_storeu_ps(dst, _mm256_insertf128_ps(_mm256_castps128_ps256(r0), r1, 1));
+                _mm256_storeu_ps(dst + 8, _mm256_insertf128_ps(_mm256_castps128_ps256(r2), r3, 1));
+            }
+        }
+
+        const Kernels avxKernels = {multiplyAVX, chainAVX, paletteAVX};
+
+        bool cpuHasAVX() {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx");
+#elif defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            // The OS must also save the upper halves of the YMM registers
+            return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+            return false;
+#endif
+        }
+#endif
+
+        const Kernels &kernelsFor(Isa _isa) {
+#ifdef AFFINE_MATH_X86
+            if (_isa == ISA_AVX) return avxKernels;
+            if (_isa == ISA_SSE) return sseKernels;
+#endif
+            return scalarKernels;
+        }
+
+        Isa &currentIsa() {
+            static Isa isa = detectIsa();
+            return isa;
+        }
+
+        const Kernels *&currentKernels() {
+            static const Kernels *kernels = &kernelsFor(currentIsa());
+            return kernels;
+        }
+    }
+
+    Isa detectIsa() {
+#ifdef AFFINE_MATH_X86
+        // SSE2 is part of the x86-64 baseline, 32-bit builds are assumed to have it as well
+        return cpuHasAVX() ? ISA_AVX : ISA_SSE;
+#else
+        return ISA_SCALAR;
+#endif
+    }
+
+    Isa getIsa() {
+        return currentIsa();
+    }
+
+    bool setIsa(Isa _isa) {
+        if (_isa < ISA_SCALAR || _isa > detectIsa()) return false;
+        currentIsa() = _isa;
+        currentKernels() = &kernelsFor(_isa);
+        return true;
+    }
+
+    const char *isaName(Isa _isa) {
+        switch (_isa) {
+            case ISA_SCALAR:
+                return "scalar";
+            case ISA_SSE:
+                return "sse";
+            case ISA_AVX:
+                return "avx";
+            default:
+                return "unknown";
+        }
+    }
+
+    void multiply(const Affine3x4 &a, const Affine3x4 &b, Affine3x4 &out) {
+        currentKernels()->multiply(a, b, out);
+    }
+
+    void multiplyParentChain(const int *parent, const Affine3x4 *local, const Affine3x4 &root,
+                             Affine3x4 *global, size_t begin, size_t end) {
+        currentKernels()->chain(parent, local, root, global, begin, end);
+    }
+
+    void composePalette(const int *boneId, const Affine3x4 *global, const Affine3x4 *offset,
+                        glm::fmat4 *palette, size_t begin, size_t end) {
+        currentKernels()->palette(boneId, global, offset, palette, begin, end);
+    }
+}
@@ -0,0 +1,72 @@
+// Affine Matrix Kernels
+// 3x4 row-major affine transforms (the implicit last row is 0 0 0 1) with
+// scalar, SSE and AVX implementations selected by CPU feature detection.
+
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+namespace AffineMath {
+    struct alignas(16) Affine3x4 {
+        float row[3][4];
+    };
+
+    enum Isa {
+        ISA_SCALAR = 0,
+        ISA_SSE,
+        ISA_AVX,
+        ISA_NUM
+    };
+
+    inline Affine3x4 identity() {
+        Affine3x4 a = {{{1.0f, 0.0f, 0.0f, 0.0f},
+                        {0.0f, 1.0f, 0.0f, 0.0f},
+                        {0.0f, 0.0f, 1.0f, 0.0f}}};
+        return a;
+    }
+
+    // The projective row of _m is dropped, callers only pass affine transforms
+    inline Affine3x4 fromMat4(const glm::fmat4 &_m) {
+        Affine3x4 a;
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 4; c++)
+                a.row[r][c] = _m[c][r];
+        return a;
+    }
+
+    inline glm::fmat4 toMat4(const Affine3x4 &_a) {
+        glm::fmat4 m(1.0f);
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 4; c++)
+                m[c][r] = _a.row[r][c];
+        return m;
+    }
+
+    // Best instruction set supported by the running CPU
+    Isa detectIsa();
+
+    // Instruction set used by the kernels below, detectIsa() unless overridden
+    Isa getIsa();
+
+    // Fails and keeps the current selection if the CPU does not support _isa
+    bool setIsa(Isa _isa);
+
+    const char *isaName(Isa _isa);
+
+    // out = a * b, out may alias a or b
+    void multiply(const Affine3x4 &a, const Affine3x4 &b, Affine3x4 &out);
+
+    // For every node i in [begin, end), in order:
+    //     global[i] = (parent[i] < 0 ? root : global[parent[i]]) * local[i]
+    // Parents must precede their children, either inside the range or already computed.
+    void multiplyParentChain(const int *parent, const Affine3x4 *local, const Affine3x4 &root,
+                             Affine3x4 *global, size_t begin, size_t end);
+
+    // For every node i in [begin, end) with boneId[i] >= 0:
+    //     palette[boneId[i]] = global[i] * offset[boneId[i]]
+    // expanded to a column-major 4x4 matrix ready for upload.
+    void composePalette(const int *boneId, const Affine3x4 *global, const Affine3x4 *offset,
+                        glm::fmat4 *palette, size_t begin, size_t end);
+}
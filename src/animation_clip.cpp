@@ -0,0 +1,506 @@
+#include "animation_clip.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SkeletalMesh {
+    namespace {
+        // Assimp leaves mTicksPerSecond at 0 when the file does not say
+        const double DEFAULT_TICKS_PER_SECOND = 25.0;
+
+        // Forward steps a cursor tries before it gives up and searches
+        const int CURSOR_STEPS = 4;
+
+        enum ClipSection {
+            CLIP_SECTION_NAME = 0,
+            CLIP_SECTION_DURATION,
+            CLIP_SECTION_NODES,
+            CLIP_SECTION_INV_BINDS,
+            CLIP_SECTION_KEY_BEGINS,
+            CLIP_SECTION_KEY_TIMES = CLIP_SECTION_KEY_BEGINS + TRACK_KIND_NUM,
+            CLIP_SECTION_ROTATIONS = CLIP_SECTION_KEY_TIMES + TRACK_KIND_NUM,
+            CLIP_SECTION_POSITIONS,
+            CLIP_SECTION_SCALES,
+            CLIP_SECTION_COMPRESSED,
+            CLIP_SECTION_PACKED_ROTATIONS,
+            CLIP_SECTION_PACKED_POSITIONS,
+            CLIP_SECTION_PACKED_SCALES,
+            CLIP_SECTION_POSITION_RANGES,
+            CLIP_SECTION_SCALE_RANGES
+        };
+
+        static_assert(CLIP_SECTION_SCALE_RANGES + 1 == CLIP_SECTION_NUM, "CLIP_SECTION_NUM is out of date");
+
+        const float SQRT2 = 1.41421356f;
+        const float PACK15 = 32767.0f;
+        const float PACK16 = 65535.0f;
+
+        // Last key of [_begin, _end) at or before _time, the first key if there is none.
+        // Steps forward from _cursor while that is cheap, otherwise searches.
+        inline uint32_t seekKey(const float *_keyTime, uint32_t _begin, uint32_t _end, uint32_t _cursor, float _time) {
+            if (_keyTime[_cursor] <= _time) {
+                for (int step = 0; step < CURSOR_STEPS; step++) {
+                    if (_cursor + 1 >= _end || _keyTime[_cursor + 1] > _time) return _cursor;
+                    _cursor++;
+                }
+            }
+            const float *found = std::upper_bound(_keyTime + _begin, _keyTime + _end, _time);
+            return found == _keyTime + _begin ? _begin : (uint32_t) (found - _keyTime) - 1;
+        }
+
+        // Blend factor between _key and the key after it, which is _next
+        inline float keyFactor(const float *_keyTime, uint32_t _key, uint32_t _end, float _time, uint32_t &_next) {
+            _next = _key + 1 < _end ? _key + 1 : _key;
+            float span = _keyTime[_next] - _keyTime[_key];
+            return span > 0.0f ? glm::clamp((_time - _keyTime[_key]) / span, 0.0f, 1.0f) : 0.0f;
+        }
+
+        // Normalized lerp along the shorter arc; between keys a few frames apart it stays within
+        // a fraction of a degree of slerp at a fraction of its cost
+        inline glm::fquat nlerp(const glm::fquat &_a, const glm::fquat &_b, float _factor) {
+            float sign = glm::dot(_a, _b) < 0.0f ? -1.0f : 1.0f;
+            glm::fquat blended(_a.w + (_b.w * sign - _a.w) * _factor, _a.x + (_b.x * sign - _a.x) * _factor,
+                               _a.y + (_b.y * sign - _a.y) * _factor, _a.z + (_b.z * sign - _a.z) * _factor);
+            return blended * (1.0f / std::sqrt(glm::dot(blended, blended)));
+        }
+
+        // The largest component is dropped and rebuilt from the unit length, the other three lie
+        // in [-1/sqrt(2), 1/sqrt(2)] and take 15 bits each. Bits 45 and 46 say which one was dropped.
+        void packRotation(const glm::fquat &_q, uint16_t _out[3]) {
+            glm::fquat unit = glm::normalize(_q);
+            float component[4] = {unit.x, unit.y, unit.z, unit.w};
+            int largest = 0;
+            for (int i = 1; i < 4; i++)
+                if (std::fabs(component[i]) > std::fabs(component[largest])) largest = i;
+            // q and -q are the same rotation, the dropped component is always taken positive
+            float sign = component[largest] < 0.0f ? -1.0f : 1.0f;
+            uint64_t bits = (uint64_t) largest << 45;
+            int shift = 30;
+            for (int i = 0; i < 4; i++) {
+                if (i == largest) continue;
+                float normalized = glm::clamp(component[i] * sign * SQRT2 * 0.5f + 0.5f, 0.0f, 1.0f);
+                bits |= (uint64_t) std::lround(normalized * PACK15) << shift;
+                shift -= 15;
+            }
+            _out[0] = (uint16_t) bits;
+            _out[1] = (uint16_t) (bits >> 16);
+            _out[2] = (uint16_t) (bits >> 32);
+        }
+
+        inline glm::fquat unpackRotation(const uint16_t _in[3]) {
+            uint64_t bits = (uint64_t) _in[0] | (uint64_t) _in[1] << 16 | (uint64_t) _in[2] << 32;
+            int largest = (int) (bits >> 45) & 3;
+            float component[4];
+            float lengthSquared = 0.0f;
+            int shift = 30;
+            for (int i = 0; i < 4; i++) {
+                if (i == largest) continue;
+                component[i] = ((float) ((bits >> shift) & 0x7fff) / PACK15 - 0.5f) * SQRT2;
+                lengthSquared += component[i] * component[i];
+                shift -= 15;
+            }
+            component[largest] = std::sqrt(std::max(0.0f, 1.0f - lengthSquared));
+            return glm::fquat(component[3], component[0], component[1], component[2]);
+        }
+
+        // 16 bits per component over [_min, _min + _extent]
+        void packVector(const glm::fvec3 &_v, const glm::fvec3 &_min, const glm::fvec3 &_extent, uint16_t _out[3]) {
+            for (int i = 0; i < 3; i++) {
+                float normalized = _extent[i] > 0.0f ? glm::clamp((_v[i] - _min[i]) / _extent[i], 0.0f, 1.0f) : 0.0f;
+                _out[i] = (uint16_t) std::lround(normalized * PACK16);
+            }
+        }
+
+        inline glm::fvec3 unpackVector(const uint16_t _in[3], const glm::fvec3 &_min, const glm::fvec3 &_extent) {
+            return _min + _extent * (glm::fvec3(_in[0], _in[1], _in[2]) * (1.0f / PACK16));
+        }
+
+        // Angle between two rotations; acos of the dot product is too coarse near zero in float
+        float rotationError(const glm::fquat &_a, const glm::fquat &_b) {
+            glm::fquat b = glm::dot(_a, _b) < 0.0f ? -_b : _b;
+            glm::fquat difference = _a - b, sum = _a + b;
+            return 2.0f * std::atan2(std::sqrt(glm::dot(difference, difference)), std::sqrt(glm::dot(sum, sum)));
+        }
+
+        float vectorError(const glm::fvec3 &_a, const glm::fvec3 &_b) { return glm::length(_a - _b); }
+
+        // Keys of [_begin, _end) to keep, so that blending the decoded kept keys reproduces the
+        // track within _tolerance. It is checked at every dropped key and halfway between original
+        // keys, since nlerp does not turn at constant speed. A track that holds still keeps one key.
+        template<typename T, typename Decode, typename Blend, typename Error>
+        void reduceTrack(const float *_time, const T *_value, uint32_t _begin, uint32_t _end, float _tolerance,
+                         Decode _decode, Blend _blend, Error _error, std::vector<uint32_t> &_kept) {
+            _kept.assign(1, _begin);
+            T first = _decode(_value[_begin]);
+            bool still = true;
+            for (uint32_t j = _begin; still && j < _end; j++) still = _error(first, _value[j]) <= _tolerance;
+            if (still) return;
+
+            uint32_t anchor = _begin;
+            while (anchor + 1 < _end) {
+                T from = _decode(_value[anchor]);
+                uint32_t reach = anchor + 1;
+                while (reach + 1 < _end) {
+                    uint32_t candidate = reach + 1;
+                    T to = _decode(_value[candidate]);
+                    float span = _time[candidate] - _time[anchor];
+                    bool covered = true;
+                    for (uint32_t j = anchor; covered && j < candidate; j++) {
+                        float factor = span > 0.0f ? (_time[j] - _time[anchor]) / span : 0.0f;
+                        if (j > anchor) covered = _error(_blend(from, to, factor), _value[j]) <= _tolerance;
+                        float halfway = 0.5f * (_time[j] + _time[j + 1]);
+                        factor = span > 0.0f ? (halfway - _time[anchor]) / span : 0.0f;
+                        covered = covered && _error(_blend(from, to, factor),
+                                                    _blend(_value[j], _value[j + 1], 0.5f)) <= _tolerance;
+                    }
+                    if (!covered) break;
+                    reach = candidate;
+                }
+                _kept.push_back(reach);
+                anchor = reach;
+            }
+        }
+
+        glm::fvec3 blendVector(const glm::fvec3 &_a, const glm::fvec3 &_b, float _factor) {
+            return glm::mix(_a, _b, _factor);
+        }
+
+        glm::fquat toGlm(const aiQuaternion &_q) { return glm::fquat(_q.w, _q.x, _q.y, _q.z); }
+
+        glm::fvec3 toGlm(const aiVector3D &_v) { return glm::fvec3(_v.x, _v.y, _v.z); }
+    }
+
+    bool AnimationClip::import(const aiAnimation *_animation, const Skeleton &_skeleton) {
+        clear();
+        if (!_animation) return false;
+        double ticksPerSecond = _animation->mTicksPerSecond > 0.0 ? _animation->mTicksPerSecond
+                                                                   : DEFAULT_TICKS_PER_SECOND;
+        name = _animation->mName.C_Str();
+        duration = (float) (_animation->mDuration / ticksPerSecond);
+        for (int k = 0; k < TRACK_KIND_NUM; k++) keyBegin[k].push_back(0);
+
+        for (unsigned int i = 0; i < _animation->mNumChannels; i++) {
+            const aiNodeAnim *channel = _animation->mChannels[i];
+            int node = _skeleton.findNode(channel->mNodeName.C_Str());
+            if (node < 0) continue;
+            glm::fmat4 bind = AffineMath::toMat4(_skeleton.localBind[node]);
+            channelNode.push_back(node);
+            channelInvBind.push_back(glm::inverse(bind));
+
+            // A kind without keys holds its bind value, so every track has at least one key
+            aiMatrix4x4 aiBind(bind[0][0], bind[1][0], bind[2][0], bind[3][0],
+                               bind[0][1], bind[1][1], bind[2][1], bind[3][1],
+                               bind[0][2], bind[1][2], bind[2][2], bind[3][2],
+                               0.0f, 0.0f, 0.0f, 1.0f);
+            aiVector3D bindScale, bindPosition;
+            aiQuaternion bindRotation;
+            aiBind.Decompose(bindScale, bindRotation, bindPosition);
+
+            for (unsigned int j = 0; j < channel->mNumRotationKeys; j++) {
+                keyTime[TRACK_ROTATION].push_back((float) (channel->mRotationKeys[j].mTime / ticksPerSecond));
+                rotation.push_back(toGlm(channel->mRotationKeys[j].mValue));
+            }
+            if (!channel->mNumRotationKeys) {
+                keyTime[TRACK_ROTATION].push_back(0.0f);
+                rotation.push_back(toGlm(bindRotation));
+            }
+            for (unsigned int j = 0; j < channel->mNumPositionKeys; j++) {
+                keyTime[TRACK_POSITION].push_back((float) (channel->mPositionKeys[j].mTime / ticksPerSecond));
+                position.push_back(toGlm(channel->mPositionKeys[j].mValue));
+            }
+            if (!channel->mNumPositionKeys) {
+                keyTime[TRACK_POSITION].push_back(0.0f);
+                position.push_back(toGlm(bindPosition));
+            }
+            for (unsigned int j = 0; j < channel->mNumScalingKeys; j++) {
+                keyTime[TRACK_SCALE].push_back((float) (channel->mScalingKeys[j].mTime / ticksPerSecond));
+                scale.push_back(toGlm(channel->mScalingKeys[j].mValue));
+            }
+            if (!channel->mNumScalingKeys) {
+                keyTime[TRACK_SCALE].push_back(0.0f);
+                scale.push_back(toGlm(bindScale));
+            }
+            for (int k = 0; k < TRACK_KIND_NUM; k++) keyBegin[k].push_back((uint32_t) keyTime[k].size());
+        }
+        return !empty();
+    }
+
+    void AnimationClip::clear() {
+        name = std::string();
+        duration = 0.0f;
+        compressed = false;
+        channelNode.clear();
+        channelInvBind.clear();
+        for (int k = 0; k < TRACK_KIND_NUM; k++) {
+            keyBegin[k].clear();
+            keyTime[k].clear();
+        }
+        rotation.clear();
+        position.clear();
+        scale.clear();
+        packedRotation.clear();
+        packedPosition.clear();
+        packedScale.clear();
+        positionRange.clear();
+        scaleRange.clear();
+    }
+
+    size_t AnimationClip::byteNum() const {
+        size_t total = 0;
+        for (int k = 0; k < TRACK_KIND_NUM; k++) total += sizeof(float) * keyTime[k].size();
+        total += sizeof(glm::fquat) * rotation.size() + sizeof(glm::fvec3) * (position.size() + scale.size());
+        total += sizeof(uint16_t) * (packedRotation.size() + packedPosition.size() + packedScale.size());
+        return total + sizeof(glm::fvec3) * (positionRange.size() + scaleRange.size());
+    }
+
+    bool AnimationClip::compress(const ClipTolerance &_tolerance, ClipCompressionReport *_report) {
+        if (compressed || empty()) return false;
+        AnimationClip packed;
+        packed.name = name;
+        packed.duration = duration;
+        packed.channelNode = channelNode;
+        packed.channelInvBind = channelInvBind;
+        packed.compressed = true;
+        for (int k = 0; k < TRACK_KIND_NUM; k++) packed.keyBegin[k].push_back(0);
+
+        std::vector<uint32_t> kept;
+        for (size_t c = 0; c < channelNode.size(); c++) {
+            BoneHandle node = channelNode[c];
+            float nodeScale = (size_t) node < _tolerance.nodeScale.size() ? _tolerance.nodeScale[node] : 1.0f;
+
+            const float *time = keyTime[TRACK_ROTATION].data();
+            uint32_t begin = keyBegin[TRACK_ROTATION][c], end = keyBegin[TRACK_ROTATION][c + 1];
+            reduceTrack(time, rotation.data(), begin, end, _tolerance.rotation * nodeScale,
+                        [](const glm::fquat &_q) {
+                            uint16_t bits[3];
+                            packRotation(_q, bits);
+                            return unpackRotation(bits);
+                        }, nlerp, rotationError, kept);
+            for (size_t i = 0; i < kept.size(); i++) {
+                uint16_t bits[3];
+                packRotation(rotation[kept[i]], bits);
+                packed.keyTime[TRACK_ROTATION].push_back(time[kept[i]]);
+                packed.packedRotation.insert(packed.packedRotation.end(), bits, bits + 3);
+            }
+
+            // Positions and scales share everything but their tolerance
+            for (int k = TRACK_POSITION; k <= TRACK_SCALE; k++) {
+                const std::vector<glm::fvec3> &value = k == TRACK_POSITION ? position : scale;
+                std::vector<uint16_t> &packedValue = k == TRACK_POSITION ? packed.packedPosition : packed.packedScale;
+                std::vector<glm::fvec3> &range = k == TRACK_POSITION ? packed.positionRange : packed.scaleRange;
+                float tolerance = (k == TRACK_POSITION ? _tolerance.position : _tolerance.scale) * nodeScale;
+                time = keyTime[k].data();
+                begin = keyBegin[k][c];
+                end = keyBegin[k][c + 1];
+
+                glm::fvec3 lower = value[begin], upper = value[begin];
+                for (uint32_t j = begin; j < end; j++) {
+                    lower = glm::min(lower, value[j]);
+                    upper = glm::max(upper, value[j]);
+                }
+                glm::fvec3 extent = upper - lower;
+                range.push_back(lower);
+                range.push_back(extent);
+                reduceTrack(time, value.data(), begin, end, tolerance,
+                            [&lower, &extent](const glm::fvec3 &_v) {
+                                uint16_t bits[3];
+                                packVector(_v, lower, extent, bits);
+                                return unpackVector(bits, lower, extent);
+                            }, blendVector, vectorError, kept);
+                for (size_t i = 0; i < kept.size(); i++) {
+                    uint16_t bits[3];
+                    packVector(value[kept[i]], lower, extent, bits);
+                    packed.keyTime[k].push_back(time[kept[i]]);
+                    packedValue.insert(packedValue.end(), bits, bits + 3);
+                }
+            }
+            for (int k = 0; k < TRACK_KIND_NUM; k++) packed.keyBegin[k].push_back((uint32_t) packed.keyTime[k].size());
+        }
+
+        if (_report) {
+            ClipCompressionReport &report = *_report;
+            report.keyNum = report.keptKeyNum = 0;
+            report.rawBytes = byteNum();
+            report.compressedBytes = packed.byteNum();
+            report.maxRotationError = report.maxPositionError = report.maxScaleError = 0.0f;
+            float *maxError[TRACK_KIND_NUM] = {&report.maxRotationError, &report.maxPositionError,
+                                               &report.maxScaleError};
+            // Measured where the reduction checked, at every original key and halfway to the next
+            for (int k = 0; k < TRACK_KIND_NUM; k++) {
+                report.keyNum += keyTime[k].size();
+                report.keptKeyNum += packed.keyTime[k].size();
+                const float *time = packed.keyTime[k].data();
+                for (size_t c = 0; c < channelNode.size(); c++) {
+                    uint32_t begin = packed.keyBegin[k][c], end = packed.keyBegin[k][c + 1];
+                    for (uint32_t j = keyBegin[k][c]; j < keyBegin[k][c + 1]; j++) {
+                        bool last = j + 1 == keyBegin[k][c + 1];
+                        for (int half = 0; half < (last ? 1 : 2); half++) {
+                            float at = half ? 0.5f * (keyTime[k][j] + keyTime[k][j + 1]) : keyTime[k][j];
+                            uint32_t next, key = seekKey(time, begin, end, begin, at);
+                            float factor = keyFactor(time, key, end, at, next);
+                            float error;
+                            if (k == TRACK_ROTATION)
+                                error = rotationError(nlerp(packed.rotationAt(key), packed.rotationAt(next), factor),
+                                                      half ? nlerp(rotation[j], rotation[j + 1], 0.5f) : rotation[j]);
+                            else if (k == TRACK_POSITION)
+                                error = vectorError(glm::mix(packed.positionAt(c, key), packed.positionAt(c, next),
+                                                             factor),
+                                                    half ? glm::mix(position[j], position[j + 1], 0.5f) : position[j]);
+                            else
+                                error = vectorError(glm::mix(packed.scaleAt(c, key), packed.scaleAt(c, next), factor),
+                                                    half ? glm::mix(scale[j], scale[j + 1], 0.5f) : scale[j]);
+                            *maxError[k] = std::max(*maxError[k], error);
+                        }
+                    }
+                }
+            }
+        }
+        *this = packed;
+        return true;
+    }
+
+    glm::fquat AnimationClip::rotationAt(uint32_t _key) const {
+        return compressed ? unpackRotation(&packedRotation[3 * (size_t) _key]) : rotation[_key];
+    }
+
+    glm::fvec3 AnimationClip::positionAt(size_t _channel, uint32_t _key) const {
+        return compressed ? unpackVector(&packedPosition[3 * (size_t) _key], positionRange[2 * _channel],
+                                         positionRange[2 * _channel + 1])
+                          : position[_key];
+    }
+
+    glm::fvec3 AnimationClip::scaleAt(size_t _channel, uint32_t _key) const {
+        return compressed ? unpackVector(&packedScale[3 * (size_t) _key], scaleRange[2 * _channel],
+                                         scaleRange[2 * _channel + 1])
+                          : scale[_key];
+    }
+
+    void AnimationClip::write(SceneCache::Writer &_writer, uint32_t _firstSection) const {
+        _writer.addStrings(_firstSection + CLIP_SECTION_NAME, std::vector<std::string>(1, name));
+        _writer.add(_firstSection + CLIP_SECTION_DURATION, &duration, sizeof(duration));
+        _writer.addVector(_firstSection + CLIP_SECTION_NODES, channelNode);
+        _writer.addVector(_firstSection + CLIP_SECTION_INV_BINDS, channelInvBind);
+        for (int k = 0; k < TRACK_KIND_NUM; k++) {
+            _writer.addVector(_firstSection + CLIP_SECTION_KEY_BEGINS + k, keyBegin[k]);
+            _writer.addVector(_firstSection + CLIP_SECTION_KEY_TIMES + k, keyTime[k]);
+        }
+        _writer.addVector(_firstSection + CLIP_SECTION_ROTATIONS, rotation);
+        _writer.addVector(_firstSection + CLIP_SECTION_POSITIONS, position);
+        _writer.addVector(_firstSection + CLIP_SECTION_SCALES, scale);
+        uint32_t packedFlag = compressed ? 1 : 0;
+        _writer.add(_firstSection + CLIP_SECTION_COMPRESSED, &packedFlag, sizeof(packedFlag));
+        _writer.addVector(_firstSection + CLIP_SECTION_PACKED_ROTATIONS, packedRotation);
+        _writer.addVector(_firstSection + CLIP_SECTION_PACKED_POSITIONS, packedPosition);
+        _writer.addVector(_firstSection + CLIP_SECTION_PACKED_SCALES, packedScale);
+        _writer.addVector(_firstSection + CLIP_SECTION_POSITION_RANGES, positionRange);
+        _writer.addVector(_firstSection + CLIP_SECTION_SCALE_RANGES, scaleRange);
+    }
+
+    bool AnimationClip::read(const SceneCache::Reader &_reader, uint32_t _firstSection) {
+        AnimationClip loaded;
+        std::vector<std::string> names;
+        std::vector<float> durations;
+        std::vector<uint32_t> packedFlag;
+        bool complete = _reader.getStrings(_firstSection + CLIP_SECTION_NAME, names) && names.size() == 1 &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_DURATION, durations) && durations.size() == 1 &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_NODES, loaded.channelNode) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_INV_BINDS, loaded.channelInvBind) &&
+                        loaded.channelInvBind.size() == loaded.channelNode.size() &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_ROTATIONS, loaded.rotation) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_POSITIONS, loaded.position) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_SCALES, loaded.scale) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_COMPRESSED, packedFlag) &&
+                        packedFlag.size() == 1 &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_PACKED_ROTATIONS, loaded.packedRotation) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_PACKED_POSITIONS, loaded.packedPosition) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_PACKED_SCALES, loaded.packedScale) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_POSITION_RANGES, loaded.positionRange) &&
+                        _reader.getVector(_firstSection + CLIP_SECTION_SCALE_RANGES, loaded.scaleRange);
+        loaded.compressed = complete && packedFlag[0] != 0;
+        size_t valueNum[TRACK_KIND_NUM] = {loaded.rotation.size(), loaded.position.size(), loaded.scale.size()};
+        if (loaded.compressed) {
+            valueNum[TRACK_ROTATION] = loaded.packedRotation.size() / 3;
+            valueNum[TRACK_POSITION] = loaded.packedPosition.size() / 3;
+            valueNum[TRACK_SCALE] = loaded.packedScale.size() / 3;
+            complete = loaded.packedRotation.size() % 3 == 0 && loaded.packedPosition.size() % 3 == 0 &&
+                       loaded.packedScale.size() % 3 == 0 &&
+                       loaded.positionRange.size() == 2 * loaded.channelNode.size() &&
+                       loaded.scaleRange.size() == 2 * loaded.channelNode.size();
+        }
+        for (int k = 0; complete && k < TRACK_KIND_NUM; k++) {
+            std::vector<uint32_t> &begin = loaded.keyBegin[k];
+            complete = _reader.getVector(_firstSection + CLIP_SECTION_KEY_BEGINS + k, begin) &&
+                       _reader.getVector(_firstSection + CLIP_SECTION_KEY_TIMES + k, loaded.keyTime[k]) &&
+                       loaded.keyTime[k].size() == valueNum[k] &&
+                       begin.size() == loaded.channelNode.size() + 1 && begin.front() == 0 &&
+                       begin.back() == valueNum[k];
+            // Sampling relies on every track having a key
+            for (size_t c = 0; complete && c + 1 < begin.size(); c++) complete = begin[c] < begin[c + 1];
+        }
+        if (!complete) return false;
+        loaded.name = names[0];
+        loaded.duration = durations[0];
+        *this = loaded;
+        return true;
+    }
+
+    void ClipPlayer::bind(const AnimationClip &_clip, bool _looping) {
+        clip = &_clip;
+        looping = _looping;
+        rewind();
+    }
+
+    void ClipPlayer::rewind() {
+        if (!clip) return;
+        for (int k = 0; k < TRACK_KIND_NUM; k++) {
+            const std::vector<uint32_t> &begin = clip->keyBegin[k];
+            cursor[k].assign(begin.begin(), begin.empty() ? begin.end() : begin.end() - 1);
+        }
+    }
+
+    void ClipPlayer::sample(float _time, SkeletonModifier &_modifier) {
+        if (!clip) return;
+        const AnimationClip &source = *clip;
+        float duration = source.duration;
+        if (looping && duration > 0.0f) {
+            _time = std::fmod(_time, duration);
+            if (_time < 0.0f) _time += duration;
+        } else {
+            _time = glm::clamp(_time, 0.0f, duration);
+        }
+
+        const uint32_t *rotationBegin = source.keyBegin[TRACK_ROTATION].data();
+        const uint32_t *positionBegin = source.keyBegin[TRACK_POSITION].data();
+        const uint32_t *scaleBegin = source.keyBegin[TRACK_SCALE].data();
+        const float *rotationTime = source.keyTime[TRACK_ROTATION].data();
+        const float *positionTime = source.keyTime[TRACK_POSITION].data();
+        const float *scaleTime = source.keyTime[TRACK_SCALE].data();
+        uint32_t *rotationCursor = cursor[TRACK_ROTATION].data();
+        uint32_t *positionCursor = cursor[TRACK_POSITION].data();
+        uint32_t *scaleCursor = cursor[TRACK_SCALE].data();
+        for (size_t c = 0; c < source.channelNode.size(); c++) {
+            uint32_t next;
+            uint32_t key = rotationCursor[c] = seekKey(rotationTime, rotationBegin[c], rotationBegin[c + 1],
+                                                      rotationCursor[c], _time);
+            float factor = keyFactor(rotationTime, key, rotationBegin[c + 1], _time, next);
+            glm::fquat r = nlerp(source.rotationAt(key), source.rotationAt(next), factor);
+
+            key = positionCursor[c] = seekKey(positionTime, positionBegin[c], positionBegin[c + 1],
+                                              positionCursor[c], _time);
+            factor = keyFactor(positionTime, key, positionBegin[c + 1], _time, next);
+            glm::fvec3 p = glm::mix(source.positionAt(c, key), source.positionAt(c, next), factor);
+
+            key = scaleCursor[c] = seekKey(scaleTime, scaleBegin[c], scaleBegin[c + 1], scaleCursor[c], _time);
+            factor = keyFactor(scaleTime, key, scaleBegin[c + 1], _time, next);
+            glm::fvec3 s = glm::mix(source.scaleAt(c, key), source.scaleAt(c, next), factor);
+
+            // Translation * rotation * scale, as Assimp composes node transforms
+            glm::fmat4 local = glm::mat4_cast(r);
+            local[0] *= s.x;
+            local[1] *= s.y;
+            local[2] *= s.z;
+            local[3] = glm::fvec4(p, 1.0f);
+            _modifier.set(source.channelNode[c], source.channelInvBind[c] * local);
+        }
+    }
+}
@@ -0,0 +1,161 @@
+// Keyframe Animation Clips
+// An aiAnimation is imported once into tracks laid out as structures of arrays:
+// per key kind, the key times of all channels back to back with their values in a
+// parallel array, every channel owning one contiguous range. Playback keeps a key
+// cursor per channel and instance, so sampling forward in time steps to the next
+// key instead of searching for it.
+//
+// A clip may be compressed in place: keys that interpolation from their neighbours
+// reproduces within a tolerance are dropped, rotations are packed as the smallest
+// three components in 48 bits and positions and scales as 16 bits per component,
+// normalized over the range of their channel. Players decode while they sample.
+//
+//     SkeletalMesh::AnimationClip clip;
+//     clip.import(scene->mAnimations[0], skeleton);
+//     SkeletalMesh::ClipPlayer player(clip);
+//     per frame: player.sample(seconds, modifier); ... skeleton.update(modifier);
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <assimp/anim.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "skeleton.h"
+#include "scene_cache.h"
+
+namespace SkeletalMesh {
+    enum TrackKind {
+        TRACK_ROTATION = 0,
+        TRACK_POSITION,
+        TRACK_SCALE,
+        TRACK_KIND_NUM
+    };
+
+    // Sections one clip takes in a SceneCache container
+    const uint32_t CLIP_SECTION_NUM = 19;
+
+    // Deviation compress() may introduce in a node's local transform
+    struct ClipTolerance {
+        float rotation;
+        float position;
+        float scale;
+        // Per node, multiplies the tolerances above, empty for 1 everywhere. Errors near the root
+        // move everything below, so long chains want their upper nodes tighter.
+        std::vector<float> nodeScale;
+
+        // About three hundredths of a degree, a twentieth of a millimetre at centimetre units
+        ClipTolerance() : rotation(5e-4f), position(5e-3f), scale(1e-4f) {}
+    };
+
+    struct ClipCompressionReport {
+        size_t keyNum;
+        size_t keptKeyNum;
+        size_t rawBytes;
+        size_t compressedBytes;
+        // Largest error measured at every original key, rotation in radians
+        float maxRotationError;
+        float maxPositionError;
+        float maxScaleError;
+
+        float ratio() const { return compressedBytes ? (float) rawBytes / compressedBytes : 0.0f; }
+    };
+
+    class AnimationClip {
+    public:
+        AnimationClip() : duration(0.0f), compressed(false) {}
+
+        // Times are converted to seconds. Channels of nodes missing from _skeleton are dropped,
+        // any node may be animated, not only bones, since FBX pivots add helper nodes to chains.
+        bool import(const aiAnimation *_animation, const Skeleton &_skeleton);
+
+        void clear();
+
+        bool empty() const { return channelNode.empty(); }
+
+        const std::string &getName() const { return name; }
+
+        float getDuration() const { return duration; }
+
+        size_t channelNum() const { return channelNode.size(); }
+
+        BoneHandle getChannelNode(size_t _channel) const { return channelNode[_channel]; }
+
+        // Keys of one kind over all channels
+        size_t keyNum(TrackKind _kind) const { return keyTime[_kind].size(); }
+
+        // Memory taken by the keys
+        size_t byteNum() const;
+
+        bool isCompressed() const { return compressed; }
+
+        // Reduces and packs the keys within _tolerance. Quantization counts against the tolerance,
+        // but a tolerance below the quantization step of a channel can not be met; _report tells.
+        bool compress(const ClipTolerance &_tolerance, ClipCompressionReport *_report = NULL);
+
+        // Uses sections _firstSection to _firstSection + CLIP_SECTION_NUM - 1
+        void write(SceneCache::Writer &_writer, uint32_t _firstSection) const;
+
+        bool read(const SceneCache::Reader &_reader, uint32_t _firstSection);
+
+    private:
+        friend class ClipPlayer;
+
+        std::string name;
+        float duration;
+        std::vector<BoneHandle> channelNode;
+        // Per channel, samples are turned into modifiers by this, inverse(localBind) of the node
+        std::vector<glm::fmat4> channelInvBind;
+        // Keys of kind k in channel c are [keyBegin[k][c], keyBegin[k][c + 1])
+        std::vector<uint32_t> keyBegin[TRACK_KIND_NUM];
+        std::vector<float> keyTime[TRACK_KIND_NUM];
+        // Values of uncompressed clips
+        std::vector<glm::fquat> rotation;
+        std::vector<glm::fvec3> position;
+        std::vector<glm::fvec3> scale;
+        // Values of compressed clips, three words per key
+        bool compressed;
+        std::vector<uint16_t> packedRotation;
+        std::vector<uint16_t> packedPosition;
+        std::vector<uint16_t> packedScale;
+        // Per channel, the minimum and extent packed positions and scales are normalized over
+        std::vector<glm::fvec3> positionRange;
+        std::vector<glm::fvec3> scaleRange;
+
+        glm::fquat rotationAt(uint32_t _key) const;
+
+        glm::fvec3 positionAt(size_t _channel, uint32_t _key) const;
+
+        glm::fvec3 scaleAt(size_t _channel, uint32_t _key) const;
+    };
+
+    // Playback state of one clip on one instance. The clip must outlive the player.
+    class ClipPlayer {
+    public:
+        ClipPlayer() : clip(NULL), looping(true) {}
+
+        explicit ClipPlayer(const AnimationClip &_clip, bool _looping = true) : clip(NULL) { bind(_clip, _looping); }
+
+        void bind(const AnimationClip &_clip, bool _looping = true);
+
+        const AnimationClip *getClip() const { return clip; }
+
+        // Forgets the key cursors, the next sample searches every channel
+        void rewind();
+
+        // Writes the pose at _time seconds into _modifier, wrapped into the clip when looping and
+        // clamped to it otherwise. A channel costs constant time while _time moves forward by about
+        // a key per call, jumping back or far ahead falls back to a binary search.
+        void sample(float _time, SkeletonModifier &_modifier);
+
+    private:
+        const AnimationClip *clip;
+        bool looping;
+        // Per kind and channel, absolute index of the last key at or before the previous sample
+        std::vector<uint32_t> cursor[TRACK_KIND_NUM];
+    };
+}
@@ -0,0 +1,40 @@
+// Hand Benchmarks
+// Each benchmark is a plain function taking the remaining command line arguments.
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "skeleton.h"
+
+namespace Benchmark {
+    typedef int (*Entry)(int argc, char *argv[]);
+
+    inline double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Random rigid rig where every node is a bone, node i's parent is one of the nodes before it.
+    // The same seed always gives the same rig.
+    void buildSyntheticSkeleton(SkeletalMesh::Skeleton &skeleton, int boneNum, unsigned seed);
+
+    // A random rigid transform per bone, as an animation would produce
+    void buildSyntheticPose(std::vector<glm::fmat4> &pose, int boneNum, unsigned seed);
+
+    int affine(int argc, char *argv[]);
+
+    int animation(int argc, char *argv[]);
+
+    int assembly(int argc, char *argv[]);
+
+    int crowd(int argc, char *argv[]);
+
+    int gesture(int argc, char *argv[]);
+
+    int import(int argc, char *argv[]);
+
+    int skinning(int argc, char *argv[]);
+
+    int texture(int argc, char *argv[]);
+}
@@ -0,0 +1,125 @@
+// Bone composition microbenchmark
+// Usage: HandBench affine [bone counts...]
+// Compares the per-bone cost of the original aiMatrix4x4 path (three 4x4 products,
+// transpose and memcpy into glm) against every AffineMath kernel the CPU supports.
+
+#include "benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace Benchmark {
+    namespace {
+        aiMatrix4x4 toAssimp(const glm::fmat4 &_m) {
+            aiMatrix4x4 m;
+            glm::fmat4 t = glm::transpose(_m);
+            memcpy(&m, &t, sizeof(m));
+            return m;
+        }
+
+        // The pre-flattening evaluator, minus the recursion and name lookups
+        struct AssimpRig {
+            std::vector<int> parent;
+            std::vector<aiMatrix4x4> local;
+            std::vector<aiMatrix4x4> offset;
+            std::vector<aiMatrix4x4> global;
+            aiMatrix4x4 invTransf;
+
+            explicit AssimpRig(const SkeletalMesh::Skeleton &skeleton)
+                    : parent(skeleton.parent), global(skeleton.nodeNum()) {
+                for (size_t i = 0; i < skeleton.nodeNum(); i++) {
+                    local.push_back(toAssimp(AffineMath::toMat4(skeleton.localBind[i])));
+                    offset.push_back(toAssimp(AffineMath::toMat4(skeleton.offset[i])));
+                }
+                invTransf = toAssimp(AffineMath::toMat4(skeleton.invRoot));
+            }
+
+            void evaluate(const std::vector<glm::fmat4> &modifier, SkeletalMesh::SkeletonTransf &transf) {
+                transf.resize(parent.size());
+                for (size_t i = 0; i < parent.size(); i++) {
+                    aiMatrix4x4 globalTransf = (parent[i] < 0 ? aiMatrix4x4() : global[parent[i]]) * local[i];
+                    aiMatrix4x4 boneMod;
+                    glm::fmat4 trans = glm::transpose(modifier[i]);
+                    memcpy(&boneMod, &trans, 16 * sizeof(float));
+                    globalTransf *= boneMod;
+                    global[i] = globalTransf;
+                    aiMatrix4x4 finalMtrx = invTransf * globalTransf * offset[i];
+                    memcpy(&transf[i], &finalMtrx.Transpose(), sizeof(transf[i]));
+                }
+            }
+        };
+
+        float maxDifference(const SkeletalMesh::SkeletonTransf &a, const glm::fmat4 *b) {
+            float diff = 0.0f;
+            for (size_t i = 0; i < a.size(); i++)
+                for (int c = 0; c < 4; c++)
+                    for (int r = 0; r < 4; r++)
+                        diff = std::max(diff, std::fabs(a[i][c][r] - b[i][c][r]));
+            return diff;
+        }
+
+        // Enough iterations for roughly 50M bones per measurement
+        int iterationsFor(int boneNum) {
+            return std::max(1, 50000000 / boneNum / 16);
+        }
+    }
+
+    int affine(int argc, char *argv[]) {
+        std::vector<int> boneCounts;
+        for (int i = 0; i < argc; i++) boneCounts.push_back(atoi(argv[i]));
+        if (boneCounts.empty()) {
+            boneCounts.push_back(21);
+            boneCounts.push_back(256);
+            boneCounts.push_back(4096);
+            boneCounts.push_back(65536);
+        }
+
+        AffineMath::Isa bestIsa = AffineMath::detectIsa();
+        printf("%8s %-10s %10s %12s\n", "bones", "path", "ns/bone", "max error");
+        for (size_t b = 0; b < boneCounts.size(); b++) {
+            int boneNum = boneCounts[b];
+            if (boneNum <= 0) continue;
+            int iterations = iterationsFor(boneNum);
+
+            SkeletalMesh::Skeleton skeleton;
+            buildSyntheticSkeleton(skeleton, boneNum, 1);
+            // Two poses alternate so that every bone is dirty on every iteration
+            std::vector<glm::fmat4> pose[2];
+            buildSyntheticPose(pose[0], boneNum, 2);
+            buildSyntheticPose(pose[1], boneNum, 3);
+
+            SkeletalMesh::SkeletonTransf reference;
+            {
+                AssimpRig rig(skeleton);
+                double begin = now();
+                for (int it = 0; it < iterations; it++)
+                    rig.evaluate(pose[it & 1], reference);
+                double elapsed = now() - begin;
+                rig.evaluate(pose[(iterations - 1) & 1], reference);
+                printf("%8d %-10s %10.2f %12s\n", boneNum, "aiMatrix4x4",
+                       elapsed * 1e9 / ((double) iterations * boneNum), "-");
+            }
+
+            for (int isa = AffineMath::ISA_SCALAR; isa <= bestIsa; isa++) {
+                AffineMath::setIsa((AffineMath::Isa) isa);
+                SkeletalMesh::SkeletonModifier modifier(skeleton);
+                double begin = now();
+                for (int it = 0; it < iterations; it++) {
+                    const std::vector<glm::fmat4> &cur = pose[it & 1];
+                    for (int i = 0; i < boneNum; i++)
+                        modifier.set(i, cur[i]);
+                    skeleton.update(modifier);
+                }
+                double elapsed = now() - begin;
+                printf("%8d %-10s %10.2f %12.3g\n", boneNum, AffineMath::isaName((AffineMath::Isa) isa),
+                       elapsed * 1e9 / ((double) iterations * boneNum),
+                       maxDifference(reference, modifier.getTransform()));
+            }
+        }
+        AffineMath::setIsa(bestIsa);
+        return 0;
+    }
+}
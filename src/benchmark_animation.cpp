@@ -0,0 +1,168 @@
+// Keyframe clip sampling benchmark
+// Usage: HandBench animation [-n instance,counts] [-k keys per second]
+// A library of 16 synthetic 4 second clips on a 21-bone hand, every instance playing one
+// of them from its own start time at 60 frames per second. Sampling with the key cursors
+// carried from frame to frame is compared against searching every key from scratch, as a
+// stateless sampler has to. Both must produce the same modifiers.
+// The library is also compressed with the default tolerances; the size, kept keys and the
+// largest joint-space error of every clip are listed, and sampling the compressed copies is
+// timed next to the raw ones.
+
+#include "benchmark.h"
+#include "animation_clip.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <string>
+#include <algorithm>
+
+#include <assimp/anim.h>
+
+namespace Benchmark {
+    namespace {
+        const int ANIMATION_CLIP_NUM = 16;
+        const int ANIMATION_BONE_NUM = 21;
+        const double ANIMATION_SECONDS = 4.0;
+        const int ANIMATION_FRAMES = 120;
+        const float ANIMATION_FRAME_SECONDS = 1.0f / 60.0f;
+
+        std::vector<int> parseCounts(const char *_list) {
+            std::vector<int> values;
+            std::string list(_list);
+            size_t begin = 0;
+            while (begin <= list.size()) {
+                size_t end = list.find(',', begin);
+                if (end == std::string::npos) end = list.size();
+                int value = atoi(list.substr(begin, end - begin).c_str());
+                if (value > 0) values.push_back(value);
+                begin = end + 1;
+            }
+            return values;
+        }
+
+        // Every bone rotates back and forth around its own axis and drifts a little, keys in ticks
+        aiAnimation *buildSyntheticAnimation(int _boneNum, int _keysPerSecond, unsigned _seed) {
+            const double ticksPerSecond = 1000.0;
+            std::mt19937 rng(_seed);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            int keyNum = (int) (ANIMATION_SECONDS * _keysPerSecond) + 1;
+
+            aiAnimation *animation = new aiAnimation();
+            animation->mName = aiString("clip" + std::to_string(_seed));
+            animation->mTicksPerSecond = ticksPerSecond;
+            animation->mDuration = ANIMATION_SECONDS * ticksPerSecond;
+            animation->mNumChannels = _boneNum;
+            animation->mChannels = new aiNodeAnim *[_boneNum];
+            for (int b = 0; b < _boneNum; b++) {
+                aiNodeAnim *channel = animation->mChannels[b] = new aiNodeAnim();
+                channel->mNodeName = aiString("bone" + std::to_string(b));
+                aiVector3D axis(unit(rng), unit(rng), unit(rng) + 2.0f);
+                axis.Normalize();
+                float amplitude = 0.5f + 0.5f * unit(rng), frequency = 1.0f + unit(rng) * 0.5f;
+                channel->mNumRotationKeys = channel->mNumPositionKeys = channel->mNumScalingKeys = keyNum;
+                channel->mRotationKeys = new aiQuatKey[keyNum];
+                channel->mPositionKeys = new aiVectorKey[keyNum];
+                channel->mScalingKeys = new aiVectorKey[keyNum];
+                for (int k = 0; k < keyNum; k++) {
+                    double seconds = (double) k / _keysPerSecond;
+                    float angle = amplitude * (float) std::sin(seconds * frequency * 2.0 * M_PI);
+                    channel->mRotationKeys[k] = aiQuatKey(seconds * ticksPerSecond, aiQuaternion(axis, angle));
+                    channel->mPositionKeys[k] = aiVectorKey(seconds * ticksPerSecond,
+                                                            aiVector3D(0.1f * angle, 1.0f, 0.0f));
+                    channel->mScalingKeys[k] = aiVectorKey(seconds * ticksPerSecond, aiVector3D(1.0f));
+                }
+            }
+            return animation;
+        }
+    }
+
+    int animation(int argc, char *argv[]) {
+        std::vector<int> instanceCounts = parseCounts("100,1000,10000");
+        int keysPerSecond = 30;
+        for (int i = 0; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "-n") == 0) instanceCounts = parseCounts(argv[i + 1]);
+            else if (strcmp(argv[i], "-k") == 0) keysPerSecond = std::max(1, atoi(argv[i + 1]));
+        }
+
+        SkeletalMesh::Skeleton hand;
+        buildSyntheticSkeleton(hand, ANIMATION_BONE_NUM, 1);
+        std::vector<SkeletalMesh::AnimationClip> clips(ANIMATION_CLIP_NUM), packedClips(ANIMATION_CLIP_NUM);
+        size_t clipBytes = 0, packedBytes = 0;
+        printf("%d clips, %d keys per second\n", ANIMATION_CLIP_NUM, keysPerSecond);
+        printf("%8s %10s %10s %10s %10s %8s %12s %12s %12s %10s\n", "clip", "keys", "kept", "raw KB", "packed KB",
+               "ratio", "rot err deg", "pos err", "scale err", "pack ms");
+        for (int c = 0; c < ANIMATION_CLIP_NUM; c++) {
+            aiAnimation *animation = buildSyntheticAnimation(ANIMATION_BONE_NUM, keysPerSecond, c + 1);
+            if (!clips[c].import(animation, hand)) return 1;
+            delete animation;
+
+            SkeletalMesh::ClipCompressionReport report;
+            packedClips[c] = clips[c];
+            double begin = now();
+            if (!packedClips[c].compress(SkeletalMesh::ClipTolerance(), &report)) return 1;
+            double packSeconds = now() - begin;
+            clipBytes += report.rawBytes;
+            packedBytes += report.compressedBytes;
+            printf("%8s %10zu %10zu %10.1f %10.1f %7.1fx %12.5f %12.6f %12.6f %10.2f\n", clips[c].getName().c_str(),
+                   report.keyNum, report.keptKeyNum, report.rawBytes / 1024.0, report.compressedBytes / 1024.0,
+                   report.ratio(), report.maxRotationError * 180.0 / M_PI, report.maxPositionError,
+                   report.maxScaleError, packSeconds * 1e3);
+        }
+        printf("%8s %10s %10s %10.1f %10.1f %7.1fx\n\n", "all", "", "", clipBytes / 1024.0, packedBytes / 1024.0,
+               (double) clipBytes / packedBytes);
+
+        printf("%10s %12s %12s %12s %14s %14s %14s %10s %12s\n", "instances", "cursor ms", "search ms", "packed ms",
+               "cursor ns/ch", "search ns/ch", "packed ns/ch", "speedup", "mismatches");
+        for (size_t n = 0; n < instanceCounts.size(); n++) {
+            int instanceNum = instanceCounts[n];
+            std::vector<SkeletalMesh::ClipPlayer> players(instanceNum);
+            std::vector<SkeletalMesh::SkeletonModifier> cursorPose(instanceNum, SkeletalMesh::SkeletonModifier(hand));
+            std::vector<SkeletalMesh::SkeletonModifier> searchPose(cursorPose);
+            std::vector<float> start(instanceNum);
+            std::mt19937 rng(7);
+            std::uniform_real_distribution<float> offset(0.0f, (float) ANIMATION_SECONDS);
+            for (int i = 0; i < instanceNum; i++) {
+                players[i].bind(clips[i % ANIMATION_CLIP_NUM]);
+                start[i] = offset(rng);
+            }
+            std::vector<SkeletalMesh::ClipPlayer> searchPlayers(players), packedPlayers(instanceNum);
+            for (int i = 0; i < instanceNum; i++) packedPlayers[i].bind(packedClips[i % ANIMATION_CLIP_NUM]);
+            std::vector<SkeletalMesh::SkeletonModifier> packedPose(cursorPose);
+
+            double cursorSeconds = 0.0, searchSeconds = 0.0, packedSeconds = 0.0;
+            size_t mismatches = 0;
+            for (int f = 0; f < ANIMATION_FRAMES; f++) {
+                float time = f * ANIMATION_FRAME_SECONDS;
+                double begin = now();
+                for (int i = 0; i < instanceNum; i++) players[i].sample(start[i] + time, cursorPose[i]);
+                cursorSeconds += now() - begin;
+
+                begin = now();
+                for (int i = 0; i < instanceNum; i++) {
+                    searchPlayers[i].rewind();
+                    searchPlayers[i].sample(start[i] + time, searchPose[i]);
+                }
+                searchSeconds += now() - begin;
+
+                begin = now();
+                for (int i = 0; i < instanceNum; i++) packedPlayers[i].sample(start[i] + time, packedPose[i]);
+                packedSeconds += now() - begin;
+
+                for (int i = 0; i < instanceNum; i++)
+                    for (int b = 0; b < ANIMATION_BONE_NUM; b++)
+                        if (cursorPose[i].get(b) != searchPose[i].get(b)) mismatches++;
+            }
+
+            double samples = (double) instanceNum * ANIMATION_BONE_NUM * ANIMATION_FRAMES;
+            printf("%10d %12.3f %12.3f %12.3f %14.1f %14.1f %14.1f %9.2fx %12zu\n", instanceNum,
+                   cursorSeconds * 1e3 / ANIMATION_FRAMES, searchSeconds * 1e3 / ANIMATION_FRAMES,
+                   packedSeconds * 1e3 / ANIMATION_FRAMES, cursorSeconds / samples * 1e9,
+                   searchSeconds / samples * 1e9, packedSeconds / samples * 1e9, searchSeconds / cursorSeconds,
+                   mismatches);
+        }
+        return 0;
+    }
+}
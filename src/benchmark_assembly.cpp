@@ -0,0 +1,176 @@
+// Load-time assembly benchmark
+// Usage: HandBench assembly [vertex count] [thread count]
+// Builds a synthetic imported scene of skinned meshes sharing part of their bones and assembles
+// it the way loading used to, growing the streams one element at a time, then with the two-pass
+// MeshAssembler on the calling thread and on the pool. Reports million vertices per second and
+// whether every result matches the old one.
+
+#include "benchmark.h"
+#include "mesh_assembler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+namespace Benchmark {
+    namespace {
+        const unsigned ASSEMBLY_MESH_NUM = 16;
+        const unsigned ASSEMBLY_MESH_BONE_NUM = 48;
+        const unsigned ASSEMBLY_BONE_NAME_NUM = 96;
+        const int ASSEMBLY_REPEATS = 5;
+
+        aiScene *buildSyntheticScene(unsigned _vertexNum, unsigned _seed) {
+            std::mt19937 rng(_seed);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            aiScene *scene = new aiScene();
+            scene->mNumMeshes = ASSEMBLY_MESH_NUM;
+            scene->mMeshes = new aiMesh *[ASSEMBLY_MESH_NUM];
+            for (unsigned m = 0; m < ASSEMBLY_MESH_NUM; m++) {
+                aiMesh *mesh = scene->mMeshes[m] = new aiMesh();
+                unsigned vertexNum = std::max(3u, _vertexNum / ASSEMBLY_MESH_NUM);
+                mesh->mNumVertices = vertexNum;
+                mesh->mVertices = new aiVector3D[vertexNum];
+                mesh->mNormals = new aiVector3D[vertexNum];
+                if (m % 2 == 0) {
+                    mesh->mTextureCoords[0] = new aiVector3D[vertexNum];
+                    mesh->mNumUVComponents[0] = 2;
+                }
+                for (unsigned v = 0; v < vertexNum; v++) {
+                    mesh->mVertices[v] = aiVector3D(unit(rng), unit(rng), unit(rng)) * 10.0f;
+                    mesh->mNormals[v] = aiVector3D(unit(rng), unit(rng), unit(rng)).Normalize();
+                    if (mesh->mTextureCoords[0])
+                        mesh->mTextureCoords[0][v] = aiVector3D(unit(rng), unit(rng), 0.0f);
+                }
+
+                mesh->mNumFaces = vertexNum * 2;
+                mesh->mFaces = new aiFace[mesh->mNumFaces];
+                for (unsigned f = 0; f < mesh->mNumFaces; f++) {
+                    aiFace &face = mesh->mFaces[f];
+                    face.mNumIndices = 3;
+                    face.mIndices = new unsigned int[3];
+                    for (int k = 0; k < 3; k++) face.mIndices[k] = rng() % vertexNum;
+                }
+
+                // Neighbouring meshes reuse some bone names, like the parts of one character do
+                std::vector<std::vector<aiVertexWeight> > weights(ASSEMBLY_MESH_BONE_NUM);
+                for (unsigned v = 0; v < vertexNum; v++) {
+                    for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++)
+                        weights[rng() % ASSEMBLY_MESH_BONE_NUM].push_back(aiVertexWeight(v, unit(rng) + 1.0f));
+                }
+                mesh->mNumBones = ASSEMBLY_MESH_BONE_NUM;
+                mesh->mBones = new aiBone *[ASSEMBLY_MESH_BONE_NUM];
+                for (unsigned b = 0; b < ASSEMBLY_MESH_BONE_NUM; b++) {
+                    aiBone *bone = mesh->mBones[b] = new aiBone();
+                    char name[32];
+                    snprintf(name, sizeof(name), "bone%u", (m * ASSEMBLY_MESH_BONE_NUM / 2 + b) % ASSEMBLY_BONE_NAME_NUM);
+                    bone->mName.Set(name);
+                    bone->mOffsetMatrix.a4 = (float) b;
+                    bone->mNumWeights = (unsigned) weights[b].size();
+                    bone->mWeights = new aiVertexWeight[bone->mNumWeights];
+                    std::copy(weights[b].begin(), weights[b].end(), bone->mWeights);
+                }
+            }
+            return scene;
+        }
+
+        // What Scene::stage did before the assembly was split into plan and fill
+        void assembleLegacy(const aiScene *_scene, std::vector<SkeletalMesh::ParametricVertex> &_vertices,
+                            std::vector<unsigned> &_indices, std::map<std::string, unsigned> &_nameBoneMap,
+                            std::vector<aiMatrix4x4> &_boneOffset) {
+            unsigned vertexOffset = 0;
+            for (unsigned i = 0; i < _scene->mNumMeshes; i++) {
+                const aiMesh *mesh = _scene->mMeshes[i];
+                for (unsigned j = 0; j < mesh->mNumVertices; j++) {
+                    aiVector2D texcoord(.0f, .0f);
+                    if (mesh->HasTextureCoords(0))
+                        texcoord = aiVector2D(mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y);
+                    _vertices.emplace_back(mesh->mVertices[j], texcoord, mesh->mNormals[j]);
+                }
+                for (unsigned j = 0; j < mesh->mNumBones; j++) {
+                    const aiBone *bone = mesh->mBones[j];
+                    std::pair<std::map<std::string, unsigned>::iterator, bool> insertion =
+                            _nameBoneMap.insert(std::make_pair(std::string(bone->mName.data), (unsigned) _boneOffset.size()));
+                    if (!insertion.second) continue;
+                    _boneOffset.push_back(bone->mOffsetMatrix);
+                    for (unsigned k = 0; k < bone->mNumWeights; k++)
+                        _vertices[vertexOffset + bone->mWeights[k].mVertexId].addBone(insertion.first->second,
+                                                                                      bone->mWeights[k].mWeight);
+                }
+                for (unsigned j = 0; j < mesh->mNumFaces; j++) {
+                    for (int k = 0; k < 3; k++)
+                        _indices.push_back(mesh->mFaces[j].mIndices[k]);
+                }
+                vertexOffset += mesh->mNumVertices;
+            }
+        }
+    }
+
+    int assembly(int argc, char *argv[]) {
+        unsigned vertexNum = argc > 0 ? (unsigned) atol(argv[0]) : 1000000;
+        unsigned threadNum = argc > 1 ? (unsigned) atoi(argv[1]) : 0;
+        if (vertexNum == 0) return 1;
+
+        aiScene *scene = buildSyntheticScene(vertexNum, 1);
+        Parallel::ThreadPool pool(threadNum);
+
+        std::vector<SkeletalMesh::ParametricVertex> referenceVertices;
+        std::vector<unsigned> referenceIndices;
+        std::map<std::string, unsigned> referenceBones;
+        std::vector<aiMatrix4x4> referenceOffsets;
+        double legacyBest = 1e30;
+        for (int r = 0; r < ASSEMBLY_REPEATS; r++) {
+            referenceVertices.clear();
+            referenceVertices.shrink_to_fit();
+            referenceIndices.clear();
+            referenceIndices.shrink_to_fit();
+            referenceBones.clear();
+            referenceOffsets.clear();
+            double begin = now();
+            assembleLegacy(scene, referenceVertices, referenceIndices, referenceBones, referenceOffsets);
+            legacyBest = std::min(legacyBest, now() - begin);
+        }
+        unsigned totalVertices = (unsigned) referenceVertices.size();
+
+        printf("%u vertices, %u indices in %u meshes, %u bones\n", totalVertices, (unsigned) referenceIndices.size(),
+               scene->mNumMeshes, (unsigned) referenceOffsets.size());
+        printf("%-22s %8s %12s %12s %8s\n", "assembly", "threads", "best ms", "Mverts/s", "match");
+        printf("%-22s %8u %12.2f %12.2f %8s\n", "emplace_back (legacy)", 1u, legacyBest * 1e3,
+               totalVertices / legacyBest * 1e-6, "-");
+
+        int result = 0;
+        for (int pass = 0; pass < 2; pass++) {
+            Parallel::ThreadPool *assemblyPool = pass == 0 ? NULL : &pool;
+            std::vector<SkeletalMesh::ParametricVertex> vertices;
+            std::vector<unsigned> indices;
+            std::map<std::string, unsigned> nameBoneMap;
+            std::vector<aiMatrix4x4> boneOffset;
+            double best = 1e30;
+            for (int r = 0; r < ASSEMBLY_REPEATS; r++) {
+                vertices.clear();
+                vertices.shrink_to_fit();
+                indices.clear();
+                indices.shrink_to_fit();
+                nameBoneMap.clear();
+                boneOffset.clear();
+                double begin = now();
+                MeshAssembler::Layout layout;
+                MeshAssembler::plan(scene, layout, nameBoneMap, boneOffset);
+                vertices.resize(layout.vertexNum());
+                indices.resize(layout.indexNum());
+                MeshAssembler::assemble(scene, layout, vertices.data(), indices.data(), assemblyPool);
+                best = std::min(best, now() - begin);
+            }
+            bool match = vertices.size() == referenceVertices.size() && indices == referenceIndices &&
+                         nameBoneMap == referenceBones && boneOffset == referenceOffsets &&
+                         memcmp(vertices.data(), referenceVertices.data(),
+                                sizeof(SkeletalMesh::ParametricVertex) * vertices.size()) == 0;
+            if (!match) result = 1;
+            printf("%-22s %8u %12.2f %12.2f %8s\n", "two-pass", assemblyPool ? pool.getThreadNum() : 1u,
+                   best * 1e3, totalVertices / best * 1e-6, match ? "yes" : "NO");
+        }
+        delete scene;
+        return result;
+    }
+}
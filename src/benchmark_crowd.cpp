@@ -0,0 +1,84 @@
+// Crowd pose evaluation scaling benchmark
+// Usage: HandBench crowd [-t thread,counts] [-n instance,counts]
+// Every tenth instance uses a 256-bone rig, the rest a 21-bone hand, and every bone
+// changes every frame. Reports the evaluation time per frame and the speedup over one thread.
+
+#include "benchmark.h"
+#include "crowd.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+namespace Benchmark {
+    namespace {
+        std::vector<int> parseList(const char *_list) {
+            std::vector<int> values;
+            std::string list(_list);
+            size_t begin = 0;
+            while (begin <= list.size()) {
+                size_t end = list.find(',', begin);
+                if (end == std::string::npos) end = list.size();
+                int value = atoi(list.substr(begin, end - begin).c_str());
+                if (value > 0) values.push_back(value);
+                begin = end + 1;
+            }
+            return values;
+        }
+    }
+
+    int crowd(int argc, char *argv[]) {
+        std::vector<int> threadCounts = parseList("1,2,4,8,16,32,64");
+        std::vector<int> instanceCounts = parseList("1,10,100,1000,10000");
+        for (int i = 0; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "-t") == 0) threadCounts = parseList(argv[i + 1]);
+            else if (strcmp(argv[i], "-n") == 0) instanceCounts = parseList(argv[i + 1]);
+        }
+
+        SkeletalMesh::Skeleton hand, large;
+        buildSyntheticSkeleton(hand, 21, 1);
+        buildSyntheticSkeleton(large, 256, 2);
+        std::vector<glm::fmat4> pose[2];
+        buildSyntheticPose(pose[0], 256, 3);
+        buildSyntheticPose(pose[1], 256, 4);
+
+        // Speedups are relative to the first thread count
+        std::vector<double> baseline;
+        printf("%8s %8s %10s %12s %10s\n", "threads", "hands", "ms/frame", "Mbones/s", "speedup");
+        for (size_t t = 0; t < threadCounts.size(); t++) {
+            Parallel::ThreadPool pool(threadCounts[t]);
+            for (size_t n = 0; n < instanceCounts.size(); n++) {
+                int instanceNum = instanceCounts[n];
+                std::vector<const SkeletalMesh::Skeleton *> instances(instanceNum);
+                size_t boneNum = 0;
+                for (int i = 0; i < instanceNum; i++) {
+                    instances[i] = (i % 10 == 9) ? &large : &hand;
+                    boneNum += instances[i]->boneNum();
+                }
+                SkeletalMesh::Crowd crowd(instances);
+
+                int frames = (int) std::max<size_t>(4, 20000000 / (boneNum * 40));
+                double elapsed = 0.0;
+                for (int f = 0; f < frames; f++) {
+                    const std::vector<glm::fmat4> &cur = pose[f & 1];
+                    for (int i = 0; i < instanceNum; i++) {
+                        SkeletalMesh::SkeletonModifier &modifier = crowd.getModifier(i);
+                        for (size_t b = 0; b < modifier.boneNum(); b++)
+                            modifier.set((SkeletalMesh::BoneHandle) b, cur[b]);
+                    }
+                    double begin = now();
+                    crowd.evaluate(pool);
+                    elapsed += now() - begin;
+                }
+
+                if (t == 0) baseline.push_back(elapsed);
+                printf("%8d %8d %10.3f %12.1f %10.2f\n", threadCounts[t], instanceNum,
+                       elapsed * 1e3 / frames, boneNum * frames / elapsed * 1e-6,
+                       baseline[n] / elapsed);
+            }
+        }
+        return 0;
+    }
+}
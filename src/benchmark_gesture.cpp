@@ -0,0 +1,99 @@
+// Finger gesture benchmark
+// Usage: HandBench gesture [-n hand,counts]
+// Every hand bends or straightens its five fingers, three joints each, at 60 frames per second
+// for three seconds; the gestures finish after about 1.3. Updating every finger through its
+// virtual gesture, as FingerAnimator does, is compared against one GestureBatch for all hands
+// sampling the compiled pose tables. The largest difference between the two poses is listed.
+
+#include "benchmark.h"
+#include "finger_animator.h"
+#include "gesture_batch.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+namespace Benchmark {
+    namespace {
+        const int GESTURE_BONE_NUM = 21;
+        const int GESTURE_FINGER_NUM = 5;
+        const int GESTURE_FRAMES = 180;
+        const double GESTURE_FRAME_SECONDS = 1.0 / 60.0;
+
+        std::vector<int> parseCounts(const char *_list) {
+            std::vector<int> values;
+            std::string list(_list);
+            size_t begin = 0;
+            while (begin <= list.size()) {
+                size_t end = list.find(',', begin);
+                if (end == std::string::npos) end = list.size();
+                int value = atoi(list.substr(begin, end - begin).c_str());
+                if (value > 0) values.push_back(value);
+                begin = end + 1;
+            }
+            return values;
+        }
+    }
+
+    int gesture(int argc, char *argv[]) {
+        std::vector<int> handCounts = parseCounts("1,100,1000,10000");
+        for (int i = 0; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "-n") == 0) handCounts = parseCounts(argv[i + 1]);
+        }
+
+        SkeletalMesh::Skeleton hand;
+        buildSyntheticSkeleton(hand, GESTURE_BONE_NUM, 1);
+        const StraightenGesture straighten(0.8);
+        const BendGesture bend(0.8);
+
+        printf("%8s %12s %12s %12s %14s %10s %12s\n", "hands", "virtual ms", "batch ms", "speedup",
+               "moving/frame", "max diff", "still after");
+        for (size_t n = 0; n < handCounts.size(); n++) {
+            int handNum = handCounts[n];
+            std::vector<SkeletalMesh::SkeletonModifier> virtualPose(handNum, SkeletalMesh::SkeletonModifier(hand));
+            std::vector<SkeletalMesh::SkeletonModifier> batchPose(virtualPose);
+            std::vector<FingerAnimator> fingers;
+            GestureBatch batch;
+            for (int h = 0; h < handNum; h++) {
+                for (int f = 0; f < GESTURE_FINGER_NUM; f++) {
+                    const FingerGesture *gesture = (h + f) % 2 ? (const FingerGesture *) &bend : &straighten;
+                    int bone = 1 + f * 3;
+                    fingers.push_back(FingerAnimator(virtualPose[h], bone, bone + 1, bone + 2, gesture));
+                    batch.AddFinger(batchPose[h], bone, bone + 1, bone + 2, gesture, 0.0);
+                }
+            }
+
+            double virtualSeconds = 0.0, batchSeconds = 0.0, lastMoving = 0.0;
+            size_t moving = 0;
+            float maxDiff = 0.0f;
+            for (int frame = 0; frame < GESTURE_FRAMES; frame++) {
+                double time = frame * GESTURE_FRAME_SECONDS;
+                double begin = now();
+                for (size_t f = 0; f < fingers.size(); f++) fingers[f].Update(time);
+                virtualSeconds += now() - begin;
+
+                begin = now();
+                size_t frameMoving = batch.Update(time);
+                batchSeconds += now() - begin;
+                moving += frameMoving;
+                if (frameMoving) lastMoving = time;
+
+                for (int h = 0; h < handNum; h++)
+                    for (int b = 1; b <= GESTURE_FINGER_NUM * 3; b++)
+                        for (int c = 0; c < 4; c++)
+                            for (int r = 0; r < 4; r++)
+                                maxDiff = std::max(maxDiff, std::fabs(virtualPose[h].get(b)[c][r] -
+                                                                      batchPose[h].get(b)[c][r]));
+            }
+
+            printf("%8d %12.4f %12.4f %11.2fx %14.1f %10.2e %10.2f s\n", handNum,
+                   virtualSeconds * 1e3 / GESTURE_FRAMES, batchSeconds * 1e3 / GESTURE_FRAMES,
+                   virtualSeconds / batchSeconds, (double) moving / GESTURE_FRAMES, maxDiff,
+                   lastMoving + GESTURE_FRAME_SECONDS);
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,84 @@
+// FBX import benchmark
+// Usage: HandBench import [file] [-t thread,counts] [-r repeats]
+// Imports the file without post-processing, read through fread or memory-mapped, inflating the
+// compressed arrays of binary FBX and converting meshes on each thread count. Reports the best and
+// median wall time and the speedup over fread on one thread.
+
+#include "benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <thread>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/config.h>
+
+#include "config.h"
+#include "mapped_io_system.h"
+
+namespace Benchmark {
+    namespace {
+        std::vector<unsigned> parseThreadList(const char *_list) {
+            std::vector<unsigned> values;
+            std::string list(_list);
+            size_t begin = 0;
+            while (begin <= list.size()) {
+                size_t end = list.find(',', begin);
+                if (end == std::string::npos) end = list.size();
+                int value = atoi(list.substr(begin, end - begin).c_str());
+                if (value > 0) values.push_back((unsigned) value);
+                begin = end + 1;
+            }
+            return values;
+        }
+    }
+
+    int import(int argc, char *argv[]) {
+        std::string filename = DATA_DIR "/Hand.fbx";
+        unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> threadCounts;
+        for (unsigned threadNum = 1; threadNum < hardwareThreads; threadNum *= 2)
+            threadCounts.push_back(threadNum);
+        threadCounts.push_back(hardwareThreads);
+        int repeats = 20;
+        for (int i = 0; i < argc; i++) {
+            if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threadCounts = parseThreadList(argv[++i]);
+            else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) repeats = std::max(1, atoi(argv[++i]));
+            else filename = argv[i];
+        }
+
+        printf("%s\n", filename.c_str());
+        printf("%6s %8s %12s %12s %10s\n", "io", "threads", "best ms", "median ms", "speedup");
+        double baseline = 0.0;
+        for (size_t run = 0; run < 2 * threadCounts.size(); run++) {
+            bool mapped = run >= threadCounts.size();
+            size_t t = run % threadCounts.size();
+            Assimp::Importer importer;
+            if (mapped) importer.SetIOHandler(new FileMapping::MappedIOSystem());
+            importer.SetPropertyInteger(AI_CONFIG_IMPORT_FBX_INFLATE_THREADS, (int) threadCounts[t]);
+            importer.SetPropertyInteger(AI_CONFIG_IMPORT_FBX_CONVERT_THREADS, (int) threadCounts[t]);
+            std::vector<double> times;
+            for (int r = 0; r < repeats; r++) {
+                double begin = now();
+                const aiScene *scene = importer.ReadFile(filename, 0);
+                double elapsed = now() - begin;
+                if (scene == NULL) {
+                    fprintf(stderr, "Import failed: %s\n", importer.GetErrorString());
+                    return 1;
+                }
+                importer.FreeScene();
+                times.push_back(elapsed);
+            }
+            std::sort(times.begin(), times.end());
+            double median = times[times.size() / 2];
+            if (run == 0) baseline = median;
+            printf("%6s %8u %12.2f %12.2f %10.2f\n", mapped ? "mmap" : "fread", threadCounts[t],
+                   times[0] * 1e3, median * 1e3, baseline / median);
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,47 @@
+// Hand Benchmarks
+// Usage: HandBench [benchmark [args...]], runs every benchmark when none is named.
+
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark.h"
+
+namespace {
+    struct NamedBenchmark {
+        const char *name;
+        Benchmark::Entry entry;
+        const char *description;
+    };
+
+    const NamedBenchmark benchmarks[] = {
+            {"affine",   Benchmark::affine,   "bone composition, ns/bone per kernel vs aiMatrix4x4"},
+            {"animation", Benchmark::animation, "keyframe clip sampling, cursors vs key search, and clip compression"},
+            {"assembly", Benchmark::assembly, "load-time vertex and index assembly, Mverts/s serial vs parallel"},
+            {"crowd",    Benchmark::crowd,    "parallel crowd pose evaluation, 1-64 threads x 1-10000 hands"},
+            {"gesture",  Benchmark::gesture,  "finger gestures, virtual per-finger updates vs one batch of pose tables"},
+            {"import",   Benchmark::import,   "FBX import wall time, fread vs mmap, inflate and convert on 1-N threads"},
+            {"skinning", Benchmark::skinning, "CPU linear blend skinning, vertices/second per kernel"},
+            {"texture",  Benchmark::texture,  "texture baking to BC1/BC3 mips, error, size and load time vs stb"},
+    };
+
+    const int benchmarkNum = sizeof(benchmarks) / sizeof(benchmarks[0]);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        int result = 0;
+        for (int i = 0; i < benchmarkNum; i++) {
+            printf("== %s ==\n", benchmarks[i].name);
+            result |= benchmarks[i].entry(0, argv + argc);
+        }
+        return result;
+    }
+    for (int i = 0; i < benchmarkNum; i++) {
+        if (strcmp(argv[1], benchmarks[i].name) == 0)
+            return benchmarks[i].entry(argc - 2, argv + 2);
+    }
+    fprintf(stderr, "Usage: %s [benchmark [args...]]\n", argv[0]);
+    for (int i = 0; i < benchmarkNum; i++)
+        fprintf(stderr, "  %-10s %s\n", benchmarks[i].name, benchmarks[i].description);
+    return 1;
+}
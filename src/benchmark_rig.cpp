@@ -0,0 +1,42 @@
+#include "benchmark.h"
+
+#include <random>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace Benchmark {
+    namespace {
+        glm::fmat4 randomRigid(std::mt19937 &rng, float maxAngle, float maxOffset) {
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            glm::fvec3 axis(unit(rng), unit(rng), unit(rng));
+            if (glm::dot(axis, axis) < 1e-4f) axis = glm::fvec3(0.0f, 0.0f, 1.0f);
+            glm::fmat4 m = glm::translate(glm::fmat4(1.0f),
+                                          glm::fvec3(unit(rng), unit(rng), unit(rng)) * maxOffset);
+            return glm::rotate(m, unit(rng) * maxAngle, glm::normalize(axis));
+        }
+    }
+
+    void buildSyntheticSkeleton(SkeletalMesh::Skeleton &skeleton, int boneNum, unsigned seed) {
+        std::mt19937 rng(seed);
+        skeleton.clear();
+        skeleton.invRoot = AffineMath::fromMat4(glm::inverse(randomRigid(rng, 3.0f, 1.0f)));
+        for (int i = 0; i < boneNum; i++) {
+            // Mostly extend the previous bone so that chains get deep, like fingers and spines do
+            int parent = -1;
+            if (i > 0) parent = (rng() % 4 != 0) ? i - 1 : (int) (rng() % i);
+            skeleton.parent.push_back(parent);
+            skeleton.localBind.push_back(AffineMath::fromMat4(randomRigid(rng, 0.5f, 1.0f)));
+            skeleton.boneId.push_back(i);
+            skeleton.offset.push_back(AffineMath::fromMat4(randomRigid(rng, 3.0f, 5.0f)));
+            skeleton.nameNodeMap.insert(std::make_pair("bone" + std::to_string(i), i));
+        }
+    }
+
+    void buildSyntheticPose(std::vector<glm::fmat4> &pose, int boneNum, unsigned seed) {
+        std::mt19937 rng(seed);
+        pose.resize(boneNum);
+        for (int i = 0; i < boneNum; i++)
+            pose[i] = randomRigid(rng, 1.0f, 0.0f);
+    }
+}
@@ -0,0 +1,86 @@
+// CPU skinning throughput benchmark
+// Usage: HandBench skinning [vertex count] [thread count]
+// Skins a synthetic mesh with four random influences per vertex against a 64-bone palette
+// with every kernel, single-threaded and on the pool, and reports vertices per second.
+
+#include "benchmark.h"
+#include "skinning.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+namespace Benchmark {
+    namespace {
+        float maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+            float diff = 0.0f;
+            for (size_t i = 0; i < a.size(); i++)
+                diff = std::max(diff, std::fabs(a[i] - b[i]));
+            return diff;
+        }
+    }
+
+    int skinning(int argc, char *argv[]) {
+        size_t vertexNum = argc > 0 ? (size_t) atol(argv[0]) : 1000000;
+        unsigned threadNum = argc > 1 ? (unsigned) atoi(argv[1]) : 0;
+        const int boneNum = 64;
+        if (vertexNum == 0) return 1;
+
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<SkeletalMesh::ParametricVertex> vertices(vertexNum);
+        for (size_t v = 0; v < vertexNum; v++) {
+            SkeletalMesh::ParametricVertex &vertex = vertices[v];
+            float sum = 0.0f;
+            for (int i = 0; i < 3; i++) {
+                vertex.position[i] = unit(rng) * 10.0f;
+                vertex.normal[i] = unit(rng);
+            }
+            for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
+                vertex.boneId[i] = rng() % boneNum;
+                vertex.boneWeight[i] = unit(rng) + 1.0f;
+                sum += vertex.boneWeight[i];
+            }
+            for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++)
+                vertex.boneWeight[i] /= sum;
+        }
+
+        SkeletalMesh::Skeleton skeleton;
+        buildSyntheticSkeleton(skeleton, boneNum, 2);
+        std::vector<glm::fmat4> pose;
+        buildSyntheticPose(pose, boneNum, 3);
+        SkeletalMesh::SkeletonModifier modifier(skeleton);
+        for (int i = 0; i < boneNum; i++) modifier.set(i, pose[i]);
+        skeleton.update(modifier);
+        const glm::fmat4 *palette = modifier.getTransform();
+
+        Parallel::ThreadPool pool(threadNum);
+        AffineMath::Isa bestIsa = AffineMath::detectIsa();
+        std::vector<float> refPosition(vertexNum * 3), refNormal(vertexNum * 3);
+        std::vector<float> position(vertexNum * 3), normal(vertexNum * 3);
+        AffineMath::setIsa(AffineMath::ISA_SCALAR);
+        SkeletalMesh::skinVertices(vertices.data(), vertexNum, palette, boneNum,
+                                   refPosition.data(), refNormal.data());
+
+        printf("%-8s %8s %12s %12s %12s\n", "kernel", "threads", "Mverts/s", "pos error", "normal error");
+        for (int isa = AffineMath::ISA_SCALAR; isa <= bestIsa; isa++) {
+            AffineMath::setIsa((AffineMath::Isa) isa);
+            for (int parallel = 0; parallel < 2; parallel++) {
+                Parallel::ThreadPool *usedPool = parallel ? &pool : NULL;
+                int repeats = std::max(1, (int) (20000000 / vertexNum));
+                double begin = now();
+                for (int r = 0; r < repeats; r++)
+                    SkeletalMesh::skinVertices(vertices.data(), vertexNum, palette, boneNum,
+                                               position.data(), normal.data(), usedPool);
+                double elapsed = now() - begin;
+                printf("%-8s %8u %12.1f %12.3g %12.3g\n", AffineMath::isaName((AffineMath::Isa) isa),
+                       parallel ? pool.getThreadNum() : 1u, vertexNum * repeats / elapsed * 1e-6,
+                       maxDifference(refPosition, position), maxDifference(refNormal, normal));
+            }
+        }
+        AffineMath::setIsa(bestIsa);
+        return 0;
+    }
+}
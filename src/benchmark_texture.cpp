@@ -0,0 +1,124 @@
+// Texture baking benchmark
+// Usage: HandBench texture [size]
+// Bakes a synthetic opaque and a synthetic translucent image of size x size pixels into a mip
+// chain of BC1 or BC3 blocks. Reports bake throughput, level 0 error against the source, the
+// memory saved against RGBA8 with mips, and the time to load the result: PNG decode through stb
+// against mapping the baked file.
+
+#include "benchmark.h"
+#include "texture_bake.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <string>
+#include <algorithm>
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include "config.h"
+
+namespace Benchmark {
+    namespace {
+        const int TEXTURE_LOAD_REPEATS = 10;
+
+        // Smooth gradients with a checker pattern and some noise, like a painted diffuse map
+        std::vector<unsigned char> buildSyntheticImage(int _size, bool _translucent, unsigned _seed) {
+            std::mt19937 rng(_seed);
+            std::uniform_int_distribution<int> noise(-8, 8);
+            std::vector<unsigned char> rgba((size_t) _size * _size * 4);
+            for (int y = 0; y < _size; y++) {
+                for (int x = 0; x < _size; x++) {
+                    unsigned char *pixel = &rgba[((size_t) y * _size + x) * 4];
+                    bool checker = ((x / 64) + (y / 64)) % 2 == 0;
+                    float u = (float) x / _size, v = (float) y / _size;
+                    int color[3] = {(int) (255 * u), (int) (255 * v), checker ? 200 : (int) (128 + 127 * std::sin(u * 20))};
+                    for (int c = 0; c < 3; c++) pixel[c] = (unsigned char) std::min(255, std::max(0, color[c] + noise(rng)));
+                    pixel[3] = _translucent ? (unsigned char) (255 * (0.5f + 0.5f * std::cos(v * 12))) : 255;
+                }
+            }
+            return rgba;
+        }
+
+        double levelZeroRmse(const TextureBake::BakedTexture &_baked, const std::vector<unsigned char> &_rgba) {
+            const TextureBake::Level &level = _baked.level(0);
+            size_t blockSize = TextureBake::blockBytes(_baked.getFormat());
+            unsigned int blocksX = (level.width + 3) / 4;
+            double sum = 0.0;
+            unsigned char decoded[64];
+            for (unsigned int y = 0; y < level.height; y += 4) {
+                for (unsigned int x = 0; x < level.width; x += 4) {
+                    const unsigned char *block = level.blocks + ((y / 4) * blocksX + x / 4) * blockSize;
+                    if (_baked.getFormat() == TextureBake::BLOCK_BC1) TextureBake::decodeBlockBC1(block, decoded);
+                    else TextureBake::decodeBlockBC3(block, decoded);
+                    for (unsigned int py = 0; py < 4 && y + py < level.height; py++) {
+                        for (unsigned int px = 0; px < 4 && x + px < level.width; px++) {
+                            for (int c = 0; c < 4; c++) {
+                                double d = decoded[(py * 4 + px) * 4 + c] -
+                                           _rgba[((size_t) (y + py) * level.width + x + px) * 4 + c];
+                                sum += d * d;
+                            }
+                        }
+                    }
+                }
+            }
+            return std::sqrt(sum / ((double) level.width * level.height * 4));
+        }
+    }
+
+    int texture(int argc, char *argv[]) {
+        int size = argc > 0 ? atoi(argv[0]) : 1024;
+        if (size <= 0) return 1;
+
+        printf("%dx%d pixels\n", size, size);
+        printf("%-12s %6s %12s %12s %10s %10s %12s %12s\n", "image", "format", "bake ms", "Mpix/s", "rmse",
+               "vs RGBA8", "stb load ms", "mmap ms");
+        for (int translucent = 0; translucent < 2; translucent++) {
+            std::vector<unsigned char> rgba = buildSyntheticImage(size, translucent != 0, 1);
+            TextureBake::BakedTexture baked;
+            double begin = now();
+            if (!baked.bake(rgba.data(), size, size, 4)) return 1;
+            double bakeSeconds = now() - begin;
+
+            // A full mip chain of RGBA8 is what glGenerateMipmap used to leave in memory
+            size_t rgbaBytes = 0;
+            for (size_t i = 0; i < baked.levelNum(); i++)
+                rgbaBytes += (size_t) baked.level(i).width * baked.level(i).height * 4;
+
+            std::string pngPath = std::string(CACHE_DIR) + "/texture_bench.png";
+            std::string bakedPath = std::string(CACHE_DIR) + "/texture_bench.btex";
+            if (!stbi_write_png(pngPath.c_str(), size, size, 4, rgba.data(), size * 4) || !baked.save(bakedPath, 1)) {
+                fprintf(stderr, "Can not write to %s\n", CACHE_DIR);
+                return 1;
+            }
+            double stbBest = 1e30, mappedBest = 1e30;
+            for (int r = 0; r < TEXTURE_LOAD_REPEATS; r++) {
+                int width, height, channels;
+                begin = now();
+                unsigned char *pixels = stbi_load(pngPath.c_str(), &width, &height, &channels, 0);
+                stbBest = std::min(stbBest, now() - begin);
+                stbi_image_free(pixels);
+
+                TextureBake::BakedTexture mapped;
+                begin = now();
+                // Touches every level, as an upload would
+                unsigned checksum = 0;
+                if (mapped.open(bakedPath, 1))
+                    for (size_t i = 0; i < mapped.levelNum(); i++)
+                        for (size_t b = 0; b < mapped.level(i).size; b += 4096) checksum += mapped.level(i).blocks[b];
+                mappedBest = std::min(mappedBest, now() - begin);
+                if (mapped.empty() || checksum == 0xffffffffu) return 1;
+            }
+            remove(pngPath.c_str());
+            remove(bakedPath.c_str());
+
+            printf("%-12s %6s %12.2f %12.2f %10.2f %9.1fx %12.2f %12.3f\n", translucent ? "translucent" : "opaque",
+                   baked.getFormat() == TextureBake::BLOCK_BC1 ? "BC1" : "BC3", bakeSeconds * 1e3,
+                   (double) size * size / bakeSeconds * 1e-6, levelZeroRmse(baked, rgba),
+                   (double) rgbaBytes / baked.byteNum(), stbBest * 1e3, mappedBest * 1e3);
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,124 @@
+// Crowd Pose Evaluation
+// Evaluates the bone palettes of many skeleton instances in parallel. The pose
+// state of all instances lives in a handful of arrays laid out back to back,
+// every instance exposes a SkeletonModifier viewing its own slice of them.
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "skeleton.h"
+#include "thread_pool.h"
+
+namespace SkeletalMesh {
+    class Crowd {
+    public:
+        // Consecutive instances are grouped into tasks of about this many nodes
+        static const size_t BATCH_NODE_NUM = 1024;
+
+    private:
+        // Instance table, one entry per instance
+        std::vector<const Skeleton *> skeleton;
+        std::vector<size_t> nodeBegin;
+        std::vector<size_t> boneBegin;
+        std::vector<unsigned char> changed;
+        std::vector<SkeletonModifier> modifier;
+
+        // Pose state of every instance, sliced by nodeBegin / boneBegin
+        std::vector<glm::fmat4> local;
+        std::vector<Affine3x4> pose;
+        std::vector<unsigned char> dirty;
+        std::vector<Affine3x4> global;
+        SkeletonTransf palette;
+
+        // Task i covers instances [batchBegin[batchOrder[i]], batchBegin[batchOrder[i] + 1]),
+        // the most expensive batches come first
+        std::vector<size_t> batchBegin;
+        std::vector<size_t> batchOrder;
+
+        // Modifiers view into the arrays above, so a crowd cannot be copied
+        Crowd(const Crowd &);
+
+        Crowd &operator=(const Crowd &);
+
+    public:
+        Crowd() {}
+
+        explicit Crowd(const std::vector<const Skeleton *> &_instances) { reset(_instances); }
+
+        // Every modifier starts out at identity, all palettes are computed by the next evaluate
+        void reset(const std::vector<const Skeleton *> &_instances) {
+            size_t instanceNum = _instances.size();
+            skeleton = _instances;
+            nodeBegin.resize(instanceNum + 1);
+            boneBegin.resize(instanceNum + 1);
+            nodeBegin[0] = boneBegin[0] = 0;
+            for (size_t i = 0; i < instanceNum; i++) {
+                nodeBegin[i + 1] = nodeBegin[i] + _instances[i]->nodeNum();
+                boneBegin[i + 1] = boneBegin[i] + _instances[i]->boneNum();
+            }
+            changed.assign(instanceNum, 0);
+
+            local.resize(nodeBegin[instanceNum]);
+            pose.resize(nodeBegin[instanceNum]);
+            dirty.resize(nodeBegin[instanceNum]);
+            global.resize(nodeBegin[instanceNum]);
+            palette.resize(boneBegin[instanceNum]);
+
+            modifier.clear();
+            modifier.resize(instanceNum);
+            for (size_t i = 0; i < instanceNum; i++) {
+                PoseView view;
+                view.local = local.data() + nodeBegin[i];
+                view.pose = pose.data() + nodeBegin[i];
+                view.dirty = dirty.data() + nodeBegin[i];
+                view.global = global.data() + nodeBegin[i];
+                view.transf = palette.data() + boneBegin[i];
+                modifier[i].bind(*_instances[i], view);
+            }
+
+            batchBegin.clear();
+            std::vector<size_t> batchCost;
+            for (size_t i = 0; i < instanceNum; i++) {
+                if (batchBegin.empty() || batchCost.back() >= BATCH_NODE_NUM) {
+                    batchBegin.push_back(i);
+                    batchCost.push_back(0);
+                }
+                batchCost.back() += _instances[i]->nodeNum();
+            }
+            batchBegin.push_back(instanceNum);
+            batchOrder.resize(batchCost.size());
+            for (size_t i = 0; i < batchOrder.size(); i++) batchOrder[i] = i;
+            std::stable_sort(batchOrder.begin(), batchOrder.end(),
+                             [&batchCost](size_t a, size_t b) { return batchCost[a] > batchCost[b]; });
+        }
+
+        size_t instanceNum() const { return skeleton.size(); }
+
+        SkeletonModifier &getModifier(size_t _instance) { return modifier[_instance]; }
+
+        const Skeleton &getSkeleton(size_t _instance) const { return *skeleton[_instance]; }
+
+        // Palettes of all instances back to back, instance i starts at getBoneBegin(i)
+        const SkeletonTransf &getPalettes() const { return palette; }
+
+        size_t getBoneBegin(size_t _instance) const { return boneBegin[_instance]; }
+
+        const glm::fmat4 *getPalette(size_t _instance) const { return palette.data() + boneBegin[_instance]; }
+
+        // Whether the palette of _instance changed in the last evaluate
+        bool hasChanged(size_t _instance) const { return changed[_instance] != 0; }
+
+        // Same semantics as Scene::updateSkeletonTransform for every instance,
+        // returns the number of instances whose palette changed
+        size_t evaluate(Parallel::ThreadPool &pool = Parallel::ThreadPool::shared()) {
+            pool.run(batchOrder.size(), [this](size_t task) {
+                size_t batch = batchOrder[task];
+                for (size_t i = batchBegin[batch]; i < batchBegin[batch + 1]; i++)
+                    changed[i] = skeleton[i]->update(modifier[i]) ? 1 : 0;
+            });
+            return (size_t) std::count(changed.begin(), changed.end(), 1);
+        }
+    };
+}
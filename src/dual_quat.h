@@ -0,0 +1,43 @@
+// Dual Quaternion Bone Palette
+// Rigid bone transforms as 8 floats, blended without the volume loss linear
+// blend skinning shows around strongly bent joints.
+
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace SkeletalMesh {
+    enum SkinningMode {
+        SKINNING_LINEAR_BLEND = 0,
+        SKINNING_DUAL_QUATERNION
+    };
+
+    // Both parts are stored as (x, y, z, w) so that they upload as two vec4
+    struct DualQuat {
+        glm::fvec4 real;
+        glm::fvec4 dual;
+    };
+
+    typedef std::vector<DualQuat> DualQuatTransf;
+
+    // The scale and shear of _m are lost, bone palettes of rigid rigs have neither
+    inline DualQuat toDualQuat(const glm::fmat4 &_m) {
+        glm::fquat q = glm::normalize(glm::quat_cast(glm::fmat3(_m)));
+        glm::fvec3 t(_m[3]);
+        glm::fvec3 v(q.x, q.y, q.z);
+        // dual = 0.5 * (t, 0) * q
+        glm::fvec3 dualV = 0.5f * (q.w * t + glm::cross(t, v));
+        DualQuat dq;
+        dq.real = glm::fvec4(v, q.w);
+        dq.dual = glm::fvec4(dualV, -0.5f * glm::dot(t, v));
+        return dq;
+    }
+
+    inline void toDualQuat(const glm::fmat4 *palette, size_t boneNum, DualQuat *out) {
+        for (size_t i = 0; i < boneNum; i++)
+            out[i] = toDualQuat(palette[i]);
+    }
+}
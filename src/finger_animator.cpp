@@ -7,12 +7,21 @@
 #endif
 
 void FingerAnimator::Update(double cur_time){
-    if (gesture_) gesture_->Update(
+    if (!gesture_) return;
+    glm::fmat4 proximal_translation, intermediate_translation, distal_translation;
+    gesture_->Update(
         begin_time_, cur_time,
-        proximal_translation_,
-        intermediate_translation_,
-        distal_translation_
+        proximal_translation,
+        intermediate_translation,
+        distal_translation
     );
+    modifier_.set(proximal_, proximal_translation);
+    modifier_.set(intermediate_, intermediate_translation);
+    modifier_.set(distal_, distal_translation);
+}
+
+double FingerGesture::Duration() const{
+    return 0.0;
 }
 
 void FingerGesture::Update(
@@ -25,6 +34,10 @@ void FingerGesture::Update(
     proximal_translation = intermediate_translation = distal_translation = translation;
 }
 
+double StraightenGesture::Duration() const{
+    return M_PI / 3 / speed_;
+}
+
 void StraightenGesture::Update(
     double begin_time, double cur_time,
     glm::fmat4 &proximal_translation,
@@ -39,6 +52,10 @@ void StraightenGesture::Update(
     proximal_translation = intermediate_translation = distal_translation = translation;
 }
 
+double BendGesture::Duration() const{
+    return M_PI / 3 / speed_;
+}
+
 void BendGesture::Update(
     double begin_time, double cur_time,
     glm::fmat4 &proximal_translation,
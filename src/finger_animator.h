@@ -3,19 +3,22 @@
 
 #include "glm/glm.hpp"
 #include "GLFW/glfw3.h"
+#include "skeleton.h"
 
 class FingerGesture;
 
 class FingerAnimator{
 public:
     FingerAnimator(
-        glm::fmat4 &proximal_translation,
-        glm::fmat4 &intermediate_translation,
-        glm::fmat4 &distal_translation,
+        SkeletalMesh::SkeletonModifier &modifier,
+        SkeletalMesh::BoneHandle proximal,
+        SkeletalMesh::BoneHandle intermediate,
+        SkeletalMesh::BoneHandle distal,
         const FingerGesture *gesture
-    ):proximal_translation_(proximal_translation),
-      intermediate_translation_(intermediate_translation),
-      distal_translation_(distal_translation),
+    ):modifier_(modifier),
+      proximal_(proximal),
+      intermediate_(intermediate),
+      distal_(distal),
       gesture_(gesture), begin_time_(0.0) {}
 
     void SetGesture(const FingerGesture *gesture){
@@ -24,11 +27,20 @@ public:
     }
 
     void Update(double cur_time);
+
+    SkeletalMesh::SkeletonModifier &modifier() const { return modifier_; }
+    SkeletalMesh::BoneHandle proximal() const { return proximal_; }
+    SkeletalMesh::BoneHandle intermediate() const { return intermediate_; }
+    SkeletalMesh::BoneHandle distal() const { return distal_; }
+    const FingerGesture *gesture() const { return gesture_; }
     
 private:
-    glm::fmat4 &proximal_translation_;
-    glm::fmat4 &intermediate_translation_;
-    glm::fmat4 &distal_translation_;
+    // Unchanged matrices are filtered out by the modifier, so a finger
+    // that has settled does not trigger any pose recompute
+    SkeletalMesh::SkeletonModifier &modifier_;
+    SkeletalMesh::BoneHandle proximal_;
+    SkeletalMesh::BoneHandle intermediate_;
+    SkeletalMesh::BoneHandle distal_;
 
     const FingerGesture *gesture_;
     double begin_time_;
@@ -36,6 +48,11 @@ private:
 
 class FingerGesture{
 public:
+    virtual ~FingerGesture() {}
+
+    // Seconds until the pose stops changing, 0 for a still pose
+    virtual double Duration() const;
+
     virtual void Update(
         double begin_time, double cur_time,
         glm::fmat4 &proximal_translation,
@@ -47,6 +64,7 @@ public:
 class StraightenGesture: public FingerGesture{
 public:
     StraightenGesture(double speed): speed_(speed) {}
+    virtual double Duration() const;
     virtual void Update(
         double begin_time, double cur_time,
         glm::fmat4 &proximal_translation,
@@ -60,6 +78,7 @@ private:
 class BendGesture: public FingerGesture{
 public:
     BendGesture(double speed): speed_(speed) {}
+    virtual double Duration() const;
     virtual void Update(
         double begin_time, double cur_time,
         glm::fmat4 &proximal_translation,
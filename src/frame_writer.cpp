@@ -0,0 +1,100 @@
+#include "frame_writer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <stb_image_write.h>
+
+namespace Offscreen {
+    namespace {
+        struct Output {
+            FILE *file;
+            uint64_t bytes;
+            bool ok;
+        };
+
+        void writeOutput(void *_output, void *_data, int _size) {
+            Output &output = *(Output *) _output;
+            output.ok = fwrite(_data, 1, _size, output.file) == (size_t) _size && output.ok;
+            output.bytes += _size;
+        }
+    }
+
+    FrameWriter::FrameWriter(const std::string &_directory, FrameFormat _format, int _width, int _height,
+                             unsigned int _maxPending)
+            : directory(_directory), format(_format), width(_width), height(_height),
+              maxPending(_maxPending ? _maxPending : 1), pending(0), queue(1) {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    FrameWriter::~FrameWriter() {
+        finish();
+    }
+
+    void FrameWriter::write(uint64_t _frame, const unsigned char *_rgba) {
+        std::shared_ptr<std::vector<unsigned char> > pixels(new std::vector<unsigned char>());
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (pending >= maxPending) {
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                changed.wait(lock, [this] { return pending < maxPending; });
+                stats.blockedSeconds +=
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            }
+            pending++;
+            if (!spare.empty()) {
+                pixels->swap(spare.back());
+                spare.pop_back();
+            }
+        }
+
+        // Flipped while copying, image files start with the top row
+        size_t rowBytes = (size_t) width * 4;
+        pixels->resize(rowBytes * height);
+        for (int y = 0; y < height; y++)
+            memcpy(&(*pixels)[rowBytes * y], _rgba + rowBytes * (height - 1 - y), rowBytes);
+
+        queue.submit([this, _frame, pixels] { encode(_frame, *pixels); });
+    }
+
+    void FrameWriter::encode(uint64_t _frame, std::vector<unsigned char> &_pixels) {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%06llu.%s", (unsigned long long) _frame, extension(format));
+        std::string path = directory + name;
+
+        Output output = {fopen(path.c_str(), "wb"), 0, true};
+        if (output.file) {
+            if (format == FRAME_PNG)
+                output.ok = stbi_write_png_to_func(writeOutput, &output, width, height, 4, _pixels.data(),
+                                                   width * 4) != 0 && output.ok;
+            else
+                writeOutput(&output, _pixels.data(), (int) _pixels.size());
+            output.ok = fclose(output.file) == 0 && output.ok;
+        }
+        bool written = output.file && output.ok;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (written) {
+            stats.writtenFrames++;
+            stats.writtenBytes += output.bytes;
+        } else {
+            stats.failedFrames++;
+        }
+        spare.push_back(std::vector<unsigned char>());
+        spare.back().swap(_pixels);
+        pending--;
+        changed.notify_all();
+    }
+
+    void FrameWriter::finish() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return pending == 0; });
+    }
+
+    FrameWriter::Stats FrameWriter::getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+}
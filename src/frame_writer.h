@@ -0,0 +1,78 @@
+// Frame Sequence Writer
+// Frames read back from the GPU are written to numbered files on a thread of
+// their own, so encoding and disk I/O overlap rendering. At most a fixed
+// number of frames wait for the writer; beyond that write() blocks, which
+// keeps memory bounded when encoding is slower than rendering.
+//
+//     Offscreen::FrameWriter writer("frames", Offscreen::FRAME_PNG, 800, 800);
+//     per frame: writer.write(frame, bottomUpRgba);
+//     at the end: writer.finish();
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "job_queue.h"
+
+namespace Offscreen {
+    enum FrameFormat {
+        // frame_000000.png ...
+        FRAME_PNG = 0,
+        // frame_000000.rgba ..., top row first, 4 bytes per pixel, no header
+        FRAME_RAW
+    };
+
+    class FrameWriter {
+    public:
+        struct Stats {
+            uint64_t writtenFrames;
+            uint64_t failedFrames;
+            uint64_t writtenBytes;
+            // Time write() spent waiting for a free frame, the writer was the bottleneck
+            double blockedSeconds;
+        };
+
+        FrameWriter(const std::string &_directory, FrameFormat _format, int _width, int _height,
+                    unsigned int _maxPending = 8);
+
+        // Waits for every frame
+        ~FrameWriter();
+
+        // _rgba holds the rows bottom up, as glReadPixels returns them, and is copied
+        void write(uint64_t _frame, const unsigned char *_rgba);
+
+        // Blocks until every frame given so far is on disk
+        void finish();
+
+        Stats getStats() const;
+
+        static const char *extension(FrameFormat _format) { return _format == FRAME_PNG ? "png" : "rgba"; }
+
+    private:
+        std::string directory;
+        FrameFormat format;
+        int width;
+        int height;
+        unsigned int maxPending;
+
+        mutable std::mutex mutex;
+        std::condition_variable changed;
+        unsigned int pending;
+        // Frame buffers the writer is done with, reused instead of allocating per frame
+        std::vector<std::vector<unsigned char> > spare;
+        Stats stats;
+
+        // Declared last, its thread is joined before the members above go away
+        Parallel::JobQueue queue;
+
+        void encode(uint64_t _frame, std::vector<unsigned char> &_pixels);
+
+        FrameWriter(const FrameWriter &);
+
+        FrameWriter &operator=(const FrameWriter &);
+    };
+}
@@ -0,0 +1,196 @@
+#include "gesture_batch.h"
+#include <algorithm>
+#include <cmath>
+#include "finger_animator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GESTURE_SSE
+#include <immintrin.h>
+#endif
+
+namespace {
+
+static_assert(sizeof(glm::fquat) == 4 * sizeof(float), "quaternions are blended as packed floats");
+
+// Shortest arc, normalized. Only sums and products of matching components,
+// so the component order of glm::fquat does not matter.
+inline glm::fquat Nlerp(const glm::fquat &a, glm::fquat b, float t){
+    if (glm::dot(a, b) < 0.0f) b = -b;
+    glm::fquat q(a.w + (b.w - a.w) * t, a.x + (b.x - a.x) * t,
+                 a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+    return q * (1.0f / std::sqrt(glm::dot(q, q)));
+}
+
+// out[i] = Nlerp(from[i], Nlerp(a[i], b[i], t[i]), weight[i])
+void BlendScalar(const glm::fquat *from, const glm::fquat *a, const glm::fquat *b,
+                 const float *t, const float *weight, size_t begin, size_t end, glm::fquat *out){
+    for (size_t i = begin; i < end; i++){
+        out[i] = Nlerp(from[i], Nlerp(a[i], b[i], t[i]), weight[i]);
+    }
+}
+
+#ifdef GESTURE_SSE
+// Four quaternions, one component per register
+struct QuatLanes{
+    __m128 c[4];
+};
+
+inline QuatLanes Load(const glm::fquat *q){
+    const float *f = reinterpret_cast<const float *>(q);
+    QuatLanes lanes = {{_mm_loadu_ps(f), _mm_loadu_ps(f + 4), _mm_loadu_ps(f + 8), _mm_loadu_ps(f + 12)}};
+    _MM_TRANSPOSE4_PS(lanes.c[0], lanes.c[1], lanes.c[2], lanes.c[3]);
+    return lanes;
+}
+
+inline void Store(QuatLanes lanes, glm::fquat *q){
+    float *f = reinterpret_cast<float *>(q);
+    _MM_TRANSPOSE4_PS(lanes.c[0], lanes.c[1], lanes.c[2], lanes.c[3]);
+    for (int k = 0; k < 4; k++) _mm_storeu_ps(f + 4 * k, lanes.c[k]);
+}
+
+inline QuatLanes Nlerp(const QuatLanes &a, const QuatLanes &b, __m128 t){
+    __m128 dot = _mm_setzero_ps();
+    for (int k = 0; k < 4; k++) dot = _mm_add_ps(dot, _mm_mul_ps(a.c[k], b.c[k]));
+    // The sign bit of the dot product flips b onto the shortest arc
+    __m128 flip = _mm_and_ps(dot, _mm_set1_ps(-0.0f));
+    QuatLanes q;
+    __m128 length2 = _mm_setzero_ps();
+    for (int k = 0; k < 4; k++){
+        __m128 bk = _mm_xor_ps(b.c[k], flip);
+        q.c[k] = _mm_add_ps(a.c[k], _mm_mul_ps(_mm_sub_ps(bk, a.c[k]), t));
+        length2 = _mm_add_ps(length2, _mm_mul_ps(q.c[k], q.c[k]));
+    }
+    __m128 inv_length = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length2));
+    for (int k = 0; k < 4; k++) q.c[k] = _mm_mul_ps(q.c[k], inv_length);
+    return q;
+}
+
+void Blend(const glm::fquat *from, const glm::fquat *a, const glm::fquat *b,
+           const float *t, const float *weight, size_t n, glm::fquat *out){
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        QuatLanes current = Nlerp(Load(a + i), Load(b + i), _mm_loadu_ps(t + i));
+        Store(Nlerp(Load(from + i), current, _mm_loadu_ps(weight + i)), out + i);
+    }
+    BlendScalar(from, a, b, t, weight, i, n, out);
+}
+#else
+void Blend(const glm::fquat *from, const glm::fquat *a, const glm::fquat *b,
+           const float *t, const float *weight, size_t n, glm::fquat *out){
+    BlendScalar(from, a, b, t, weight, 0, n, out);
+}
+#endif
+
+inline double Progress(double cur_time, double begin_time, double seconds){
+    if (seconds <= 0.0) return 1.0;
+    return std::min(std::max((cur_time - begin_time) / seconds, 0.0), 1.0);
+}
+
+}  // namespace
+
+GesturePoseTable::GesturePoseTable(const FingerGesture &gesture)
+    : duration_(std::max(gesture.Duration(), 0.0)),
+      sample_num_(duration_ > 0.0 ? kSampleNum : 1){
+    samples_.resize(sample_num_ * kJointNum);
+    for (int s = 0; s < sample_num_; s++){
+        double time = sample_num_ > 1 ? duration_ * s / (sample_num_ - 1) : 0.0;
+        glm::fmat4 joint[kJointNum];
+        gesture.Update(0.0, time, joint[0], joint[1], joint[2]);
+        for (int j = 0; j < kJointNum; j++){
+            samples_[s * kJointNum + j] = glm::normalize(glm::quat_cast(glm::fmat3(joint[j])));
+        }
+    }
+}
+
+const GesturePoseTable *GestureBatch::Compile(const FingerGesture *gesture){
+    if (!gesture) return nullptr;
+    std::unique_ptr<GesturePoseTable> &table = tables_[gesture];
+    if (!table) table.reset(new GesturePoseTable(*gesture));
+    return table.get();
+}
+
+int GestureBatch::AddFinger(
+    SkeletalMesh::SkeletonModifier &modifier,
+    SkeletalMesh::BoneHandle proximal,
+    SkeletalMesh::BoneHandle intermediate,
+    SkeletalMesh::BoneHandle distal,
+    const FingerGesture *gesture, double begin_time
+){
+    Finger finger;
+    finger.modifier = &modifier;
+    finger.bones[0] = proximal;
+    finger.bones[1] = intermediate;
+    finger.bones[2] = distal;
+    finger.gesture = gesture;
+    finger.table = Compile(gesture);
+    finger.begin_time = begin_time;
+    finger.fade_begin = begin_time;
+    finger.fade_seconds = 0.0;
+    finger.settled = !finger.table;
+    fingers_.push_back(finger);
+    pose_.resize(fingers_.size() * GesturePoseTable::kJointNum, glm::fquat(1.0f, 0.0f, 0.0f, 0.0f));
+    fade_from_.resize(pose_.size(), glm::fquat(1.0f, 0.0f, 0.0f, 0.0f));
+    return (int)fingers_.size() - 1;
+}
+
+void GestureBatch::SetGesture(int finger_index, const FingerGesture *gesture, double cur_time, double fade_seconds){
+    Finger &finger = fingers_[finger_index];
+    if (gesture == finger.gesture) return;
+    finger.gesture = gesture;
+    finger.table = Compile(gesture);
+    finger.begin_time = cur_time;
+    finger.fade_begin = cur_time;
+    finger.fade_seconds = std::max(fade_seconds, 0.0);
+    finger.settled = !finger.table;
+    std::copy(pose_.begin() + finger_index * GesturePoseTable::kJointNum,
+              pose_.begin() + (finger_index + 1) * GesturePoseTable::kJointNum,
+              fade_from_.begin() + finger_index * GesturePoseTable::kJointNum);
+}
+
+size_t GestureBatch::Update(double cur_time){
+    const int kJointNum = GesturePoseTable::kJointNum;
+
+    // Gather, per joint of every moving finger, the two table samples around
+    // its time and the fade weight
+    size_t lane_num = pose_.size();
+    lane_.resize(lane_num);
+    from_.resize(lane_num);
+    a_.resize(lane_num);
+    b_.resize(lane_num);
+    t_.resize(lane_num);
+    weight_.resize(lane_num);
+    size_t moving = 0, k = 0;
+    for (size_t i = 0; i < fingers_.size(); i++){
+        Finger &finger = fingers_[i];
+        if (finger.settled) continue;
+        const GesturePoseTable &table = *finger.table;
+        double progress = Progress(cur_time, finger.begin_time, table.Duration());
+        double weight = Progress(cur_time, finger.fade_begin, finger.fade_seconds);
+        double position = progress * (table.SampleNum() - 1);
+        int sample = std::min((int)position, std::max(table.SampleNum() - 2, 0));
+        int next = std::min(sample + 1, table.SampleNum() - 1);
+        float t = (float)(position - sample);
+        for (int j = 0; j < kJointNum; j++, k++){
+            lane_[k] = (int)i * kJointNum + j;
+            from_[k] = fade_from_[i * kJointNum + j];
+            a_[k] = table.Sample(sample, j);
+            b_[k] = table.Sample(next, j);
+            t_[k] = t;
+            weight_[k] = (float)weight;
+        }
+        // This write reaches the final pose, nothing changes after it
+        if (progress >= 1.0 && weight >= 1.0) finger.settled = true;
+        moving++;
+    }
+
+    blended_.resize(lane_num);
+    Blend(from_.data(), a_.data(), b_.data(), t_.data(), weight_.data(), k, blended_.data());
+
+    for (size_t m = 0; m < k; m++){
+        int lane = lane_[m];
+        const Finger &finger = fingers_[lane / kJointNum];
+        pose_[lane] = blended_[m];
+        finger.modifier->set(finger.bones[lane % kJointNum], glm::mat4_cast(blended_[m]));
+    }
+    return moving;
+}
@@ -0,0 +1,86 @@
+#ifndef GESTURE_BATCH_H
+#define GESTURE_BATCH_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "skeleton.h"
+
+class FingerGesture;
+
+// A gesture sampled once over its normalized time into a quaternion curve
+// per joint, so that animating a finger is a lookup instead of a virtual call
+class GesturePoseTable{
+public:
+    static const int kJointNum = 3;     // proximal, intermediate, distal
+    static const int kSampleNum = 32;
+
+    explicit GesturePoseTable(const FingerGesture &gesture);
+
+    double Duration() const { return duration_; }
+    int SampleNum() const { return sample_num_; }
+
+    const glm::fquat &Sample(int sample, int joint) const {
+        return samples_[sample * kJointNum + joint];
+    }
+
+private:
+    double duration_;
+    int sample_num_;
+    std::vector<glm::fquat> samples_;
+};
+
+// The fingers of any number of hands, blended together in one loop.
+// A finger whose gesture has finished is written once more and then left
+// alone until it gets a new gesture.
+class GestureBatch{
+public:
+    // Returns the index of the finger. The gesture is compiled on first use
+    // and must outlive the batch.
+    int AddFinger(
+        SkeletalMesh::SkeletonModifier &modifier,
+        SkeletalMesh::BoneHandle proximal,
+        SkeletalMesh::BoneHandle intermediate,
+        SkeletalMesh::BoneHandle distal,
+        const FingerGesture *gesture, double begin_time
+    );
+
+    // Cross-fades from the finger's current pose into the new gesture over
+    // fade_seconds, 0 switches at once. Setting the gesture the finger
+    // already plays does not restart it.
+    void SetGesture(int finger, const FingerGesture *gesture, double cur_time, double fade_seconds = 0.0);
+
+    // Writes every finger still moving into its modifier, returns how many
+    size_t Update(double cur_time);
+
+    size_t FingerNum() const { return fingers_.size(); }
+
+private:
+    struct Finger{
+        SkeletalMesh::SkeletonModifier *modifier;
+        SkeletalMesh::BoneHandle bones[GesturePoseTable::kJointNum];
+        const FingerGesture *gesture;
+        const GesturePoseTable *table;
+        double begin_time;
+        double fade_begin;
+        double fade_seconds;
+        bool settled;
+    };
+
+    const GesturePoseTable *Compile(const FingerGesture *gesture);
+
+    std::map<const FingerGesture *, std::unique_ptr<GesturePoseTable> > tables_;
+    std::vector<Finger> fingers_;
+    // Per finger and joint: the pose last written and the pose a fade started from
+    std::vector<glm::fquat> pose_;
+    std::vector<glm::fquat> fade_from_;
+    // Per joint of the fingers moving this update, the inputs of the blend
+    std::vector<int> lane_;
+    std::vector<glm::fquat> from_, a_, b_;
+    std::vector<float> t_, weight_;
+    std::vector<glm::fquat> blended_;
+};
+
+#endif  // GESTURE_BATCH_H
@@ -2,16 +2,40 @@
 #include "GLFW/glfw3.h"
 #include <algorithm>
 
-void HandAnimator::SetGesture(std::vector<const FingerGesture *> finger_gesture_list){
-    int sz = std::min(finger_gesture_list.size(), finger_animator_list_.size());
+HandAnimator::HandAnimator(std::vector<FingerAnimator> finger_animator_list):
+    own_batch_(new GestureBatch()), batch_(own_batch_.get()){
+    AddFingers(finger_animator_list);
+}
+
+HandAnimator::HandAnimator(GestureBatch &batch, std::vector<FingerAnimator> finger_animator_list):
+    batch_(&batch){
+    AddFingers(finger_animator_list);
+}
+
+void HandAnimator::AddFingers(const std::vector<FingerAnimator> &finger_animator_list){
+    for (const FingerAnimator &finger : finger_animator_list){
+        finger_list_.push_back(batch_->AddFinger(
+            finger.modifier(), finger.proximal(), finger.intermediate(), finger.distal(),
+            finger.gesture(), 0.0
+        ));
+    }
+}
+
+void HandAnimator::SetGesture(std::vector<const FingerGesture *> finger_gesture_list, double fade_seconds){
+    SetGesture(finger_gesture_list, glfwGetTime(), fade_seconds);
+}
+
+void HandAnimator::SetGesture(std::vector<const FingerGesture *> finger_gesture_list, double cur_time, double fade_seconds){
+    int sz = std::min(finger_gesture_list.size(), finger_list_.size());
     for (int i = 0; i < sz; i++){
-        finger_animator_list_[i].SetGesture(finger_gesture_list[i]);
+        batch_->SetGesture(finger_list_[i], finger_gesture_list[i], cur_time, fade_seconds);
     }
 }
 
 void HandAnimator::Update(){
-    float cur_time = glfwGetTime();
-    for (FingerAnimator &finger : finger_animator_list_){
-        finger.Update(cur_time);
-    }
-}
\ No newline at end of file
+    Update(glfwGetTime());
+}
+
+void HandAnimator::Update(double cur_time){
+    if (own_batch_) own_batch_->Update(cur_time);
+}
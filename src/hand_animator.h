@@ -2,18 +2,34 @@
 #define HAND_ANIMATOR_H
 
 #include "finger_animator.h"
+#include "gesture_batch.h"
+#include <memory>
 #include <vector>
 
 class HandAnimator{
 public:
-    HandAnimator(std::vector<FingerAnimator> finger_animator_list): 
-        finger_animator_list_(finger_animator_list) {}
+    // The fingers are animated by a batch of this hand's own
+    HandAnimator(std::vector<FingerAnimator> finger_animator_list);
 
-    void SetGesture(std::vector<const FingerGesture*> finger_gesture_list);
+    // The fingers join a batch shared with other hands, whoever owns it
+    // updates it once per frame for all of them
+    HandAnimator(GestureBatch &batch, std::vector<FingerAnimator> finger_animator_list);
+
+    // Fingers beyond the list keep their gesture
+    void SetGesture(std::vector<const FingerGesture*> finger_gesture_list, double fade_seconds = 0.0);
+
+    // Starts the gestures at cur_time, on the clock Update is given
+    void SetGesture(std::vector<const FingerGesture*> finger_gesture_list, double cur_time, double fade_seconds);
 
     void Update();
+
+    void Update(double cur_time);
 private:
-    std::vector<FingerAnimator> finger_animator_list_;
+    void AddFingers(const std::vector<FingerAnimator> &finger_animator_list);
+
+    std::unique_ptr<GestureBatch> own_batch_;
+    GestureBatch *batch_;
+    std::vector<int> finger_list_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,155 @@
+// Instanced Skinning Buffers
+// Feeds many instances of one scene to a single glDrawElementsInstancedBaseVertex
+// per mesh. The bone palettes of a whole Crowd live back to back in one texture
+// buffer, four RGBA32F texels per bone matrix, and every instance carries its model
+// matrix and the index of its first bone as instanced vertex attributes. A vertex
+// shader then fetches bone (in_bone_base + in_bone_index[i]) with texelFetch, so
+// the palette size is only bounded by GL_MAX_TEXTURE_BUFFER_SIZE rather than the
+// uniform space. Works with OpenGL 3.3 core.
+//
+//     SkeletalMesh::InstanceBuffer instances;   instances.create();
+//     instances.uploadInstances(attributes, instanceNum);
+//     scene.setInstanceInput(program, "in_model", "in_bone_base", instances.getInstanceBuffer());
+//     per frame: crowd.evaluate(); instances.uploadPalettes(crowd);
+//                instances.bindPalettes(SCENE_RESOURCE_SHADER_PALETTE_CHANNEL);
+//                scene.submit(queue, program, instances.instanceNum()); queue.flush();
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "gl_env.h"
+#include "crowd.h"
+
+#include <glm/glm.hpp>
+
+#define SCENE_RESOURCE_SHADER_PALETTE_CHANNEL 1
+
+namespace SkeletalMesh {
+    // Per-instance vertex attributes, laid out as Scene::setInstanceInput reads them
+    struct InstanceAttributes {
+        glm::fmat4 model;
+        // Palette index of the instance's bone 0, Crowd::getBoneBegin
+        GLint boneBase;
+        GLint padding[3];
+    };
+
+    class InstanceBuffer {
+    public:
+        struct Stats {
+            // Of the last uploadPalettes: bytes sent, glBufferSubData calls, whether the
+            // buffer was orphaned and refilled as a whole
+            size_t paletteBytes;
+            size_t paletteRanges;
+            bool paletteOrphaned;
+        };
+
+        InstanceBuffer() : paletteBuffer(0), paletteTexture(0), instanceBuffer(0), paletteCapacity(0),
+                           instanceCount(0) {
+            stats.paletteBytes = stats.paletteRanges = 0;
+            stats.paletteOrphaned = false;
+        }
+
+        ~InstanceBuffer() { destroy(); }
+
+        void create() {
+            destroy();
+            glGenBuffers(1, &paletteBuffer);
+            glGenBuffers(1, &instanceBuffer);
+            glGenTextures(1, &paletteTexture);
+            glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+
+        void destroy() {
+            if (paletteTexture) glDeleteTextures(1, &paletteTexture);
+            if (paletteBuffer) glDeleteBuffers(1, &paletteBuffer);
+            if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+            paletteTexture = paletteBuffer = instanceBuffer = 0;
+            paletteCapacity = 0;
+            instanceCount = 0;
+        }
+
+        // Bones the texture buffer can address on this implementation
+        static size_t maxBoneNum() {
+            GLint texels = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+            return (size_t) texels / 4;
+        }
+
+        void uploadInstances(const InstanceAttributes *_instances, size_t _instanceNum) {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, _instanceNum * sizeof(InstanceAttributes), _instances, GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            instanceCount = _instanceNum;
+        }
+
+        // Uploads the palettes that changed in the crowd's last evaluate, as runs of consecutive
+        // instances. Once most of the crowd moves, the buffer is orphaned and refilled instead,
+        // so the driver never waits for draws still reading the previous frame.
+        void uploadPalettes(const Crowd &_crowd) {
+            const SkeletonTransf &palettes = _crowd.getPalettes();
+            size_t bytes = palettes.size() * sizeof(glm::fmat4);
+            stats.paletteBytes = stats.paletteRanges = 0;
+            stats.paletteOrphaned = false;
+            glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+
+            size_t changedBones = 0;
+            for (size_t i = 0; i < _crowd.instanceNum(); i++)
+                if (_crowd.hasChanged(i)) changedBones += _crowd.getSkeleton(i).boneNum();
+            if (bytes != paletteCapacity || changedBones * 2 > palettes.size()) {
+                glBufferData(GL_TEXTURE_BUFFER, bytes, palettes.data(), GL_STREAM_DRAW);
+                paletteCapacity = bytes;
+                stats.paletteBytes = bytes;
+                stats.paletteRanges = 1;
+                stats.paletteOrphaned = true;
+            } else {
+                size_t instance = 0, instanceNum = _crowd.instanceNum();
+                while (instance < instanceNum) {
+                    if (!_crowd.hasChanged(instance)) {
+                        instance++;
+                        continue;
+                    }
+                    size_t end = instance + 1;
+                    while (end < instanceNum && _crowd.hasChanged(end)) end++;
+                    size_t first = _crowd.getBoneBegin(instance);
+                    size_t last = end < instanceNum ? _crowd.getBoneBegin(end) : palettes.size();
+                    glBufferSubData(GL_TEXTURE_BUFFER, first * sizeof(glm::fmat4), (last - first) * sizeof(glm::fmat4),
+                                    palettes.data() + first);
+                    stats.paletteBytes += (last - first) * sizeof(glm::fmat4);
+                    stats.paletteRanges++;
+                    instance = end;
+                }
+            }
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+
+        void bindPalettes(GLenum _channel) const {
+            glActiveTexture(GL_TEXTURE0 + _channel);
+            glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        GLuint getInstanceBuffer() const { return instanceBuffer; }
+
+        size_t instanceNum() const { return instanceCount; }
+
+        const Stats &getStats() const { return stats; }
+
+    private:
+        GLuint paletteBuffer;
+        GLuint paletteTexture;
+        GLuint instanceBuffer;
+        size_t paletteCapacity;
+        size_t instanceCount;
+        Stats stats;
+
+        InstanceBuffer(const InstanceBuffer &);
+
+        InstanceBuffer &operator=(const InstanceBuffer &);
+    };
+}
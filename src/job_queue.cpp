@@ -0,0 +1,50 @@
+#include "job_queue.h"
+
+#include <algorithm>
+
+namespace Parallel {
+    JobQueue::JobQueue(unsigned _threadNum)
+            : stopping(false) {
+        if (_threadNum == 0) _threadNum = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned i = 0; i < _threadNum; i++)
+            workers.push_back(std::thread(&JobQueue::workerLoop, this));
+    }
+
+    JobQueue::~JobQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    JobQueue &JobQueue::shared() {
+        static JobQueue queue;
+        return queue;
+    }
+
+    void JobQueue::submit(const Job &job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        wake.notify_one();
+    }
+
+    void JobQueue::workerLoop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job.swap(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+}
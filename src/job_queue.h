@@ -0,0 +1,45 @@
+// Background Job Queue
+// Fire-and-forget jobs served in submission order by dedicated threads. Meant
+// for long work such as asset loading that must neither block the render
+// thread nor occupy the ThreadPool it uses for per-frame work.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+    class JobQueue {
+    public:
+        typedef std::function<void()> Job;
+
+        // 0 picks one thread per hardware thread, minus the render thread
+        explicit JobQueue(unsigned _threadNum = 0);
+
+        // Jobs that have not started yet are dropped, running ones are waited for
+        ~JobQueue();
+
+        unsigned getThreadNum() const { return (unsigned) workers.size(); }
+
+        void submit(const Job &job);
+
+        static JobQueue &shared();
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<Job> jobs;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping;
+
+        JobQueue(const JobQueue &);
+
+        JobQueue &operator=(const JobQueue &);
+
+        void workerLoop();
+    };
+}
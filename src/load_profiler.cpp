@@ -0,0 +1,195 @@
+#include "load_profiler.h"
+
+#ifdef LOAD_PROFILER
+
+#include <algorithm>
+
+namespace LoadProfiler {
+    namespace {
+        const char *const PHASE_NAMES[PHASE_NUM + 1] = {
+                "read", "parse", "convert", "postprocess", "assembly", "texture decode", "upload", "span"
+        };
+
+        // Where Assimp's regions belong; the FBX importer reports read, parse and convert
+        // separately, other importers only the whole import
+        Phase assimpPhase(const std::string &_region) {
+            if (_region == "fbx read") return PHASE_READ;
+            if (_region == "fbx tokenize" || _region == "fbx parse") return PHASE_PARSE;
+            if (_region == "fbx convert") return PHASE_CONVERT;
+            if (_region == "preprocess" || _region.compare(0, 11, "postprocess") == 0) return PHASE_POSTPROCESS;
+            return PHASE_SPAN;
+        }
+
+        void writeJsonString(FILE *_out, const std::string &_text) {
+            fputc('"', _out);
+            for (size_t i = 0; i < _text.size(); i++) {
+                unsigned char c = (unsigned char) _text[i];
+                if (c == '"' || c == '\\') fprintf(_out, "\\%c", c);
+                else if (c < 0x20) fprintf(_out, "\\u%04x", c);
+                else fputc(c, _out);
+            }
+            fputc('"', _out);
+        }
+    }
+
+    const char *phaseName(Phase _phase) {
+        return _phase <= PHASE_NUM ? PHASE_NAMES[_phase] : "unknown";
+    }
+
+    Recorder &Recorder::shared() {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    Recorder::Recorder()
+            : origin(std::chrono::steady_clock::now()), assimpListener(*this) {
+        Assimp::Profiling::Profiler::SetListener(&assimpListener);
+    }
+
+    Recorder::~Recorder() {
+        Assimp::Profiling::Profiler::SetListener(NULL);
+    }
+
+    unsigned Recorder::threadId() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return threads.insert(std::make_pair(std::this_thread::get_id(), (unsigned) threads.size())).first->second;
+    }
+
+    void Recorder::record(const Event &_event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        eventList.push_back(_event);
+    }
+
+    std::vector<Event> Recorder::events() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return eventList;
+    }
+
+    void Recorder::clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        eventList.clear();
+    }
+
+    bool Recorder::writeChromeTrace(const std::string &_path) const {
+        std::vector<Event> list = events();
+        FILE *out = fopen(_path.c_str(), "w");
+        if (!out) return false;
+        fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for (size_t i = 0; i < list.size(); i++) {
+            const Event &event = list[i];
+            fprintf(out, "  {\"name\": ");
+            writeJsonString(out, event.name);
+            fprintf(out, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u, "
+                         "\"args\": {\"bytes\": %llu, \"items\": %llu}}%s\n",
+                    phaseName(event.phase), event.begin * 1e6, (event.end - event.begin) * 1e6, event.thread,
+                    (unsigned long long) event.bytes, (unsigned long long) event.items,
+                    i + 1 < list.size() ? "," : "");
+        }
+        fprintf(out, "]}\n");
+        return fclose(out) == 0;
+    }
+
+    void Recorder::printSummary(FILE *_out) const {
+        struct Row {
+            Phase phase;
+            std::string name;
+            double begin;
+            unsigned calls;
+            double seconds;
+            uint64_t bytes;
+            uint64_t items;
+        };
+        std::vector<Event> list = events();
+        std::vector<Row> rows;
+        Row phases[PHASE_NUM];
+        for (int p = 0; p < PHASE_NUM; p++) {
+            Row empty = {(Phase) p, phaseName((Phase) p), 0.0, 0, 0.0, 0, 0};
+            phases[p] = empty;
+        }
+        double begin = list.empty() ? 0.0 : list[0].begin, end = begin;
+        for (size_t i = 0; i < list.size(); i++) {
+            const Event &event = list[i];
+            begin = std::min(begin, event.begin);
+            end = std::max(end, event.end);
+            if (event.phase >= PHASE_NUM) continue;
+            size_t r = 0;
+            while (r < rows.size() && (rows[r].phase != event.phase || rows[r].name != event.name)) r++;
+            if (r == rows.size()) {
+                Row row = {event.phase, event.name, event.begin, 0, 0.0, 0, 0};
+                rows.push_back(row);
+            }
+            rows[r].begin = std::min(rows[r].begin, event.begin);
+            Row *targets[2] = {&rows[r], &phases[event.phase]};
+            for (int t = 0; t < 2; t++) {
+                targets[t]->calls++;
+                targets[t]->seconds += event.end - event.begin;
+                targets[t]->bytes += event.bytes;
+                targets[t]->items += event.items;
+            }
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+            return a.phase != b.phase ? a.phase < b.phase : a.begin < b.begin;
+        });
+
+        fprintf(_out, "%-15s %-48s %6s %10s %10s %12s %10s\n", "phase", "region", "calls", "ms", "MB", "items", "MB/s");
+        for (int pass = 0; pass < 2; pass++) {
+            const Row *table = pass == 0 ? rows.data() : phases;
+            size_t rowNum = pass == 0 ? rows.size() : (size_t) PHASE_NUM;
+            if (pass == 1) fprintf(_out, "-- per phase, busy time summed over threads\n");
+            for (size_t r = 0; r < rowNum; r++) {
+                const Row &row = table[r];
+                if (row.calls == 0) continue;
+                double megabytes = row.bytes / (1024.0 * 1024.0);
+                fprintf(_out, "%-15s %-48s %6u %10.2f %10.2f %12llu", phaseName(row.phase),
+                        pass == 0 ? row.name.c_str() : "", row.calls, row.seconds * 1e3, megabytes,
+                        (unsigned long long) row.items);
+                if (row.bytes && row.seconds > 0.0) fprintf(_out, " %10.1f\n", megabytes / row.seconds);
+                else fprintf(_out, " %10s\n", "-");
+            }
+        }
+        fprintf(_out, "wall %.2f ms from first to last event\n", (end - begin) * 1e3);
+    }
+
+    void Recorder::AssimpListener::BeginRegion(const std::string &_region) {
+        double time = recorder.now();
+        std::lock_guard<std::mutex> lock(mutex);
+        open[std::make_pair(std::this_thread::get_id(), _region)] = time;
+    }
+
+    void Recorder::AssimpListener::EndRegion(const std::string &_region, uint64_t _bytes, uint64_t _items) {
+        Event event;
+        event.end = recorder.now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<std::pair<std::thread::id, std::string>, double>::iterator it =
+                    open.find(std::make_pair(std::this_thread::get_id(), _region));
+            if (it == open.end()) return;
+            event.begin = it->second;
+            open.erase(it);
+        }
+        event.name = "assimp " + _region;
+        event.phase = assimpPhase(_region);
+        event.bytes = _bytes;
+        event.items = _items;
+        event.thread = recorder.threadId();
+        recorder.record(event);
+    }
+
+    Scope::Scope(const std::string &_name, Phase _phase) {
+        Recorder &recorder = Recorder::shared();
+        event.name = _name;
+        event.phase = _phase;
+        event.bytes = 0;
+        event.items = 0;
+        event.thread = recorder.threadId();
+        event.begin = recorder.now();
+    }
+
+    Scope::~Scope() {
+        Recorder &recorder = Recorder::shared();
+        event.end = recorder.now();
+        recorder.record(event);
+    }
+}
+
+#endif
@@ -0,0 +1,141 @@
+// Load-time Phase Profiler
+// Scoped timers around every phase of loading a scene: file read, parse, conversion
+// and post-processing inside Assimp, then assembly, texture decode and GL upload. Each
+// scope counts the bytes and items it processed. The recorded timeline is written as a
+// Chrome trace (chrome://tracing, Perfetto) and summed up per phase.
+//
+// Compiled in with LOAD_PROFILER defined (CMake option HAND_LOAD_PROFILER). Without it
+// the macros expand to nothing, so instrumented code pays nothing, arguments included.
+//
+//     LOAD_PROFILE_SCOPE(scope, "assembly", LoadProfiler::PHASE_ASSEMBLY);
+//     ...
+//     LOAD_PROFILE_COUNT(scope, vertexBytes, vertexNum);
+//
+//     LoadProfiler::Recorder::shared().writeChromeTrace("load_trace.json");
+//     LoadProfiler::Recorder::shared().printSummary(stdout);
+
+#pragma once
+
+#ifdef LOAD_PROFILER
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <assimp/Profiler.h>
+
+namespace LoadProfiler {
+    enum Phase {
+        PHASE_READ = 0,
+        PHASE_PARSE,
+        PHASE_CONVERT,
+        PHASE_POSTPROCESS,
+        PHASE_ASSEMBLY,
+        PHASE_TEXTURE_DECODE,
+        PHASE_UPLOAD,
+        PHASE_NUM,
+        // Encloses other phases, shown in the trace but not summed up
+        PHASE_SPAN = PHASE_NUM
+    };
+
+    const char *phaseName(Phase _phase);
+
+    struct Event {
+        std::string name;
+        Phase phase;
+        // Seconds since the recorder was created
+        double begin;
+        double end;
+        uint64_t bytes;
+        uint64_t items;
+        unsigned thread;
+    };
+
+    class Recorder {
+    public:
+        // Created on first use, which also starts recording the regions of every Assimp import
+        static Recorder &shared();
+
+        double now() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+        }
+
+        // Small id for the calling thread, in order of first appearance
+        unsigned threadId();
+
+        void record(const Event &_event);
+
+        std::vector<Event> events() const;
+
+        void clear();
+
+        bool writeChromeTrace(const std::string &_path) const;
+
+        // Per phase and region: calls, busy milliseconds, bytes, items and throughput
+        void printSummary(FILE *_out) const;
+
+    private:
+        // Turns Assimp's profiler regions into events, matching ends to begins per thread
+        class AssimpListener : public Assimp::Profiling::ProfilerListener {
+        public:
+            explicit AssimpListener(Recorder &_recorder) : recorder(_recorder) {}
+
+            void BeginRegion(const std::string &_region) override;
+
+            void EndRegion(const std::string &_region, uint64_t _bytes, uint64_t _items) override;
+
+        private:
+            Recorder &recorder;
+            std::mutex mutex;
+            std::map<std::pair<std::thread::id, std::string>, double> open;
+        };
+
+        std::chrono::steady_clock::time_point origin;
+        mutable std::mutex mutex;
+        std::vector<Event> eventList;
+        std::map<std::thread::id, unsigned> threads;
+        AssimpListener assimpListener;
+
+        Recorder();
+
+        ~Recorder();
+
+        Recorder(const Recorder &);
+
+        Recorder &operator=(const Recorder &);
+    };
+
+    // Records one event from construction to destruction
+    class Scope {
+    public:
+        Scope(const std::string &_name, Phase _phase);
+
+        ~Scope();
+
+        void count(uint64_t _bytes, uint64_t _items) {
+            event.bytes += _bytes;
+            event.items += _items;
+        }
+
+    private:
+        Event event;
+
+        Scope(const Scope &);
+
+        Scope &operator=(const Scope &);
+    };
+}
+
+#define LOAD_PROFILE_SCOPE(_var, _name, _phase) LoadProfiler::Scope _var((_name), (_phase))
+#define LOAD_PROFILE_COUNT(_var, _bytes, _items) (_var).count((_bytes), (_items))
+
+#else
+
+#define LOAD_PROFILE_SCOPE(_var, _name, _phase)
+#define LOAD_PROFILE_COUNT(_var, _bytes, _items) ((void) 0)
+
+#endif
@@ -2,6 +2,8 @@
 // Author: Yi Kangrui <yikangrui@pku.edu.cn>
 
 //#define DIFFUSE_TEXTURE_MAPPING
+//#define DUAL_QUATERNION_SKINNING
+//#define PACKED_VERTEX_FORMAT
 
 #include "gl_env.h"
 
@@ -15,20 +17,32 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <thread>
 
 #include "skeletal_mesh.h"
+#include "scene_load.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "hand_animator.h"
 #include "finger_animator.h"
+#include "offscreen.h"
+#include "frame_writer.h"
+#include "soft_raster.h"
+#include "uniform_stream.h"
 
 namespace SkeletalAnimation {
     const char *vertex_shader_330 =
             "#version 330 core\n"
             "const int MAX_BONES = 100;\n"
-            "uniform mat4 u_bone_transf[MAX_BONES];\n"
-            "uniform mat4 u_mvp;\n"
+            "layout(std140) uniform FrameData {\n"
+            "    mat4 u_mvp;\n"
+            "    mat4 u_bone_transf[MAX_BONES];\n"
+            "};\n"
             "layout(location = 0) in vec3 in_position;\n"
             "layout(location = 1) in vec2 in_texcoord;\n"
             "layout(location = 2) in vec3 in_normal;\n"
@@ -48,6 +62,81 @@ namespace SkeletalAnimation {
             "    pass_texcoord = in_texcoord;\n"
             "}\n";
 
+    // Same inputs, bones are (real, dual) vec4 pairs. At 2 vec4 per bone twice as many bones
+    // fit in the uniform block of vertex_shader_330.
+    const char *vertex_shader_330_dqs =
+            "#version 330 core\n"
+            "const int MAX_BONES = 200;\n"
+            "layout(std140) uniform FrameData {\n"
+            "    mat4 u_mvp;\n"
+            "    vec4 u_bone_dq[2 * MAX_BONES];\n"
+            "};\n"
+            "layout(location = 0) in vec3 in_position;\n"
+            "layout(location = 1) in vec2 in_texcoord;\n"
+            "layout(location = 2) in vec3 in_normal;\n"
+            "layout(location = 3) in ivec4 in_bone_index;\n"
+            "layout(location = 4) in vec4 in_bone_weight;\n"
+            "out vec2 pass_texcoord;\n"
+            "void main() {\n"
+            "    float adjust_factor = 0.0;\n"
+            "    for (int i = 0; i < 4; i++) adjust_factor += in_bone_weight[i] * 0.25;\n"
+            "    vec4 blend_real = vec4(0.0, 0.0, 0.0, 1.0);\n"
+            "    vec4 blend_dual = vec4(0.0);\n"
+            "    if (adjust_factor > 1e-3) {\n"
+            "        vec4 pivot = u_bone_dq[2 * in_bone_index[0]];\n"
+            "        blend_real = vec4(0.0);\n"
+            "        for (int i = 0; i < 4; i++) {\n"
+            "            vec4 real = u_bone_dq[2 * in_bone_index[i]];\n"
+            "            vec4 dual = u_bone_dq[2 * in_bone_index[i] + 1];\n"
+            "            float weight = in_bone_weight[i] / adjust_factor;\n"
+            "            if (dot(real, pivot) < 0.0) weight = -weight;\n"
+            "            blend_real += real * weight;\n"
+            "            blend_dual += dual * weight;\n"
+            "        }\n"
+            "        float len = length(blend_real);\n"
+            "        blend_real /= len;\n"
+            "        blend_dual /= len;\n"
+            "    }\n"
+            "    vec3 position = in_position + 2.0 * cross(blend_real.xyz,\n"
+            "        cross(blend_real.xyz, in_position) + blend_real.w * in_position);\n"
+            "    position += 2.0 * (blend_real.w * blend_dual.xyz - blend_dual.w * blend_real.xyz\n"
+            "        + cross(blend_real.xyz, blend_dual.xyz));\n"
+            "    gl_Position = u_mvp * vec4(position, 1.0);\n"
+            "    pass_texcoord = in_texcoord;\n"
+            "}\n";
+
+    // vertex_shader_330 for many instances at once: palettes come from a texture buffer holding
+    // every instance's bones back to back, the instance's own bones start at in_bone_base
+    const char *vertex_shader_330_instanced =
+            "#version 330 core\n"
+            "uniform samplerBuffer u_bone_palette;\n"
+            "uniform mat4 u_mvp;\n"
+            "layout(location = 0) in vec3 in_position;\n"
+            "layout(location = 1) in vec2 in_texcoord;\n"
+            "layout(location = 2) in vec3 in_normal;\n"
+            "layout(location = 3) in ivec4 in_bone_index;\n"
+            "layout(location = 4) in vec4 in_bone_weight;\n"
+            "layout(location = 5) in int in_bone_base;\n"
+            "layout(location = 6) in mat4 in_model;\n"
+            "out vec2 pass_texcoord;\n"
+            "mat4 fetch_bone(int bone) {\n"
+            "    int texel = 4 * (in_bone_base + bone);\n"
+            "    return mat4(texelFetch(u_bone_palette, texel), texelFetch(u_bone_palette, texel + 1),\n"
+            "                texelFetch(u_bone_palette, texel + 2), texelFetch(u_bone_palette, texel + 3));\n"
+            "}\n"
+            "void main() {\n"
+            "    float adjust_factor = 0.0;\n"
+            "    for (int i = 0; i < 4; i++) adjust_factor += in_bone_weight[i] * 0.25;\n"
+            "    mat4 bone_transform = mat4(1.0);\n"
+            "    if (adjust_factor > 1e-3) {\n"
+            "        bone_transform -= bone_transform;\n"
+            "        for (int i = 0; i < 4; i++)\n"
+            "            bone_transform += fetch_bone(in_bone_index[i]) * in_bone_weight[i] / adjust_factor;\n"
+            "    }\n"
+            "    gl_Position = u_mvp * in_model * bone_transform * vec4(in_position, 1.0);\n"
+            "    pass_texcoord = in_texcoord;\n"
+            "}\n";
+
     const char *fragment_shader_330 =
             "#version 330 core\n"
             "uniform sampler2D u_diffuse;\n"
@@ -62,6 +151,18 @@ namespace SkeletalAnimation {
             "}\n";
 }
 
+// GL time per frame given to uploading a scene that is still loading
+static const double UPLOAD_BUDGET_SECONDS = 0.004;
+
+// Video memory diffuse textures may stream into, the coarsest levels stay resident regardless
+static const size_t TEXTURE_BUDGET_BYTES = 64 * 1024 * 1024;
+
+// Uniform block binding point of FrameData, the MVP and bones of the frame
+static const GLuint FRAME_DATA_BINDING = 0;
+
+// Switching gestures blends out of the current pose over this long
+static const double GESTURE_FADE_SECONDS = 0.2;
+
 static void error_callback(int error, const char *description) {
     fprintf(stderr, "Error: %s\n", description);
 }
@@ -71,115 +172,311 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
         glfwSetWindowShouldClose(window, GLFW_TRUE);
 }
 
-static void ProcessHandGestureInput(GLFWwindow* window, HandAnimator* hand_animator){
+// Gesture of every finger, thumb first, for the keys J K L U I. False for any other key.
+static bool SelectHandGesture(int key, std::vector<const FingerGesture*> &finger_gesture_list){
     static const StraightenGesture straighten(0.8);
     static const BendGesture bend(0.8);
     static const FingerGesture idle;
-    
-    if(glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS){   // fist
-        hand_animator->SetGesture({&bend, &bend, &bend, &bend, &bend});
-    }
-    if(glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS){   // V
-        hand_animator->SetGesture({&bend, &idle, &idle, &bend, &bend});
-    }
-    if(glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS){   // open palm
-        hand_animator->SetGesture({&straighten, &straighten, &straighten,
-                                   &straighten, &straighten});
-    }
-    if(glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS){   // pistol
-        hand_animator->SetGesture({&straighten, &straighten, &bend, &bend, &bend});
+
+    switch(key){
+    case GLFW_KEY_J:    // fist
+        finger_gesture_list = {&bend, &bend, &bend, &bend, &bend};
+        return true;
+    case GLFW_KEY_K:    // V
+        finger_gesture_list = {&bend, &idle, &idle, &bend, &bend};
+        return true;
+    case GLFW_KEY_L:    // open palm
+        finger_gesture_list = {&straighten, &straighten, &straighten,
+                               &straighten, &straighten};
+        return true;
+    case GLFW_KEY_U:    // pistol
+        finger_gesture_list = {&straighten, &straighten, &bend, &bend, &bend};
+        return true;
+    case GLFW_KEY_I:    // call
+        finger_gesture_list = {&straighten, &bend, &bend, 
+                               &bend, &straighten};
+        return true;
+    default:
+        return false;
     }
-    if(glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS){   // call
-        hand_animator->SetGesture({&straighten, &bend, &bend, 
-                                   &bend, &straighten});
+}
+
+static void ProcessHandGestureInput(GLFWwindow* window, HandAnimator* hand_animator){
+    static const int keys[] = {GLFW_KEY_J, GLFW_KEY_K, GLFW_KEY_L, GLFW_KEY_U, GLFW_KEY_I};
+    std::vector<const FingerGesture*> finger_gesture_list;
+    for (int key : keys){
+        if(glfwGetKey(window, key) == GLFW_PRESS && SelectHandGesture(key, finger_gesture_list)){
+            hand_animator->SetGesture(finger_gesture_list, GESTURE_FADE_SECONDS);
+        }
     }
 }
 
-int main(int argc, char *argv[]) {
-    GLFWwindow *window;
-    GLuint vertex_shader, fragment_shader, program;
+static GLuint LinkProgram(const char *vertex_source, const char *fragment_source) {
+    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex_shader, 1, &vertex_source, NULL);
+    glCompileShader(vertex_shader);
 
-    glfwSetErrorCallback(error_callback);
+    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment_shader, 1, &fragment_source, NULL);
+    glCompileShader(fragment_shader);
 
-    if (!glfwInit())
-        exit(EXIT_FAILURE);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-#ifdef __APPLE__ // for macos
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+    int linkStatus;
+    if (glGetProgramiv(program, GL_LINK_STATUS, &linkStatus), linkStatus == GL_FALSE)
+        std::cout << "Error occured in glLinkProgram()" << std::endl;
+    return program;
+}
 
-    window = glfwCreateWindow(800, 800, "OpenGL output", NULL, NULL);
-    if (!window) {
-        glfwTerminate();
+// Hand --headless <directory> [--frames n] [--fps f] [--size WxH] [--format png|raw]
+//      [--gestures jklui] [--gesture-seconds s] [--renderer gl|software|compare] [--hands n]
+// renders n frames of a fixed clock without any window and writes them to <directory>, which
+// must exist. Each letter of --gestures acts as its key pressed for s seconds, in turn.
+// --hands, with or without --headless, draws a grid of n hands instead, instanced, each going
+// through the gestures on its own clock.
+// The software renderer draws on the CPU, compare draws every frame both ways, writes the GL
+// one and counts the pixels where the two differ by more than COMPARE_CHANNEL_TOLERANCE.
+enum HeadlessRenderer {
+    RENDERER_GL = 0,
+    RENDERER_SOFTWARE,
+    RENDERER_COMPARE
+};
+
+// Rasterization rules GL leaves open move single pixels along edges
+static const int COMPARE_CHANNEL_TOLERANCE = 2;
+static const double COMPARE_PIXEL_SHARE = 0.01;
+
+struct HeadlessOptions {
+    bool enabled = false;
+    std::string directory;
+    int frames = 240;
+    double fps = 60.0;
+    int width = 800;
+    int height = 800;
+    Offscreen::FrameFormat format = Offscreen::FRAME_PNG;
+    std::string gestures = "jlkliu";
+    double gesture_seconds = 2.0;
+    HeadlessRenderer renderer = RENDERER_GL;
+    int hands = 0;
+};
+
+static bool ParseHeadlessOptions(int argc, char *argv[], HeadlessOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--headless") == 0 && value) {
+            options.enabled = true;
+            options.directory = value;
+        } else if (strcmp(argv[i], "--frames") == 0 && value) {
+            options.frames = atoi(value);
+        } else if (strcmp(argv[i], "--fps") == 0 && value) {
+            options.fps = atof(value);
+        } else if (strcmp(argv[i], "--size") == 0 && value) {
+            if (sscanf(value, "%dx%d", &options.width, &options.height) != 2) return false;
+        } else if (strcmp(argv[i], "--format") == 0 && value) {
+            if (strcmp(value, "png") == 0) options.format = Offscreen::FRAME_PNG;
+            else if (strcmp(value, "raw") == 0) options.format = Offscreen::FRAME_RAW;
+            else return false;
+        } else if (strcmp(argv[i], "--gestures") == 0 && value) {
+            options.gestures = value;
+        } else if (strcmp(argv[i], "--gesture-seconds") == 0 && value) {
+            options.gesture_seconds = atof(value);
+        } else if (strcmp(argv[i], "--renderer") == 0 && value) {
+            if (strcmp(value, "gl") == 0) options.renderer = RENDERER_GL;
+            else if (strcmp(value, "software") == 0) options.renderer = RENDERER_SOFTWARE;
+            else if (strcmp(value, "compare") == 0) options.renderer = RENDERER_COMPARE;
+            else return false;
+        } else if (strcmp(argv[i], "--hands") == 0 && value) {
+            options.hands = atoi(value);
+            if (options.hands <= 0) return false;
+        } else {
+            return false;
+        }
+        i++;
+    }
+    // The software renderer draws a single hand
+    if (options.hands > 0 && options.renderer != RENDERER_GL) return false;
+    return options.frames > 0 && options.fps > 0.0 && options.width > 0 && options.height > 0 &&
+           options.gesture_seconds > 0.0;
+}
+
+int main(int argc, char *argv[]) {
+    GLFWwindow *window = NULL;
+    GLuint program;
+
+    HeadlessOptions headless;
+    if (!ParseHeadlessOptions(argc, argv, headless)) {
+        fprintf(stderr, "Usage: %s [--headless <directory> [--frames n] [--fps f] [--size WxH] "
+                        "[--format png|raw] [--gestures jklui] [--gesture-seconds s] "
+                        "[--renderer gl|software|compare]] [--hands n]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    glfwSetKeyCallback(window, key_callback);
+#ifdef HEADLESS_EGL
+    Offscreen::HeadlessContext headless_context;
+#endif
+    if (headless.enabled) {
+#ifdef HEADLESS_EGL
+        if (!headless_context.create()) {
+            fprintf(stderr, "Error: no EGL context with OpenGL 3.3 core\n");
+            exit(EXIT_FAILURE);
+        }
+        // GLEW looks for a GLX display after loading the entry points, there is none here
+        glewExperimental = GL_TRUE;
+        GLenum glew_status = glewInit();
+        if (glew_status != GLEW_OK && glew_status != GLEW_ERROR_NO_GLX_DISPLAY)
+            exit(EXIT_FAILURE);
+        glGetError();
+#else
+        fprintf(stderr, "Error: built without EGL, headless rendering is not available\n");
+        exit(EXIT_FAILURE);
+#endif
+    } else {
+        glfwSetErrorCallback(error_callback);
 
-    glfwMakeContextCurrent(window);
-    glfwSwapInterval(0);
+        if (!glfwInit())
+            exit(EXIT_FAILURE);
 
-    if (glewInit() != GLEW_OK)
-        exit(EXIT_FAILURE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__ // for macos
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
 
-    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader, 1, &SkeletalAnimation::vertex_shader_330, NULL);
-    glCompileShader(vertex_shader);
+        window = glfwCreateWindow(800, 800, "OpenGL output", NULL, NULL);
+        if (!window) {
+            glfwTerminate();
+            exit(EXIT_FAILURE);
+        }
 
-    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader, 1, &SkeletalAnimation::fragment_shader_330, NULL);
-    glCompileShader(fragment_shader);
+        glfwSetKeyCallback(window, key_callback);
 
-    program = glCreateProgram();
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
 
-    int linkStatus;
-    if (glGetProgramiv(program, GL_LINK_STATUS, &linkStatus), linkStatus == GL_FALSE)
-        std::cout << "Error occured in glLinkProgram()" << std::endl;
+        if (glewInit() != GLEW_OK)
+            exit(EXIT_FAILURE);
+    }
+
+    SkeletalMesh::LoadOptions load_options;
+    load_options.cacheDir = CACHE_DIR;
+    TextureImage::TextureStreamer texture_streamer(TEXTURE_BUDGET_BYTES);
+    // Frames of a headless run must not depend on when background fetches finish
+    load_options.textureStreamer = headless.enabled ? NULL : &texture_streamer;
+    // The software renderer draws from the CPU copy of the meshes
+    load_options.retainGeometry = headless.enabled && headless.renderer != RENDERER_GL;
+#ifdef PACKED_VERTEX_FORMAT
+    load_options.vertexFormat = SkeletalMesh::VERTEX_FORMAT_PACKED;
+#endif
+    // The hand loads in the background, frames keep coming with a progress bar until it is ready
+    std::shared_ptr<SkeletalMesh::SceneLoad> hand_load =
+            SkeletalMesh::SceneLoad::start("Hand", DATA_DIR"/Hand.fbx", load_options);
+    while (headless.enabled) {
+        SkeletalMesh::SceneLoad::State state = hand_load->update(UPLOAD_BUDGET_SECONDS);
+        if (state >= SkeletalMesh::SceneLoad::LOAD_READY) break;
+        if (state == SkeletalMesh::SceneLoad::LOAD_STAGING)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    while (!headless.enabled && !glfwWindowShouldClose(window) &&
+           hand_load->update(UPLOAD_BUDGET_SECONDS) < SkeletalMesh::SceneLoad::LOAD_READY) {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        glViewport(0, 0, width, height);
+        glClearColor(0.5, 0.5, 0.5, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, height / 2 - 4, (GLsizei) (width * hand_load->getProgress()), 8);
+        glClearColor(1.0, 1.0, 1.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDisable(GL_SCISSOR_TEST);
 
-    SkeletalMesh::Scene &sr = SkeletalMesh::Scene::loadScene("Hand", DATA_DIR"/Hand.fbx");
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+    SkeletalMesh::Scene &sr = hand_load->getScene();
     if (&sr == &SkeletalMesh::Scene::error)
         std::cout << "Error occured in loadMesh()" << std::endl;
 
+#ifdef LOAD_PROFILER
+    LoadProfiler::Recorder::shared().printSummary(stdout);
+    if (LoadProfiler::Recorder::shared().writeChromeTrace(CACHE_DIR "/load_trace.json"))
+        std::cout << "Load trace written to " CACHE_DIR "/load_trace.json" << std::endl;
+#endif
+
+#ifdef DUAL_QUATERNION_SKINNING
+    sr.setSkinningMode(SkeletalMesh::SKINNING_DUAL_QUATERNION);
+#endif
+    bool dual_quaternion = sr.getSkinningMode() == SkeletalMesh::SKINNING_DUAL_QUATERNION;
+
+    program = LinkProgram(dual_quaternion ? SkeletalAnimation::vertex_shader_330_dqs
+                                          : SkeletalAnimation::vertex_shader_330,
+                          SkeletalAnimation::fragment_shader_330);
+
     sr.setShaderInput(program, "in_position", "in_texcoord", "in_normal", "in_bone_index", "in_bone_weight");
 
-    float passed_time;
-    SkeletalMesh::SkeletonModifier modifier;
+    SkeletalMesh::SkeletonModifier modifier(sr.getSkeleton());
+    SkeletalMesh::BoneHandle metacarpals = modifier.find("metacarpals");
 
     const FingerGesture idle;
     HandAnimator hand_animator({
-        FingerAnimator(modifier["thumb_proximal_phalange"],
-                       modifier["thumb_intermediate_phalange"],
-                       modifier["thumb_distal_phalange"],
+        FingerAnimator(modifier,
+                       modifier.find("thumb_proximal_phalange"),
+                       modifier.find("thumb_intermediate_phalange"),
+                       modifier.find("thumb_distal_phalange"),
                        &idle
                        ),
-        FingerAnimator(modifier["index_proximal_phalange"],
-                       modifier["index_intermediate_phalange"],
-                       modifier["index_distal_phalange"],
+        FingerAnimator(modifier,
+                       modifier.find("index_proximal_phalange"),
+                       modifier.find("index_intermediate_phalange"),
+                       modifier.find("index_distal_phalange"),
                        &idle),
-        FingerAnimator(modifier["middle_proximal_phalange"],
-                       modifier["middle_intermediate_phalange"],
-                       modifier["middle_distal_phalange"],
+        FingerAnimator(modifier,
+                       modifier.find("middle_proximal_phalange"),
+                       modifier.find("middle_intermediate_phalange"),
+                       modifier.find("middle_distal_phalange"),
                        &idle),
-        FingerAnimator(modifier["ring_proximal_phalange"],
-                       modifier["ring_intermediate_phalange"],
-                       modifier["ring_distal_phalange"],
+        FingerAnimator(modifier,
+                       modifier.find("ring_proximal_phalange"),
+                       modifier.find("ring_intermediate_phalange"),
+                       modifier.find("ring_distal_phalange"),
                        &idle),
-        FingerAnimator(modifier["pinky_proximal_phalange"],
-                       modifier["pinky_intermediate_phalange"],
-                       modifier["pinky_distal_phalange"],
+        FingerAnimator(modifier,
+                       modifier.find("pinky_proximal_phalange"),
+                       modifier.find("pinky_intermediate_phalange"),
+                       modifier.find("pinky_distal_phalange"),
                        &idle)
     });
 
-    glEnable(GL_DEPTH_TEST);
-    while (!glfwWindowShouldClose(window)) {
-        passed_time = (float) glfwGetTime();
+    // The MVP and the palette of every frame are streamed through a ring of uniform buffer
+    // regions. A region holds one frame only, so the whole palette is written every frame.
+    // Sampler uniforms persist in the program and are set once.
+    size_t frame_block_bytes = UniformStream::bindBlock(program, "FrameData", FRAME_DATA_BINDING);
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "u_diffuse"), SCENE_RESOURCE_SHADER_DIFFUSE_CHANNEL);
+    glUseProgram(0);
+    size_t bone_bytes = dual_quaternion ? sizeof(SkeletalMesh::DualQuat) : sizeof(glm::fmat4);
+    size_t frame_data_bytes = sizeof(glm::fmat4) + sr.getSkeleton().boneNum() * bone_bytes;
+    // Frames are written straight into the mapped block, a palette larger than MAX_BONES would
+    // run past the region
+    if (frame_block_bytes == 0) {
+        fprintf(stderr, "Error: the skinning program has no FrameData uniform block\n");
+        exit(EXIT_FAILURE);
+    }
+    if (frame_data_bytes > frame_block_bytes) {
+        fprintf(stderr, "Error: %zu bones do not fit in the FrameData uniform block of %zu bytes\n",
+                sr.getSkeleton().boneNum(), frame_block_bytes);
+        exit(EXIT_FAILURE);
+    }
+    UniformStream::FrameRing frame_ring;
+    frame_ring.create(frame_block_bytes);
+    // Meshes of a frame are drawn sorted by state, runs sharing it in one multi-draw
+    SkeletalMesh::RenderQueue render_queue;
 
+    glEnable(GL_DEPTH_TEST);
+    auto animate_hand = [&](float passed_time) {
         // --- You may edit below ---
 
         // Example: Rotate the hand
@@ -187,11 +484,12 @@ int main(int argc, char *argv[]) {
         float metacarpals_angle = passed_time * (M_PI / 4.0f);
         // * target = metacarpals
         // * rotation axis = (1, 0, 0)
-        modifier["metacarpals"] = glm::rotate(glm::identity<glm::mat4>(), metacarpals_angle, glm::fvec3(1.0, 0.0, 0.0));
+        modifier.set(metacarpals,
+                     glm::rotate(glm::identity<glm::mat4>(), metacarpals_angle, glm::fvec3(1.0, 0.0, 0.0)));
 
         /**********************************************************************************\
         *
-        * To animate fingers, modify modifier["HAND_SECTION"] each frame,
+        * To animate fingers, call modifier.set(modifier.find("HAND_SECTION"), ...) each frame,
         * where HAND_SECTION can only be one of the bone names in the Hand's Hierarchy.
         *
         * A virtual hand's structure is like this: (slightly DIFFERENT from the real world)
@@ -227,7 +525,7 @@ int main(int argc, char *argv[]) {
         *				- pinky_distal_phalange
         *					- pinky_fingertip
         *
-        * Notice that modifier["HAND_SECTION"] is a local transformation matrix,
+        * Notice that the HAND_SECTION modifier is a local transformation matrix,
         * where (1, 0, 0) is the bone's direction, and apparently (0, 1, 0) / (0, 0, 1)
         * is perpendicular to the bone.
         * Particularly, (0, 0, 1) is the rotation axis of the nearer joint.
@@ -242,19 +540,22 @@ int main(int argc, char *argv[]) {
         // float thumb_angle = abs(time_in_period / (period * 0.5f) - 1.0f) * (M_PI / 3.0);
         // // * target = proximal phalange of the index
         // // * rotation axis = (0, 0, 1)
-        // modifier["index_proximal_phalange"] = glm::rotate(glm::identity<glm::mat4>(), thumb_angle,
-        //                                                   glm::fvec3(0.0, 0.0, 1.0));
+        // modifier.set(modifier.find("index_proximal_phalange"),
+        //              glm::rotate(glm::identity<glm::mat4>(), thumb_angle, glm::fvec3(0.0, 0.0, 1.0)));
 
-        ProcessHandGestureInput(window, &hand_animator);
-        hand_animator.Update();
+        hand_animator.Update(passed_time);
 
         // --- You may edit above ---
+    };
 
-        float ratio;
-        int width, height;
+    auto hand_mvp = [](float ratio) {
+        return glm::ortho(-12.5f * ratio, 12.5f * ratio, -5.f, 20.f, -20.f, 20.f)
+               *
+               glm::lookAt(glm::fvec3(.0f, .0f, -1.f), glm::fvec3(.0f, .0f, .0f), glm::fvec3(.0f, 1.f, .0f));
+    };
 
-        glfwGetFramebufferSize(window, &width, &height);
-        ratio = width / (float) height;
+    auto draw_frame = [&](int width, int height) {
+        float ratio = width / (float) height;
 
         glClearColor(0.5, 0.5, 0.5, 1.0);
 
@@ -262,17 +563,283 @@ int main(int argc, char *argv[]) {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(program);
-        glm::fmat4 mvp = glm::ortho(-12.5f * ratio, 12.5f * ratio, -5.f, 20.f, -20.f, 20.f)
-                         *
-                         glm::lookAt(glm::fvec3(.0f, .0f, -1.f), glm::fvec3(.0f, .0f, .0f), glm::fvec3(.0f, 1.f, .0f));
-        glUniformMatrix4fv(glGetUniformLocation(program, "u_mvp"), 1, GL_FALSE, (const GLfloat *) &mvp);
-        glUniform1i(glGetUniformLocation(program, "u_diffuse"), SCENE_RESOURCE_SHADER_DIFFUSE_CHANNEL);
-        SkeletalMesh::Scene::SkeletonTransf bonesTransf;
-        sr.getSkeletonTransform(bonesTransf, modifier);
-        if (!bonesTransf.empty())
-            glUniformMatrix4fv(glGetUniformLocation(program, "u_bone_transf"), bonesTransf.size(), GL_FALSE,
-                               (float *) bonesTransf.data());
-        sr.render();
+        char *frame_data = frame_ring.map();
+        if (frame_data) {
+            glm::fmat4 mvp = hand_mvp(ratio);
+            memcpy(frame_data, &mvp, sizeof(mvp));
+            sr.updateSkeletonTransform(modifier);
+            if (dual_quaternion) {
+                SkeletalMesh::toDualQuat(modifier.getTransform(), modifier.boneNum(),
+                                         (SkeletalMesh::DualQuat *) (frame_data + sizeof(mvp)));
+            } else {
+                memcpy(frame_data + sizeof(mvp), modifier.getTransform(), modifier.boneNum() * sizeof(glm::fmat4));
+            }
+            frame_ring.bind(FRAME_DATA_BINDING, frame_data_bytes);
+            sr.submit(render_queue, program);
+            render_queue.flush();
+            frame_ring.fence();
+        } else {
+            fprintf(stderr, "Error: could not map the uniform buffer, the hand is not drawn this frame\n");
+        }
+        // The hand spans about the window, finer levels stream in over the next frames
+        sr.requestTextureDetail(texture_streamer, (float) std::max(width, height));
+        texture_streamer.update();
+    };
+
+    // The same frame on the CPU, drawing the palette of the current modifier
+#ifdef DIFFUSE_TEXTURE_MAPPING
+    const SoftRaster::Shading software_shading = SoftRaster::SHADE_DIFFUSE;
+#else
+    const SoftRaster::Shading software_shading = SoftRaster::SHADE_TEXCOORD;
+#endif
+    SoftRaster::Rasterizer software_raster;
+    auto draw_frame_software = [&](SoftRaster::Target &target) {
+        sr.updateSkeletonTransform(modifier);
+        target.clear(glm::fvec4(0.5f, 0.5f, 0.5f, 1.0f));
+        software_raster.begin(target, hand_mvp(target.getWidth() / (float) target.getHeight()),
+                              modifier.getTransform(), modifier.boneNum(), software_shading);
+        bool drawn = sr.renderSoftware(software_raster);
+        software_raster.end();
+        return drawn;
+    };
+
+    // --hands: one Crowd poses every hand, palettes and model matrices go to an InstanceBuffer
+    // and each mesh is drawn once for all hands
+    SkeletalMesh::Crowd crowd;
+    SkeletalMesh::InstanceBuffer crowd_buffer;
+    GestureBatch crowd_gestures;
+    std::vector<size_t> crowd_gesture_index(headless.hands, (size_t) -1);
+    GLuint crowd_program = 0;
+    GLint crowd_mvp_location = -1;
+    int crowd_columns = (int) ceil(sqrt((double) headless.hands));
+    if (headless.hands > 0) {
+        size_t crowd_bones = sr.getSkeleton().boneNum() * headless.hands;
+        if (crowd_bones > SkeletalMesh::InstanceBuffer::maxBoneNum()) {
+            fprintf(stderr, "Error: %zu bones do not fit in a texture buffer of %zu\n", crowd_bones,
+                    SkeletalMesh::InstanceBuffer::maxBoneNum());
+            exit(EXIT_FAILURE);
+        }
+        crowd_program = LinkProgram(SkeletalAnimation::vertex_shader_330_instanced,
+                                    SkeletalAnimation::fragment_shader_330);
+        crowd_mvp_location = glGetUniformLocation(crowd_program, "u_mvp");
+        glUseProgram(crowd_program);
+        glUniform1i(glGetUniformLocation(crowd_program, "u_diffuse"), SCENE_RESOURCE_SHADER_DIFFUSE_CHANNEL);
+        glUniform1i(glGetUniformLocation(crowd_program, "u_bone_palette"), SCENE_RESOURCE_SHADER_PALETTE_CHANNEL);
+        glUseProgram(0);
+        crowd.reset(std::vector<const SkeletalMesh::Skeleton *>(headless.hands, &sr.getSkeleton()));
+
+        // Hands span about y in [-5, 20] at the origin, each is centered and shrunk into its cell
+        static const char *fingers[] = {"thumb", "index", "middle", "ring", "pinky"};
+        float cell = 25.0f / crowd_columns;
+        std::vector<SkeletalMesh::InstanceAttributes> attributes(headless.hands);
+        for (int i = 0; i < headless.hands; i++) {
+            glm::fvec3 center(-12.5f + (i % crowd_columns + 0.5f) * cell, -5.0f + (i / crowd_columns + 0.5f) * cell,
+                              0.0f);
+            memset(&attributes[i], 0, sizeof(attributes[i]));
+            attributes[i].model = glm::translate(glm::identity<glm::fmat4>(), center) *
+                                  glm::scale(glm::identity<glm::fmat4>(), glm::fvec3(1.0f / crowd_columns)) *
+                                  glm::translate(glm::identity<glm::fmat4>(), glm::fvec3(0.0f, -7.5f, 0.0f));
+            attributes[i].boneBase = (GLint) crowd.getBoneBegin(i);
+
+            SkeletalMesh::SkeletonModifier &hand = crowd.getModifier(i);
+            for (const char *finger : fingers) {
+                crowd_gestures.AddFinger(hand,
+                                         hand.find(std::string(finger) + "_proximal_phalange"),
+                                         hand.find(std::string(finger) + "_intermediate_phalange"),
+                                         hand.find(std::string(finger) + "_distal_phalange"),
+                                         &idle, 0.0);
+            }
+        }
+        crowd_buffer.create();
+        crowd_buffer.uploadInstances(attributes.data(), attributes.size());
+        sr.setInstanceInput(crowd_program, "in_model", "in_bone_base", crowd_buffer.getInstanceBuffer());
+    }
+
+    auto animate_crowd = [&](double passed_time) {
+        std::vector<const FingerGesture *> finger_gesture_list;
+        for (int i = 0; i < headless.hands; i++) {
+            // Golden ratio offsets spread the hands evenly over the gesture cycle and the turn
+            double offset = fmod(i * 0.6180339887498949, 1.0);
+            crowd.getModifier(i).set(metacarpals,
+                                     glm::rotate(glm::identity<glm::mat4>(),
+                                                 (float) ((passed_time + offset * 8.0) * (M_PI / 4.0)),
+                                                 glm::fvec3(1.0, 0.0, 0.0)));
+            if (headless.gestures.empty()) continue;
+            size_t index = (size_t) (passed_time / headless.gesture_seconds + offset * headless.gestures.size()) %
+                           headless.gestures.size();
+            if (index != crowd_gesture_index[i] &&
+                SelectHandGesture(toupper(headless.gestures[index]), finger_gesture_list)) {
+                for (int f = 0; f < 5; f++)
+                    crowd_gestures.SetGesture(i * 5 + f, finger_gesture_list[f], passed_time, GESTURE_FADE_SECONDS);
+            }
+            crowd_gesture_index[i] = index;
+        }
+        crowd_gestures.Update(passed_time);
+        crowd.evaluate();
+    };
+
+    auto draw_crowd = [&](int width, int height) {
+        float ratio = width / (float) height;
+
+        glClearColor(0.5, 0.5, 0.5, 1.0);
+
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        glUseProgram(crowd_program);
+        glm::fmat4 mvp = hand_mvp(ratio);
+        glUniformMatrix4fv(crowd_mvp_location, 1, GL_FALSE, (const GLfloat *) &mvp);
+        crowd_buffer.uploadPalettes(crowd);
+        crowd_buffer.bindPalettes(SCENE_RESOURCE_SHADER_PALETTE_CHANNEL);
+        sr.submit(render_queue, crowd_program, (GLsizei) crowd_buffer.instanceNum());
+        render_queue.flush();
+        sr.requestTextureDetail(texture_streamer, (float) std::max(width, height) / crowd_columns);
+        texture_streamer.update();
+    };
+
+    if (headless.enabled) {
+        int exit_status = EXIT_SUCCESS;
+        {
+            // Frames go through the PBO ring to the writer thread, the clock advances exactly 1 / fps
+            // per frame however long drawing takes
+            Offscreen::RenderTarget target;
+            if (!target.create(headless.width, headless.height)) {
+                fprintf(stderr, "Error: incomplete offscreen framebuffer\n");
+                exit(EXIT_FAILURE);
+            }
+            Offscreen::FrameWriter writer(headless.directory, headless.format, headless.width, headless.height);
+            SoftRaster::Target software_target;
+            software_target.resize(headless.width, headless.height);
+            // Software frames wait here until the GL frame of the same number is read back
+            std::vector<std::vector<unsigned char> > software_frames(
+                    headless.renderer == RENDERER_COMPARE ? Offscreen::READBACK_RING_SIZE + 1 : 0);
+            size_t compared_pixels = 0, differing_pixels = 0;
+            int max_channel_difference = 0;
+            Offscreen::FrameReadback readback(
+                    headless.width, headless.height,
+                    [&](uint64_t frame, const unsigned char *rgba) {
+                        if (!software_frames.empty()) {
+                            const std::vector<unsigned char> &software = software_frames[frame % software_frames.size()];
+                            for (size_t p = 0; p < software.size(); p += 4) {
+                                int difference = 0;
+                                for (int c = 0; c < 3; c++)
+                                    difference = std::max(difference, abs((int) rgba[p + c] - (int) software[p + c]));
+                                max_channel_difference = std::max(max_channel_difference, difference);
+                                if (difference > COMPARE_CHANNEL_TOLERANCE) differing_pixels++;
+                            }
+                            compared_pixels += software.size() / 4;
+                        }
+                        writer.write(frame, rgba);
+                    });
+
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            size_t gesture_index = 0;
+            std::vector<const FingerGesture*> finger_gesture_list;
+            for (int frame = 0; frame < headless.frames; frame++) {
+                double frame_time = frame / headless.fps;
+                if (crowd_program) {
+                    animate_crowd(frame_time);
+                    target.bind();
+                    draw_crowd(headless.width, headless.height);
+                    readback.capture(frame);
+                    continue;
+                }
+                if (!headless.gestures.empty()) {
+                    size_t index = (size_t) (frame_time / headless.gesture_seconds) % headless.gestures.size();
+                    if ((frame == 0 || index != gesture_index) &&
+                        SelectHandGesture(toupper(headless.gestures[index]), finger_gesture_list))
+                        hand_animator.SetGesture(finger_gesture_list, frame_time, GESTURE_FADE_SECONDS);
+                    gesture_index = index;
+                }
+                animate_hand((float) frame_time);
+                if (headless.renderer != RENDERER_SOFTWARE) {
+                    target.bind();
+                    draw_frame(headless.width, headless.height);
+                    readback.capture(frame);
+                }
+                if (headless.renderer != RENDERER_GL) {
+                    if (!draw_frame_software(software_target)) {
+                        fprintf(stderr, "Error: the software renderer needs linear blend skinning\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    const unsigned char *pixels = software_target.getPixels();
+                    if (software_frames.empty()) {
+                        writer.write(frame, pixels);
+                    } else {
+                        software_frames[frame % software_frames.size()].assign(
+                                pixels, pixels + (size_t) headless.width * headless.height * 4);
+                    }
+                }
+            }
+            readback.flush();
+            double render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            writer.finish();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            const Offscreen::FrameReadback::Stats &readback_stats = readback.getStats();
+            Offscreen::FrameWriter::Stats writer_stats = writer.getStats();
+            printf("%d frames %dx%d in %.3f s: %.1f frames/s written, %.1f frames/s rendered\n",
+                   headless.frames, headless.width, headless.height, seconds, headless.frames / seconds,
+                   headless.frames / render_seconds);
+            if (headless.renderer != RENDERER_SOFTWARE) {
+                printf("readback: %llu stalls, %.3f s waiting for the GPU\n",
+                       (unsigned long long) readback_stats.stalls, readback_stats.stallSeconds);
+            }
+            if (headless.renderer != RENDERER_SOFTWARE && !crowd_program) {
+                const UniformStream::FrameRing::Stats &uniform_stats = frame_ring.getStats();
+                printf("uniforms: %zu bytes per frame, %.2f MB in total, %llu fence waits (%.3f s), %s mapping\n",
+                       uniform_stats.frameBytes, uniform_stats.totalBytes / 1048576.0,
+                       (unsigned long long) uniform_stats.fenceWaits, uniform_stats.fenceWaitSeconds,
+                       uniform_stats.persistent ? "persistent" : "unsynchronized");
+            }
+            if (headless.renderer != RENDERER_SOFTWARE) {
+                const SkeletalMesh::RenderQueue::Stats &queue_stats = render_queue.getStats();
+                printf("draws: %zu meshes, %zu draws and %zu state changes in mesh order, "
+                       "%zu and %zu sorted\n", queue_stats.itemNum, queue_stats.unsortedDraws,
+                       queue_stats.unsortedStateChanges, queue_stats.draws, queue_stats.stateChanges);
+            }
+            if (crowd_program) {
+                const SkeletalMesh::InstanceBuffer::Stats &crowd_stats = crowd_buffer.getStats();
+                printf("crowd: %d hands, %zu draws per frame, last palette upload %.2f MB in %zu ranges%s\n",
+                       headless.hands, sr.getMeshEntries().size(), crowd_stats.paletteBytes / 1048576.0,
+                       crowd_stats.paletteRanges, crowd_stats.paletteOrphaned ? ", orphaned" : "");
+            }
+            if (headless.renderer != RENDERER_GL) {
+                const SoftRaster::Rasterizer::Stats &raster_stats = software_raster.getStats();
+                printf("software: %zu triangles, %zu set up, %zu tile bins, %zu pixels shaded in the last frame\n",
+                       raster_stats.triangleNum, raster_stats.setupTriangleNum, raster_stats.binnedTriangleNum,
+                       raster_stats.shadedPixelNum);
+            }
+            if (headless.renderer == RENDERER_COMPARE) {
+                double share = compared_pixels ? (double) differing_pixels / compared_pixels : 0.0;
+                printf("compare: %zu of %zu pixels (%.3f%%) differ by more than %d, at most by %d\n",
+                       differing_pixels, compared_pixels, share * 100.0, COMPARE_CHANNEL_TOLERANCE,
+                       max_channel_difference);
+                if (share > COMPARE_PIXEL_SHARE) exit_status = EXIT_FAILURE;
+            }
+            printf("writer: %llu frames, %.1f MB to %s, %.3f s blocked, %llu failed\n",
+                   (unsigned long long) writer_stats.writtenFrames, writer_stats.writtenBytes / 1048576.0,
+                   headless.directory.c_str(), writer_stats.blockedSeconds,
+                   (unsigned long long) writer_stats.failedFrames);
+
+            if (writer_stats.failedFrames) exit_status = EXIT_FAILURE;
+        }
+        SkeletalMesh::Scene::unloadScene("Hand");
+        exit(exit_status);
+    }
+
+    while (!glfwWindowShouldClose(window)) {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+
+        if (crowd_program) {
+            animate_crowd(glfwGetTime());
+            draw_crowd(width, height);
+        } else {
+            ProcessHandGestureInput(window, &hand_animator);
+            animate_hand((float) glfwGetTime());
+            draw_frame(width, height);
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -0,0 +1,99 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace FileMapping {
+    MappedFile::MappedFile()
+            : address(NULL), length(0), opened(false)
+#ifdef _WIN32
+            , file(NULL), mapping(NULL)
+#endif
+    {}
+
+    MappedFile::MappedFile(const std::string &_path)
+            : MappedFile() {
+        open(_path);
+    }
+
+    MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string &_path, bool _sequential) {
+        close();
+        HANDLE handle = CreateFileA(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                    _sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+        if (handle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(handle, &fileSize)) {
+            CloseHandle(handle);
+            return false;
+        }
+        file = handle;
+        length = (size_t) fileSize.QuadPart;
+        opened = true;
+        if (length == 0) return true;
+
+        mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) address = MapViewOfFile((HANDLE) mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!address) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address) UnmapViewOfFile(address);
+        if (mapping) CloseHandle((HANDLE) mapping);
+        if (file) CloseHandle((HANDLE) file);
+        address = NULL;
+        mapping = NULL;
+        file = NULL;
+        length = 0;
+        opened = false;
+    }
+#else
+    bool MappedFile::open(const std::string &_path, bool _sequential) {
+        close();
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat status;
+        if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t) status.st_size;
+        if (length > 0) {
+            void *mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            address = mapped;
+            // Only a hint, failing it changes nothing
+            if (_sequential) madvise(mapped, length, MADV_SEQUENTIAL);
+        }
+        // The mapping keeps the file alive on its own
+        ::close(fd);
+        opened = true;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address) munmap(address, length);
+        address = NULL;
+        length = 0;
+        opened = false;
+    }
+#endif
+}
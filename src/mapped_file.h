@@ -0,0 +1,45 @@
+// Read-only Memory-mapped File
+// Maps a whole file so that loaders can hand its bytes straight to GL or to a
+// parser without copying them through a read buffer first.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace FileMapping {
+    class MappedFile {
+    public:
+        MappedFile();
+
+        explicit MappedFile(const std::string &_path);
+
+        ~MappedFile();
+
+        // Replaces any previous mapping, false if the file can not be opened or mapped.
+        // An empty file opens successfully with data() == NULL.
+        // _sequential hints the OS to read ahead aggressively, for files parsed front to back.
+        bool open(const std::string &_path, bool _sequential = false);
+
+        void close();
+
+        bool isOpen() const { return opened; }
+
+        const unsigned char *data() const { return (const unsigned char *) address; }
+
+        size_t size() const { return length; }
+
+    private:
+        void *address;
+        size_t length;
+        bool opened;
+#ifdef _WIN32
+        void *file;
+        void *mapping;
+#endif
+
+        MappedFile(const MappedFile &);
+
+        MappedFile &operator=(const MappedFile &);
+    };
+}
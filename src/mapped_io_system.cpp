@@ -0,0 +1,70 @@
+#include "mapped_io_system.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace FileMapping {
+    MappedIOStream::MappedIOStream(MappedFile *_file)
+            : file(_file), cursor(0) {}
+
+    MappedIOStream::~MappedIOStream() { delete file; }
+
+    size_t MappedIOStream::Read(void *pvBuffer, size_t pSize, size_t pCount) {
+        if (pSize == 0 || pCount == 0) return 0;
+        size_t count = std::min(pCount, (file->size() - cursor) / pSize);
+        memcpy(pvBuffer, file->data() + cursor, count * pSize);
+        cursor += count * pSize;
+        return count;
+    }
+
+    size_t MappedIOStream::Write(const void *, size_t, size_t) { return 0; }
+
+    aiReturn MappedIOStream::Seek(size_t pOffset, aiOrigin pOrigin) {
+        size_t target;
+        switch (pOrigin) {
+            case aiOrigin_SET:
+                target = pOffset;
+                break;
+            case aiOrigin_CUR:
+                target = cursor + pOffset;
+                break;
+            case aiOrigin_END:
+                // The offset is negative for aiOrigin_END, see IOStream::Seek
+                if (pOffset > file->size()) return AI_FAILURE;
+                target = file->size() - pOffset;
+                break;
+            default:
+                return AI_FAILURE;
+        }
+        if (target > file->size()) return AI_FAILURE;
+        cursor = target;
+        return AI_SUCCESS;
+    }
+
+    size_t MappedIOStream::Tell() const { return cursor; }
+
+    size_t MappedIOStream::FileSize() const { return file->size(); }
+
+    void MappedIOStream::Flush() {}
+
+    const void *MappedIOStream::MappedData() const { return file->data(); }
+
+    bool MappedIOSystem::Exists(const char *pFile) const {
+        struct stat status;
+        return pFile != NULL && stat(pFile, &status) == 0;
+    }
+
+    Assimp::IOStream *MappedIOSystem::Open(const char *pFile, const char *pMode) {
+        if (pFile == NULL || pMode == NULL) return NULL;
+        if (strchr(pMode, 'w') || strchr(pMode, 'a') || strchr(pMode, '+'))
+            return Assimp::DefaultIOSystem::Open(pFile, pMode);
+        MappedFile *file = new MappedFile();
+        if (!file->open(pFile, true)) {
+            delete file;
+            return NULL;
+        }
+        return new MappedIOStream(file);
+    }
+}
@@ -0,0 +1,55 @@
+// Memory-mapped Assimp IO System
+// Serves files opened for reading out of a MappedFile instead of copying them
+// through fread, and exposes the mapping via IOStream::MappedData so that the
+// binary FBX importer tokenizes the file in place. Writing falls back to the
+// default IO system.
+//
+//     Assimp::Importer importer;
+//     importer.SetIOHandler(new FileMapping::MappedIOSystem());  // the importer owns it
+
+#pragma once
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+
+#include "mapped_file.h"
+
+namespace FileMapping {
+    class MappedIOStream : public Assimp::IOStream {
+    public:
+        // Takes over an open mapping
+        explicit MappedIOStream(MappedFile *_file);
+
+        ~MappedIOStream();
+
+        size_t Read(void *pvBuffer, size_t pSize, size_t pCount);
+
+        // Read-only, always writes nothing
+        size_t Write(const void *pvBuffer, size_t pSize, size_t pCount);
+
+        aiReturn Seek(size_t pOffset, aiOrigin pOrigin);
+
+        size_t Tell() const;
+
+        size_t FileSize() const;
+
+        void Flush();
+
+        const void *MappedData() const;
+
+    private:
+        MappedFile *file;
+        size_t cursor;
+
+        MappedIOStream(const MappedIOStream &);
+
+        MappedIOStream &operator=(const MappedIOStream &);
+    };
+
+    class MappedIOSystem : public Assimp::DefaultIOSystem {
+    public:
+        bool Exists(const char *pFile) const;
+
+        Assimp::IOStream *Open(const char *pFile, const char *pMode = "rb");
+    };
+}
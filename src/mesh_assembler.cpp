@@ -0,0 +1,160 @@
+#include "mesh_assembler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace MeshAssembler {
+    namespace {
+        struct Influence {
+            // Position among all weights of the scene, the order they used to be added in
+            unsigned order;
+            unsigned boneId;
+            float weight;
+        };
+
+        size_t chunkNum(size_t _elementNum) { return (_elementNum + ASSEMBLY_CHUNK_SIZE - 1) / ASSEMBLY_CHUNK_SIZE; }
+
+        void runTasks(Parallel::ThreadPool *_pool, size_t _taskNum, const Parallel::ThreadPool::Task &_task) {
+            if (_pool) {
+                _pool->run(_taskNum, _task);
+            } else {
+                for (size_t i = 0; i < _taskNum; i++) _task(i);
+            }
+        }
+
+        // Index of the range of _offset holding _element, skipping over empty ones
+        unsigned rangeOf(const std::vector<unsigned> &_offset, unsigned _element) {
+            return (unsigned) (std::upper_bound(_offset.begin(), _offset.end(), _element) - _offset.begin()) - 1;
+        }
+    }
+
+    void plan(const aiScene *_scene, Layout &_layout, std::map<std::string, unsigned> &_nameBoneMap,
+              std::vector<aiMatrix4x4> &_boneOffset) {
+        unsigned meshNum = _scene->mNumMeshes;
+        _layout.vertexOffset.assign(meshNum + 1, 0);
+        _layout.indexOffset.assign(meshNum + 1, 0);
+        _layout.meshBoneOffset.assign(meshNum + 1, 0);
+        _layout.boneId.clear();
+        for (unsigned i = 0; i < meshNum; i++) {
+            const aiMesh *mesh = _scene->mMeshes[i];
+            _layout.vertexOffset[i + 1] = _layout.vertexOffset[i] + mesh->mNumVertices;
+            _layout.indexOffset[i + 1] = _layout.indexOffset[i] + mesh->mNumFaces * 3;
+            _layout.meshBoneOffset[i] = (unsigned) _layout.boneId.size();
+            for (unsigned j = 0; j < mesh->mNumBones; j++) {
+                const aiBone *bone = mesh->mBones[j];
+                std::pair<std::map<std::string, unsigned>::iterator, bool> insertion =
+                        _nameBoneMap.insert(std::make_pair(std::string(bone->mName.data), (unsigned) _boneOffset.size()));
+                if (insertion.second) {
+                    _boneOffset.push_back(bone->mOffsetMatrix);
+                    _layout.boneId.push_back((int) insertion.first->second);
+                } else {
+                    _layout.boneId.push_back(-1);
+                }
+            }
+        }
+        _layout.meshBoneOffset[meshNum] = (unsigned) _layout.boneId.size();
+    }
+
+    void assemble(const aiScene *_scene, const Layout &_layout, SkeletalMesh::ParametricVertex *_vertices,
+                  unsigned *_indices, Parallel::ThreadPool *_pool) {
+        const unsigned vertexNum = _layout.vertexNum();
+        const unsigned faceNum = _layout.indexNum() / 3;
+
+        // Bones that contribute, and where their weights start in the scene-wide order
+        std::vector<unsigned> bones;
+        std::vector<unsigned> weightOrder;
+        unsigned weightNum = 0;
+        for (unsigned m = 0; m < _layout.meshNum(); m++) {
+            for (unsigned b = _layout.meshBoneOffset[m]; b < _layout.meshBoneOffset[m + 1]; b++) {
+                if (_layout.boneId[b] < 0) continue;
+                bones.push_back(b);
+                weightOrder.push_back(weightNum);
+                weightNum += _scene->mMeshes[m]->mBones[b - _layout.meshBoneOffset[m]]->mNumWeights;
+            }
+        }
+        std::unique_ptr<std::atomic<unsigned>[]> cursor(weightNum ? new std::atomic<unsigned>[vertexNum] : NULL);
+
+        // Attributes and faces, chunk by chunk across mesh boundaries
+        size_t vertexChunkNum = chunkNum(vertexNum);
+        runTasks(_pool, vertexChunkNum + chunkNum(faceNum), [&](size_t _task) {
+            if (_task < vertexChunkNum) {
+                unsigned begin = (unsigned) _task * ASSEMBLY_CHUNK_SIZE;
+                unsigned end = std::min(vertexNum, begin + ASSEMBLY_CHUNK_SIZE);
+                unsigned m = rangeOf(_layout.vertexOffset, begin);
+                for (unsigned v = begin; v < end; v++) {
+                    while (v >= _layout.vertexOffset[m + 1]) m++;
+                    const aiMesh *mesh = _scene->mMeshes[m];
+                    unsigned j = v - _layout.vertexOffset[m];
+                    aiVector2D texcoord(.0f, .0f);
+                    if (mesh->HasTextureCoords(0))
+                        texcoord = aiVector2D(mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y);
+                    _vertices[v] = SkeletalMesh::ParametricVertex(mesh->mVertices[j], texcoord, mesh->mNormals[j]);
+                    if (cursor) cursor[v].store(0, std::memory_order_relaxed);
+                }
+            } else {
+                unsigned begin = (unsigned) (_task - vertexChunkNum) * ASSEMBLY_CHUNK_SIZE;
+                unsigned end = std::min(faceNum, begin + ASSEMBLY_CHUNK_SIZE);
+                unsigned m = rangeOf(_layout.indexOffset, begin * 3);
+                for (unsigned f = begin; f < end; f++) {
+                    while (f * 3 >= _layout.indexOffset[m + 1]) m++;
+                    const aiFace &face = _scene->mMeshes[m]->mFaces[f - _layout.indexOffset[m] / 3];
+                    for (int k = 0; k < 3; k++)
+                        _indices[f * 3 + k] = face.mIndices[k];
+                }
+            }
+        });
+        if (weightNum == 0) return;
+
+        // Influence counts per vertex, bone by bone
+        runTasks(_pool, bones.size(), [&](size_t _task) {
+            unsigned b = bones[_task];
+            unsigned m = rangeOf(_layout.meshBoneOffset, b);
+            const aiBone *bone = _scene->mMeshes[m]->mBones[b - _layout.meshBoneOffset[m]];
+            for (unsigned k = 0; k < bone->mNumWeights; k++)
+                cursor[_layout.vertexOffset[m] + bone->mWeights[k].mVertexId].fetch_add(1, std::memory_order_relaxed);
+        });
+
+        // Counts become the start of every vertex's influence list and the cursor into it
+        std::vector<unsigned> influenceBegin(vertexNum + 1);
+        unsigned sum = 0;
+        for (unsigned v = 0; v < vertexNum; v++) {
+            influenceBegin[v] = sum;
+            sum += cursor[v].load(std::memory_order_relaxed);
+            cursor[v].store(influenceBegin[v], std::memory_order_relaxed);
+        }
+        influenceBegin[vertexNum] = sum;
+
+        std::vector<Influence> influences(weightNum);
+        runTasks(_pool, bones.size(), [&](size_t _task) {
+            unsigned b = bones[_task];
+            unsigned m = rangeOf(_layout.meshBoneOffset, b);
+            const aiBone *bone = _scene->mMeshes[m]->mBones[b - _layout.meshBoneOffset[m]];
+            for (unsigned k = 0; k < bone->mNumWeights; k++) {
+                unsigned v = _layout.vertexOffset[m] + bone->mWeights[k].mVertexId;
+                Influence &influence = influences[cursor[v].fetch_add(1, std::memory_order_relaxed)];
+                influence.order = weightOrder[_task] + k;
+                influence.boneId = (unsigned) _layout.boneId[b];
+                influence.weight = bone->mWeights[k].mWeight;
+            }
+        });
+
+        // Restores the original order within each vertex before keeping its strongest influences
+        runTasks(_pool, vertexChunkNum, [&](size_t _task) {
+            unsigned begin = (unsigned) _task * ASSEMBLY_CHUNK_SIZE;
+            unsigned end = std::min(vertexNum, begin + ASSEMBLY_CHUNK_SIZE);
+            for (unsigned v = begin; v < end; v++) {
+                Influence *first = influences.data() + influenceBegin[v];
+                Influence *last = influences.data() + influenceBegin[v + 1];
+                for (Influence *i = first + 1; i < last; i++) {
+                    Influence moved = *i;
+                    Influence *j = i;
+                    for (; j > first && (j - 1)->order > moved.order; j--) *j = *(j - 1);
+                    *j = moved;
+                }
+                for (Influence *i = first; i < last; i++)
+                    _vertices[v].addBone(i->boneId, i->weight);
+            }
+        });
+    }
+}
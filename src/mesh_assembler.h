@@ -0,0 +1,56 @@
+// Load-time Vertex and Index Assembly
+// Turns the meshes of an imported aiScene into one vertex and one index stream
+// in two passes: a serial plan that fixes every size and offset, then a fill
+// that writes straight into preallocated storage from many threads.
+//
+//     MeshAssembler::Layout layout;
+//     MeshAssembler::plan(scene, layout, nameBoneMap, boneOffset);
+//     vertices.resize(layout.vertexNum());
+//     indices.resize(layout.indexNum());
+//     MeshAssembler::assemble(scene, layout, vertices.data(), indices.data(), &pool);
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <assimp/scene.h>
+
+#include "parametric_vertex.h"
+#include "thread_pool.h"
+
+namespace MeshAssembler {
+    // Vertices, faces or vertex influences handled by one task of the fill
+    const unsigned ASSEMBLY_CHUNK_SIZE = 4096;
+
+    struct Layout {
+        // Per aiMesh, then the total as a last entry
+        std::vector<unsigned> vertexOffset;
+        std::vector<unsigned> indexOffset;
+        // Per aiMesh, then the total: where its bones start in boneId
+        std::vector<unsigned> meshBoneOffset;
+        // Per aiBone of every mesh: id in the scene's bone palette, -1 if its weights are not used
+        std::vector<int> boneId;
+
+        unsigned meshNum() const { return vertexOffset.empty() ? 0 : (unsigned) vertexOffset.size() - 1; }
+
+        unsigned vertexNum() const { return vertexOffset.empty() ? 0 : vertexOffset.back(); }
+
+        unsigned indexNum() const { return indexOffset.empty() ? 0 : indexOffset.back(); }
+    };
+
+    // First pass. Numbers the bones in order of first appearance into _nameBoneMap and appends
+    // their offset matrices to _boneOffset. Only the first mesh a bone appears in contributes
+    // its weights, as loading has always done.
+    void plan(const aiScene *_scene, Layout &_layout, std::map<std::string, unsigned> &_nameBoneMap,
+              std::vector<aiMatrix4x4> &_boneOffset);
+
+    // Second pass. Fills layout.vertexNum() vertices and layout.indexNum() triangle corner indices,
+    // mesh by mesh, with indices relative to their mesh. Any storage works, including a mapped
+    // buffer. Bone weights are gathered bone by bone into a per-vertex influence list and then
+    // added per vertex in their original order, so the result is the same on any thread count.
+    // A NULL _pool assembles on the calling thread.
+    void assemble(const aiScene *_scene, const Layout &_layout, SkeletalMesh::ParametricVertex *_vertices,
+                  unsigned *_indices, Parallel::ThreadPool *_pool = NULL);
+}
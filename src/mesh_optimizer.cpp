@@ -0,0 +1,160 @@
+#include "mesh_optimizer.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace MeshOptimizer {
+    namespace {
+        const size_t NO_TRIANGLE = (size_t) -1;
+
+        // Weights from Forsyth, "Linear-Speed Vertex Cache Optimisation"
+        const float CACHE_DECAY_POWER = 1.5f;
+        const float LAST_TRIANGLE_SCORE = 0.75f;
+        const float VALENCE_BOOST_SCALE = 2.0f;
+        const float VALENCE_BOOST_POWER = 0.5f;
+
+        float vertexScore(int cachePos, unsigned remaining) {
+            if (remaining == 0) return 0.0f;
+            float score = 0.0f;
+            if (cachePos >= 0) {
+                // The three vertices of the last triangle score the same, whichever order they went in
+                if (cachePos < 3) {
+                    score = LAST_TRIANGLE_SCORE;
+                } else {
+                    float scaler = 1.0f / (OPTIMIZE_CACHE_SIZE - 3);
+                    score = std::pow(1.0f - (cachePos - 3) * scaler, CACHE_DECAY_POWER);
+                }
+            }
+            // Vertices with few triangles left are finished first so they can leave the cache
+            return score + VALENCE_BOOST_SCALE * std::pow((float) remaining, -VALENCE_BOOST_POWER);
+        }
+    }
+
+    CacheStats analyzeVertexCache(const unsigned *indices, size_t indexNum, size_t vertexNum, unsigned cacheSize) {
+        CacheStats stats = {0.0f, 0.0f};
+        if (indexNum < 3 || vertexNum == 0) return stats;
+
+        // A vertex is in the FIFO while fewer than cacheSize misses happened after its own
+        std::vector<size_t> missTime(vertexNum, 0);
+        std::vector<char> referenced(vertexNum, 0);
+        size_t time = cacheSize + 1;
+        size_t misses = 0, unique = 0;
+        for (size_t i = 0; i < indexNum; i++) {
+            unsigned v = indices[i];
+            if (time - missTime[v] > cacheSize) {
+                missTime[v] = time++;
+                misses++;
+            }
+            if (!referenced[v]) {
+                referenced[v] = 1;
+                unique++;
+            }
+        }
+        stats.acmr = (float) misses / (float) (indexNum / 3);
+        stats.atvr = (float) misses / (float) unique;
+        return stats;
+    }
+
+    void optimizeVertexCache(unsigned *indices, size_t indexNum, size_t vertexNum) {
+        size_t triangleNum = indexNum / 3;
+        if (triangleNum == 0) return;
+
+        // Triangles around each vertex in CSR form, the live ones are the first remaining[v]
+        std::vector<unsigned> adjacencyBegin(vertexNum + 1, 0);
+        for (size_t i = 0; i < triangleNum * 3; i++)
+            adjacencyBegin[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexNum; v++)
+            adjacencyBegin[v + 1] += adjacencyBegin[v];
+        std::vector<unsigned> adjacency(triangleNum * 3);
+        std::vector<unsigned> remaining(vertexNum, 0);
+        for (size_t t = 0; t < triangleNum; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned v = indices[t * 3 + k];
+                adjacency[adjacencyBegin[v] + remaining[v]++] = (unsigned) t;
+            }
+        }
+
+        std::vector<int> cachePos(vertexNum, -1);
+        std::vector<float> score(vertexNum);
+        for (size_t v = 0; v < vertexNum; v++)
+            score[v] = vertexScore(-1, remaining[v]);
+        std::vector<float> triangleScore(triangleNum);
+        std::vector<char> emitted(triangleNum, 0);
+        size_t best = 0;
+        for (size_t t = 0; t < triangleNum; t++) {
+            triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+            if (triangleScore[t] > triangleScore[best]) best = t;
+        }
+
+        std::vector<unsigned> output(triangleNum * 3);
+        unsigned cache[OPTIMIZE_CACHE_SIZE + 3];
+        unsigned cacheNum = 0;
+        size_t scan = 0;
+        for (size_t out = 0; out < triangleNum; out++) {
+            if (best == NO_TRIANGLE) {
+                // Nothing in the cache touches a live triangle, continue with the next one in input order
+                while (emitted[scan]) scan++;
+                best = scan;
+            }
+            emitted[best] = 1;
+            const unsigned *triangle = indices + best * 3;
+            unsigned nextCache[OPTIMIZE_CACHE_SIZE + 3];
+            unsigned nextNum = 0;
+            for (int k = 0; k < 3; k++) {
+                unsigned v = triangle[k];
+                output[out * 3 + k] = v;
+                unsigned *live = adjacency.data() + adjacencyBegin[v];
+                unsigned *found = std::find(live, live + remaining[v], (unsigned) best);
+                *found = live[--remaining[v]];
+                if (std::find(nextCache, nextCache + nextNum, v) == nextCache + nextNum)
+                    nextCache[nextNum++] = v;
+            }
+            for (unsigned i = 0; i < cacheNum; i++) {
+                unsigned v = cache[i];
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                    nextCache[nextNum++] = v;
+            }
+
+            // Vertices pushed past the end leave the cache but still need their score lowered
+            for (unsigned i = 0; i < nextNum; i++) {
+                unsigned v = nextCache[i];
+                cachePos[v] = i < OPTIMIZE_CACHE_SIZE ? (int) i : -1;
+                score[v] = vertexScore(cachePos[v], remaining[v]);
+            }
+            best = NO_TRIANGLE;
+            float bestScore = -1.0f;
+            for (unsigned i = 0; i < nextNum; i++) {
+                unsigned v = nextCache[i];
+                const unsigned *live = adjacency.data() + adjacencyBegin[v];
+                for (unsigned j = 0; j < remaining[v]; j++) {
+                    unsigned t = live[j];
+                    triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                    if (triangleScore[t] > bestScore) {
+                        bestScore = triangleScore[t];
+                        best = t;
+                    }
+                }
+            }
+
+            cacheNum = std::min(nextNum, OPTIMIZE_CACHE_SIZE);
+            std::copy(nextCache, nextCache + cacheNum, cache);
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    void optimizeVertexFetch(unsigned *indices, size_t indexNum, size_t vertexNum, unsigned *remap) {
+        const unsigned UNASSIGNED = (unsigned) -1;
+        std::fill(remap, remap + vertexNum, UNASSIGNED);
+        unsigned next = 0;
+        for (size_t i = 0; i < indexNum; i++) {
+            unsigned &target = remap[indices[i]];
+            if (target == UNASSIGNED) target = next++;
+            indices[i] = target;
+        }
+        for (size_t v = 0; v < vertexNum; v++) {
+            if (remap[v] == UNASSIGNED) remap[v] = next++;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+// Load-time Mesh Optimization
+// Triangle order for the post-transform vertex cache (Forsyth's linear-speed
+// algorithm) and vertex order for fetch locality, with cache statistics to
+// compare the two.
+
+#pragma once
+
+#include <cstddef>
+
+namespace MeshOptimizer {
+    // Size of the LRU cache the triangle order is scored against
+    const unsigned OPTIMIZE_CACHE_SIZE = 32;
+
+    // Size of the FIFO cache the statistics are measured with
+    const unsigned ANALYZE_CACHE_SIZE = 16;
+
+    struct CacheStats {
+        // Average cache miss ratio, transformed vertices per triangle (0.5 .. 3)
+        float acmr;
+        // Average transform to vertex ratio, transformed vertices per referenced vertex (1 ..)
+        float atvr;
+    };
+
+    CacheStats analyzeVertexCache(const unsigned *indices, size_t indexNum, size_t vertexNum,
+                                  unsigned cacheSize = ANALYZE_CACHE_SIZE);
+
+    // Reorders the triangles of indices in place, vertex ids stay the same
+    void optimizeVertexCache(unsigned *indices, size_t indexNum, size_t vertexNum);
+
+    // Renumbers vertices in order of first use and rewrites indices to match.
+    // remap receives vertexNum entries, vertex v moves to remap[v]; unreferenced
+    // vertices go last in their original order.
+    void optimizeVertexFetch(unsigned *indices, size_t indexNum, size_t vertexNum, unsigned *remap);
+}
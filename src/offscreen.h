@@ -0,0 +1,260 @@
+// Offscreen Rendering
+// Frames are drawn into a framebuffer object instead of a window and read back
+// through a ring of pixel buffer objects: glReadPixels into a PBO returns at
+// once, the copy runs on the GPU while the next frames are drawn, and a PBO is
+// only mapped when the ring comes around to it again, fenced so the map rarely
+// waits. With EGL, the context needs no window or display at all and runs on
+// Mesa's software rasterizer as well.
+//
+//     Offscreen::HeadlessContext context;   context.create();   glewInit();
+//     Offscreen::RenderTarget target;       target.create(800, 800);
+//     Offscreen::FrameReadback readback(800, 800, onFrame);
+//     per frame: target.bind(); draw ...; readback.capture(frame);
+//     at the end: readback.flush();
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gl_env.h"
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace Offscreen {
+    // Frames in flight between glReadPixels and the map that hands them on
+    const unsigned int READBACK_RING_SIZE = 3;
+
+#ifdef HEADLESS_EGL
+    // An OpenGL 3.3 core context without any surface. Prefers Mesa's surfaceless platform,
+    // which needs no display server, and falls back to the default display.
+    class HeadlessContext {
+    public:
+        HeadlessContext() : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT) {}
+
+        ~HeadlessContext() { destroy(); }
+
+        bool create() {
+            destroy();
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                    (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+            if (getPlatformDisplay)
+                display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+            if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            EGLint major, minor;
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+                display = EGL_NO_DISPLAY;
+                return false;
+            }
+            if (!eglBindAPI(EGL_OPENGL_API)) {
+                destroy();
+                return false;
+            }
+
+            // Surfaceless contexts need no config where EGL_KHR_no_config_context is supported
+            const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+            EGLConfig config = NULL;
+            EGLint configNum = 0;
+            eglChooseConfig(display, configAttributes, &config, 1, &configNum);
+            const EGLint contextAttributes[] = {
+                    EGL_CONTEXT_MAJOR_VERSION, 3,
+                    EGL_CONTEXT_MINOR_VERSION, 3,
+                    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                    EGL_NONE};
+            context = eglCreateContext(display, configNum ? config : (EGLConfig) 0, EGL_NO_CONTEXT,
+                                       contextAttributes);
+            if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+                destroy();
+                return false;
+            }
+            return true;
+        }
+
+        void destroy() {
+            if (display == EGL_NO_DISPLAY) return;
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+            context = EGL_NO_CONTEXT;
+        }
+
+    private:
+        EGLDisplay display;
+        EGLContext context;
+
+        HeadlessContext(const HeadlessContext &);
+
+        HeadlessContext &operator=(const HeadlessContext &);
+    };
+#endif
+
+    // An RGBA8 color and 24-bit depth framebuffer of a fixed size
+    class RenderTarget {
+    public:
+        RenderTarget() : framebuffer(0), color(0), depth(0), width(0), height(0) {}
+
+        ~RenderTarget() { destroy(); }
+
+        bool create(int _width, int _height) {
+            destroy();
+            width = _width;
+            height = _height;
+            glGenRenderbuffers(1, &color);
+            glBindRenderbuffer(GL_RENDERBUFFER, color);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+            glGenRenderbuffers(1, &depth);
+            glBindRenderbuffer(GL_RENDERBUFFER, depth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+            bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            if (!complete) destroy();
+            return complete;
+        }
+
+        void destroy() {
+            if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+            if (color) glDeleteRenderbuffers(1, &color);
+            if (depth) glDeleteRenderbuffers(1, &depth);
+            framebuffer = color = depth = 0;
+        }
+
+        // Draws and reads go to the target until another framebuffer is bound
+        void bind() const {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, width, height);
+        }
+
+        int getWidth() const { return width; }
+
+        int getHeight() const { return height; }
+
+    private:
+        GLuint framebuffer;
+        GLuint color;
+        GLuint depth;
+        int width;
+        int height;
+
+        RenderTarget(const RenderTarget &);
+
+        RenderTarget &operator=(const RenderTarget &);
+    };
+
+    // Reads frames of the bound read framebuffer back through a ring of PBOs. Frames reach the
+    // callback in capture order, READBACK_RING_SIZE captures late, as tightly packed RGBA rows
+    // from the bottom up. The pixels are only valid during the call.
+    class FrameReadback {
+    public:
+        typedef std::function<void(uint64_t frame, const unsigned char *rgba)> Callback;
+
+        struct Stats {
+            uint64_t capturedFrames;
+            uint64_t deliveredFrames;
+            // Maps whose copy had not finished yet, the render thread waited for the GPU
+            uint64_t stalls;
+            double stallSeconds;
+        };
+
+        FrameReadback(int _width, int _height, const Callback &_callback,
+                      unsigned int _ringSize = READBACK_RING_SIZE)
+                : width(_width), height(_height), callback(_callback), slots(_ringSize ? _ringSize : 1),
+                  next(0) {
+            stats.capturedFrames = stats.deliveredFrames = stats.stalls = 0;
+            stats.stallSeconds = 0.0;
+            for (size_t i = 0; i < slots.size(); i++) {
+                glGenBuffers(1, &slots[i].buffer);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].buffer);
+                glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes(), NULL, GL_STREAM_READ);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        ~FrameReadback() {
+            for (size_t i = 0; i < slots.size(); i++) {
+                if (slots[i].fence) glDeleteSync(slots[i].fence);
+                glDeleteBuffers(1, &slots[i].buffer);
+            }
+        }
+
+        size_t frameBytes() const { return (size_t) width * height * 4; }
+
+        // Starts copying the current frame, first handing on the frame that last used the slot
+        void capture(uint64_t _frame) {
+            Slot &slot = slots[next];
+            if (slot.fence) deliver(slot);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            slot.frame = _frame;
+            next = (next + 1) % slots.size();
+            stats.capturedFrames++;
+        }
+
+        // Hands on every frame still in flight
+        void flush() {
+            for (size_t i = 0; i < slots.size(); i++) {
+                Slot &slot = slots[(next + i) % slots.size()];
+                if (slot.fence) deliver(slot);
+            }
+        }
+
+        const Stats &getStats() const { return stats; }
+
+    private:
+        struct Slot {
+            GLuint buffer;
+            GLsync fence;
+            uint64_t frame;
+
+            Slot() : buffer(0), fence(0), frame(0) {}
+        };
+
+        int width;
+        int height;
+        Callback callback;
+        std::vector<Slot> slots;
+        size_t next;
+        Stats stats;
+
+        void deliver(Slot &_slot) {
+            if (glClientWaitSync(_slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                stats.stalls++;
+                while (glClientWaitSync(_slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+                stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            }
+            glDeleteSync(_slot.fence);
+            _slot.fence = 0;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, _slot.buffer);
+            const unsigned char *pixels =
+                    (const unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes(), GL_MAP_READ_BIT);
+            if (pixels) {
+                callback(_slot.frame, pixels);
+                stats.deliveredFrames++;
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        FrameReadback(const FrameReadback &);
+
+        FrameReadback &operator=(const FrameReadback &);
+    };
+}
@@ -0,0 +1,239 @@
+// Quantized Skinned Vertex Layout
+// 32 bytes per vertex instead of the 64 of ParametricVertex:
+//     position   3 x float32
+//     normal     2 x snorm16, octahedral encoded
+//     texcoord   2 x float16
+//     bones      4 x uint8 indices + 4 x unorm16 weights, or, for rigs with more
+//                than 256 bones, 4 x uint16 indices + 4 x unorm8 weights
+// Quantized weights always sum to exactly one.
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "parametric_vertex.h"
+
+namespace SkeletalMesh {
+    enum VertexFormat {
+        VERTEX_FORMAT_FLOAT = 0,
+        VERTEX_FORMAT_PACKED
+    };
+
+    // Index width of the bone data in a PackedVertex, chosen per scene from its bone count
+    enum PackedBoneLayout {
+        PACKED_BONE_INDEX8_WEIGHT16 = 0,
+        PACKED_BONE_INDEX16_WEIGHT8
+    };
+
+    // Packed normals arrive in in_normal.xy, shaders that use them decode with this
+    static const char *const packed_normal_decode_glsl =
+            "vec3 decode_normal(vec2 e) {\n"
+            "    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+            "    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+            "    return normalize(n);\n"
+            "}\n";
+
+    struct PackedVertex {
+        float position[3];
+        int16_t normal[2];
+        uint16_t texcoord[2];
+        uint8_t bone[12];
+
+        // Byte offsets of the bone indices and weights inside bone[]
+        static size_t boneIdOffset(PackedBoneLayout) { return 0; }
+
+        static size_t boneWeightOffset(PackedBoneLayout _layout) {
+            return _layout == PACKED_BONE_INDEX8_WEIGHT16 ? 4 : 8;
+        }
+    };
+
+    struct VertexPackReport {
+        size_t floatBytes;
+        size_t packedBytes;
+        float maxNormalErrorDegrees;
+        float maxTexcoordError;
+        float maxWeightError;
+        // Vertices whose bone ids did not fit the index width and were clamped
+        size_t clampedBoneIds;
+
+        VertexPackReport()
+                : floatBytes(0), packedBytes(0), maxNormalErrorDegrees(0.0f),
+                  maxTexcoordError(0.0f), maxWeightError(0.0f), clampedBoneIds(0) {}
+    };
+
+    namespace VertexPacking {
+        inline uint16_t floatToHalf(float _f) {
+            uint32_t bits;
+            memcpy(&bits, &_f, sizeof(bits));
+            uint32_t sign = (bits >> 16) & 0x8000u;
+            int32_t exponent = (int32_t) ((bits >> 23) & 0xffu) - 127 + 15;
+            uint32_t mantissa = bits & 0x7fffffu;
+            if (((bits >> 23) & 0xffu) == 0xffu)                 // inf, nan
+                return (uint16_t) (sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+            if (exponent >= 31) return (uint16_t) (sign | 0x7c00u);
+            if (exponent <= 0) {                                 // subnormal or zero
+                if (exponent < -10) return (uint16_t) sign;
+                mantissa |= 0x800000u;
+                uint32_t shift = (uint32_t) (14 - exponent);
+                uint32_t half = mantissa >> shift;
+                uint32_t rest = mantissa & ((1u << shift) - 1u);
+                uint32_t halfway = 1u << (shift - 1u);
+                if (rest > halfway || (rest == halfway && (half & 1u))) half++;
+                return (uint16_t) (sign | half);
+            }
+            uint32_t half = sign | ((uint32_t) exponent << 10) | (mantissa >> 13);
+            uint32_t rest = mantissa & 0x1fffu;
+            // Round to nearest even, a carry into the exponent is still correct
+            if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) half++;
+            return (uint16_t) half;
+        }
+
+        inline float halfToFloat(uint16_t _h) {
+            uint32_t sign = ((uint32_t) _h & 0x8000u) << 16;
+            uint32_t exponent = ((uint32_t) _h >> 10) & 0x1fu;
+            uint32_t mantissa = (uint32_t) _h & 0x3ffu;
+            uint32_t bits;
+            if (exponent == 0) {
+                if (mantissa == 0) {
+                    bits = sign;
+                } else {
+                    exponent = 127 - 15 + 1;
+                    while (!(mantissa & 0x400u)) {
+                        mantissa <<= 1;
+                        exponent--;
+                    }
+                    bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+                }
+            } else if (exponent == 31) {
+                bits = sign | 0x7f800000u | (mantissa << 13);
+            } else {
+                bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+            }
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            return f;
+        }
+
+        inline int16_t toSnorm16(float _f) {
+            return (int16_t) std::lround(std::max(-1.0f, std::min(1.0f, _f)) * 32767.0f);
+        }
+
+        inline void encodeOctahedral(const float _n[3], int16_t _out[2]) {
+            float l1 = std::fabs(_n[0]) + std::fabs(_n[1]) + std::fabs(_n[2]);
+            if (l1 <= 0.0f) {
+                _out[0] = _out[1] = 0;
+                return;
+            }
+            float x = _n[0] / l1, y = _n[1] / l1;
+            if (_n[2] < 0.0f) {
+                // Fold the lower hemisphere over the diagonals
+                float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = fx;
+                y = fy;
+            }
+            _out[0] = toSnorm16(x);
+            _out[1] = toSnorm16(y);
+        }
+
+        inline void decodeOctahedral(const int16_t _in[2], float _out[3]) {
+            float x = std::max(-1.0f, _in[0] / 32767.0f), y = std::max(-1.0f, _in[1] / 32767.0f);
+            float z = 1.0f - std::fabs(x) - std::fabs(y);
+            if (z < 0.0f) {
+                float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = fx;
+                y = fy;
+            }
+            float length = std::sqrt(x * x + y * y + z * z);
+            _out[0] = x / length;
+            _out[1] = y / length;
+            _out[2] = z / length;
+        }
+
+        // Quantizes weights normalized to sum one into _levels steps, rounding so the
+        // quantized values also sum to _levels exactly (largest remainder first)
+        inline void quantizeWeights(const float _w[SCENE_RESOURCE_BONE_PER_VERTEX], unsigned _levels,
+                                    unsigned _out[SCENE_RESOURCE_BONE_PER_VERTEX]) {
+            float sum = 0.0f;
+            for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) sum += _w[i];
+            if (sum <= 0.0f) {
+                for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) _out[i] = 0;
+                return;
+            }
+            float remainder[SCENE_RESOURCE_BONE_PER_VERTEX];
+            unsigned total = 0;
+            for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
+                float scaled = _w[i] / sum * _levels;
+                _out[i] = (unsigned) scaled;
+                remainder[i] = scaled - _out[i];
+                total += _out[i];
+            }
+            while (total < _levels) {
+                int best = 0;
+                for (int i = 1; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++)
+                    if (remainder[i] > remainder[best]) best = i;
+                _out[best]++;
+                remainder[best] = -1.0f;
+                total++;
+            }
+        }
+
+        inline void pack(const ParametricVertex &_v, PackedBoneLayout _layout, PackedVertex &_out,
+                         VertexPackReport &_report) {
+            memcpy(_out.position, _v.position, sizeof(_out.position));
+
+            encodeOctahedral(_v.normal, _out.normal);
+            float decoded[3];
+            decodeOctahedral(_out.normal, decoded);
+            float length = std::sqrt(_v.normal[0] * _v.normal[0] + _v.normal[1] * _v.normal[1] +
+                                     _v.normal[2] * _v.normal[2]);
+            if (length > 0.0f) {
+                float cosine = (decoded[0] * _v.normal[0] + decoded[1] * _v.normal[1] +
+                                decoded[2] * _v.normal[2]) / length;
+                float degrees = std::acos(std::max(-1.0f, std::min(1.0f, cosine))) * 57.29577951f;
+                _report.maxNormalErrorDegrees = std::max(_report.maxNormalErrorDegrees, degrees);
+            }
+
+            for (int i = 0; i < 2; i++) {
+                _out.texcoord[i] = floatToHalf(_v.texcoord[i]);
+                _report.maxTexcoordError = std::max(_report.maxTexcoordError,
+                                                    std::fabs(halfToFloat(_out.texcoord[i]) - _v.texcoord[i]));
+            }
+
+            unsigned levels = _layout == PACKED_BONE_INDEX8_WEIGHT16 ? 65535u : 255u;
+            unsigned maxId = _layout == PACKED_BONE_INDEX8_WEIGHT16 ? 255u : 65535u;
+            unsigned weight[SCENE_RESOURCE_BONE_PER_VERTEX];
+            quantizeWeights(_v.boneWeight, levels, weight);
+            float sum = 0.0f;
+            for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) sum += _v.boneWeight[i];
+            bool clamped = false;
+            uint8_t *ids = _out.bone + PackedVertex::boneIdOffset(_layout);
+            uint8_t *weights = _out.bone + PackedVertex::boneWeightOffset(_layout);
+            for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
+                unsigned id = _v.boneId[i];
+                if (id > maxId) {
+                    id = maxId;
+                    clamped = true;
+                }
+                if (_layout == PACKED_BONE_INDEX8_WEIGHT16) {
+                    ids[i] = (uint8_t) id;
+                    uint16_t w = (uint16_t) weight[i];
+                    memcpy(weights + i * 2, &w, sizeof(w));
+                } else {
+                    uint16_t id16 = (uint16_t) id;
+                    memcpy(ids + i * 2, &id16, sizeof(id16));
+                    weights[i] = (uint8_t) weight[i];
+                }
+                if (sum > 0.0f) {
+                    _report.maxWeightError = std::max(_report.maxWeightError,
+                                                      std::fabs((float) weight[i] / levels - _v.boneWeight[i] / sum));
+                }
+            }
+            if (clamped) _report.clampedBoneIds++;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+// Skinned Vertex Layout
+// Shared by the GL upload path and the CPU consumers of the vertex stream.
+
+#pragma once
+
+#include <cstring>
+
+#include <assimp/vector2.h>
+#include <assimp/vector3.h>
+
+#define SCENE_RESOURCE_BONE_PER_VERTEX 4
+
+namespace SkeletalMesh {
+    struct ParametricVertex {
+        float position[3];
+        float texcoord[2];
+        float normal[3];
+        unsigned int boneId[SCENE_RESOURCE_BONE_PER_VERTEX];
+        float boneWeight[SCENE_RESOURCE_BONE_PER_VERTEX];
+
+        ParametricVertex() { memset(this, 0, sizeof(ParametricVertex)); }
+
+        ParametricVertex(aiVector3D _p, aiVector2D _tc, aiVector3D _n) {
+            memcpy(position, &_p, sizeof(position));
+            memcpy(texcoord, &_tc, sizeof(texcoord));
+            memcpy(normal, &_n, sizeof(normal));
+            memset(boneId, 0, sizeof(boneId));
+            memset(boneWeight, 0, sizeof(boneWeight));
+        }
+
+        bool addBone(unsigned int _id, float _weight) {
+            if (_weight < 1e-6) return false;
+            int minWeightIndex = 0;
+            for (int i = 1; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
+                if (boneWeight[i] < boneWeight[minWeightIndex])
+                    minWeightIndex = i;
+            }
+            if (boneWeight[minWeightIndex] < _weight) {
+                boneId[minWeightIndex] = _id;
+                boneWeight[minWeightIndex] = _weight;
+                return true;
+            }
+            return false;
+        }
+    };
+}
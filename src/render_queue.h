@@ -0,0 +1,154 @@
+// Render Queue
+// Collects the draws of a frame and submits them sorted by program, vertex array
+// and diffuse texture, so each piece of state is bound once per run instead of
+// once per mesh. Consecutive draws that end up sharing all of their state go out
+// as a single glMultiDrawElementsBaseVertex. Draws are opaque, only their order
+// within a run of equal state is kept.
+//
+//     SkeletalMesh::RenderQueue queue;
+//     per frame: scene.submit(queue, program); ...; queue.flush();
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "gl_env.h"
+#include "texture_image.h"
+
+namespace SkeletalMesh {
+    class RenderQueue {
+    public:
+        struct DrawItem {
+            GLuint program;
+            GLuint vao;
+            // NULL draws with texture 0 bound
+            const TextureImage::Texture *diffuse;
+            GLenum diffuseChannel;
+            GLenum indexType;
+            GLsizei indexNum;
+            size_t indexByteOffset;
+            GLint baseVertex;
+            // 0 for a plain draw, otherwise drawn instanced
+            GLsizei instanceNum;
+        };
+
+        // Per flush, of the submission as it was queued, drawn one by one and binding the texture
+        // of every mesh like Scene::render, and as actually issued
+        struct Stats {
+            size_t itemNum;
+            size_t unsortedDraws;
+            size_t unsortedStateChanges;
+            size_t draws;
+            size_t stateChanges;
+        };
+
+        RenderQueue() { memset(&stats, 0, sizeof(stats)); }
+
+        void submit(const DrawItem &_item) { items.push_back(_item); }
+
+        size_t size() const { return items.size(); }
+
+        // Issues and clears every queued draw. Leaves the last program and vertex array bound.
+        void flush() {
+            memset(&stats, 0, sizeof(stats));
+            stats.itemNum = items.size();
+            countUnsorted();
+
+            order.resize(items.size());
+            for (size_t i = 0; i < order.size(); i++) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+                return stateLess(items[a], items[b]);
+            });
+
+            const DrawItem *bound = NULL;
+            size_t run = 0;
+            while (run < order.size()) {
+                const DrawItem &item = items[order[run]];
+                size_t end = run + 1;
+                if (!item.instanceNum) {
+                    while (end < order.size() && !items[order[end]].instanceNum &&
+                           sameState(items[order[end]], item))
+                        end++;
+                }
+
+                if (!bound || bound->program != item.program) {
+                    glUseProgram(item.program);
+                    stats.stateChanges++;
+                }
+                if (!bound || bound->vao != item.vao) {
+                    glBindVertexArray(item.vao);
+                    stats.stateChanges++;
+                }
+                if (!bound || bound->diffuse != item.diffuse || bound->diffuseChannel != item.diffuseChannel) {
+                    if (!item.diffuse || !item.diffuse->bind(item.diffuseChannel)) {
+                        glActiveTexture(GL_TEXTURE0 + item.diffuseChannel);
+                        glBindTexture(GL_TEXTURE_2D, 0);
+                    }
+                    stats.stateChanges++;
+                }
+                bound = &item;
+
+                if (item.instanceNum) {
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.indexNum, item.indexType,
+                                                      (const void *) item.indexByteOffset, item.instanceNum,
+                                                      item.baseVertex);
+                } else if (end - run == 1) {
+                    glDrawElementsBaseVertex(GL_TRIANGLES, item.indexNum, item.indexType,
+                                             (const void *) item.indexByteOffset, item.baseVertex);
+                } else {
+                    counts.clear();
+                    offsets.clear();
+                    baseVertices.clear();
+                    for (size_t i = run; i < end; i++) {
+                        counts.push_back(items[order[i]].indexNum);
+                        offsets.push_back((const void *) items[order[i]].indexByteOffset);
+                        baseVertices.push_back(items[order[i]].baseVertex);
+                    }
+                    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), item.indexType, offsets.data(),
+                                                  (GLsizei) counts.size(), baseVertices.data());
+                }
+                stats.draws++;
+                run = end;
+            }
+            glActiveTexture(GL_TEXTURE0);
+            items.clear();
+        }
+
+        const Stats &getStats() const { return stats; }
+
+    private:
+        std::vector<DrawItem> items;
+        std::vector<size_t> order;
+        std::vector<GLsizei> counts;
+        std::vector<const void *> offsets;
+        std::vector<GLint> baseVertices;
+        Stats stats;
+
+        static bool stateLess(const DrawItem &_a, const DrawItem &_b) {
+            if (_a.program != _b.program) return _a.program < _b.program;
+            if (_a.vao != _b.vao) return _a.vao < _b.vao;
+            if (_a.diffuse != _b.diffuse) return std::less<const TextureImage::Texture *>()(_a.diffuse, _b.diffuse);
+            if (_a.diffuseChannel != _b.diffuseChannel) return _a.diffuseChannel < _b.diffuseChannel;
+            return _a.indexType < _b.indexType;
+        }
+
+        static bool sameState(const DrawItem &_a, const DrawItem &_b) {
+            return _a.program == _b.program && _a.vao == _b.vao && _a.diffuse == _b.diffuse &&
+                   _a.diffuseChannel == _b.diffuseChannel && _a.indexType == _b.indexType;
+        }
+
+        // Program and vertex array once per change, the texture for every draw
+        void countUnsorted() {
+            for (size_t i = 0; i < items.size(); i++) {
+                if (i == 0 || items[i].program != items[i - 1].program) stats.unsortedStateChanges++;
+                if (i == 0 || items[i].vao != items[i - 1].vao) stats.unsortedStateChanges++;
+                stats.unsortedStateChanges++;
+                stats.unsortedDraws++;
+            }
+        }
+    };
+}
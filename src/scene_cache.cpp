@@ -0,0 +1,179 @@
+#include "scene_cache.h"
+
+#include <cstdio>
+
+namespace SceneCache {
+    namespace {
+        const char MAGIC[8] = {'S', 'K', 'M', 'S', 'C', 'E', 'N', 'E'};
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t sectionNum;
+            uint64_t key;
+            uint64_t payloadHash;
+            uint64_t fileSize;
+            uint64_t reserved;
+        };
+
+        struct SectionEntry {
+            uint32_t id;
+            uint32_t reserved;
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        size_t alignUp(size_t _value) {
+            return (_value + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        }
+
+        inline uint64_t mix(uint64_t _h) {
+            _h ^= _h >> 33;
+            _h *= 0xff51afd7ed558ccdULL;
+            _h ^= _h >> 33;
+            _h *= 0xc4ceb9fe1a85ec53ULL;
+            _h ^= _h >> 33;
+            return _h;
+        }
+    }
+
+    // FNV-1a over 64 bit words with a final avalanche, quick enough to rehash a source asset on every start
+    uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+        const uint64_t PRIME = 0x100000001b3ULL;
+        const unsigned char *bytes = (const unsigned char *) data;
+        uint64_t h = 0xcbf29ce484222325ULL ^ mix(seed + 1);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            h = (h ^ word) * PRIME;
+            h ^= h >> 29;
+        }
+        for (; i < size; i++)
+            h = (h ^ bytes[i]) * PRIME;
+        return mix(h ^ (uint64_t) size);
+    }
+
+    bool hashFile(const std::string &path, uint64_t seed, uint64_t &hash) {
+        FileMapping::MappedFile file;
+        if (!file.open(path)) return false;
+        hash = hashBytes(file.data(), file.size(), seed);
+        return true;
+    }
+
+    void Writer::add(uint32_t id, const void *data, size_t size) {
+        Pending section;
+        section.id = id;
+        section.bytes.assign((const unsigned char *) data, (const unsigned char *) data + size);
+        sections.push_back(section);
+    }
+
+    void Writer::addStrings(uint32_t id, const std::vector<std::string> &values) {
+        Pending section;
+        section.id = id;
+        for (size_t i = 0; i < values.size(); i++) {
+            uint32_t length = (uint32_t) values[i].size();
+            const unsigned char *lengthBytes = (const unsigned char *) &length;
+            section.bytes.insert(section.bytes.end(), lengthBytes, lengthBytes + sizeof(length));
+            section.bytes.insert(section.bytes.end(), values[i].begin(), values[i].end());
+        }
+        sections.push_back(section);
+    }
+
+    bool Writer::save(const std::string &path, uint64_t key) const {
+        std::vector<unsigned char> payload(sizeof(SectionEntry) * sections.size());
+        for (size_t i = 0; i < sections.size(); i++) {
+            // Offsets are from the start of the file
+            size_t offset = alignUp(sizeof(Header) + payload.size());
+            payload.resize(offset - sizeof(Header));
+            SectionEntry entry = {sections[i].id, 0, offset, sections[i].bytes.size()};
+            memcpy(payload.data() + sizeof(SectionEntry) * i, &entry, sizeof(entry));
+            payload.insert(payload.end(), sections[i].bytes.begin(), sections[i].bytes.end());
+        }
+
+        Header header;
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = CACHE_VERSION;
+        header.sectionNum = (uint32_t) sections.size();
+        header.key = key;
+        header.payloadHash = hashBytes(payload.data(), payload.size());
+        header.fileSize = sizeof(Header) + payload.size();
+        header.reserved = 0;
+
+        std::string temporary = path + ".tmp";
+        FILE *fo = fopen(temporary.c_str(), "wb");
+        if (fo == NULL) return false;
+        bool written = fwrite(&header, sizeof(header), 1, fo) == 1 &&
+                       (payload.empty() || fwrite(payload.data(), payload.size(), 1, fo) == 1);
+        written = fclose(fo) == 0 && written;
+        if (!written) {
+            remove(temporary.c_str());
+            return false;
+        }
+        // rename() does not replace an existing file everywhere
+        remove(path.c_str());
+        return rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    bool Reader::open(const std::string &path, uint64_t key) {
+        close();
+        if (!file.open(path)) return false;
+
+        const unsigned char *bytes = file.data();
+        size_t size = file.size();
+        Header header;
+        bool valid = size >= sizeof(Header);
+        if (valid) {
+            memcpy(&header, bytes, sizeof(header));
+            valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == CACHE_VERSION &&
+                    header.key == key && header.fileSize == size &&
+                    (size - sizeof(Header)) / sizeof(SectionEntry) >= header.sectionNum;
+        }
+        if (valid)
+            valid = hashBytes(bytes + sizeof(Header), size - sizeof(Header)) == header.payloadHash;
+        if (valid) {
+            table = (const Section *) (bytes + sizeof(Header));
+            sectionNum = header.sectionNum;
+            for (uint32_t i = 0; i < sectionNum && valid; i++)
+                valid = table[i].offset <= size && table[i].size <= size - table[i].offset;
+        }
+        if (!valid) close();
+        return valid;
+    }
+
+    void Reader::close() {
+        file.close();
+        table = NULL;
+        sectionNum = 0;
+    }
+
+    bool Reader::get(uint32_t id, const void *&data, size_t &size) const {
+        for (uint32_t i = 0; i < sectionNum; i++) {
+            if (table[i].id == id) {
+                data = file.data() + table[i].offset;
+                size = (size_t) table[i].size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Reader::getStrings(uint32_t id, std::vector<std::string> &values) const {
+        const void *data;
+        size_t size;
+        if (!get(id, data, size)) return false;
+        const unsigned char *bytes = (const unsigned char *) data;
+        values.clear();
+        size_t position = 0;
+        while (position < size) {
+            uint32_t length;
+            if (size - position < sizeof(length)) return false;
+            memcpy(&length, bytes + position, sizeof(length));
+            position += sizeof(length);
+            if (size - position < length) return false;
+            values.push_back(std::string((const char *) bytes + position, length));
+            position += length;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,93 @@
+// Baked Scene Cache Container
+// A versioned file of 16-byte aligned binary sections, keyed by a hash of the
+// source asset and the options it was imported with. Readers map the file and
+// hand out pointers into the mapping, nothing is parsed or copied.
+//
+// Layout:
+//     Header                                   magic, version, key, payload hash
+//     Section[sectionNum]                      id, offset, size
+//     section data ...                         each at a multiple of 16 bytes
+// The payload hash covers everything after the header, so a truncated or
+// damaged file is rejected instead of loaded.
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace SceneCache {
+    // Bump whenever the layout of any stored structure changes
+    const uint32_t CACHE_VERSION = 1;
+
+    const size_t SECTION_ALIGNMENT = 16;
+
+    uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+    // Hash of the content of a file, false if it can not be read
+    bool hashFile(const std::string &path, uint64_t seed, uint64_t &hash);
+
+    class Writer {
+    public:
+        void add(uint32_t id, const void *data, size_t size);
+
+        template<typename T>
+        void addVector(uint32_t id, const std::vector<T> &values) {
+            add(id, values.data(), sizeof(T) * values.size());
+        }
+
+        // Each string as a 32 bit length followed by its bytes
+        void addStrings(uint32_t id, const std::vector<std::string> &values);
+
+        // Written to a temporary file first, so readers never see a partial cache
+        bool save(const std::string &path, uint64_t key) const;
+
+    private:
+        struct Pending {
+            uint32_t id;
+            std::vector<unsigned char> bytes;
+        };
+
+        std::vector<Pending> sections;
+    };
+
+    class Reader {
+    public:
+        Reader() : table(NULL), sectionNum(0) {}
+
+        // False, with nothing mapped, if the file is missing, of another version or key, or damaged
+        bool open(const std::string &path, uint64_t key);
+
+        void close();
+
+        bool get(uint32_t id, const void *&data, size_t &size) const;
+
+        template<typename T>
+        bool getVector(uint32_t id, std::vector<T> &values) const {
+            const void *data;
+            size_t size;
+            if (!get(id, data, size) || size % sizeof(T) != 0) return false;
+            values.resize(size / sizeof(T));
+            if (size) memcpy(values.data(), data, size);
+            return true;
+        }
+
+        bool getStrings(uint32_t id, std::vector<std::string> &values) const;
+
+    private:
+        struct Section {
+            uint32_t id;
+            uint32_t reserved;
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        FileMapping::MappedFile file;
+        const Section *table;
+        uint32_t sectionNum;
+    };
+}
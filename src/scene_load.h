@@ -0,0 +1,189 @@
+// Asynchronous Scene Loading
+// Staging (cache lookup or import, assembly, texture decode or bake) runs on a
+// background JobQueue; the GL thread then uploads the result a slice at a time
+// within a per-frame time budget, so it can keep presenting frames meanwhile.
+//
+//     std::shared_ptr<SceneLoad> load = SceneLoad::start("Hand", path, options);
+//     while (load->update(0.004) != SceneLoad::LOAD_READY) { draw a frame ... }
+//     Scene &scene = load->getScene();
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "skeletal_mesh.h"
+#include "job_queue.h"
+
+namespace SkeletalMesh {
+    // Buffers are filled in slices of this size, the smallest unit the upload budget is checked at
+    const size_t SCENE_UPLOAD_CHUNK_BYTES = 256 * 1024;
+
+    class SceneLoad {
+    public:
+        enum State {
+            LOAD_STAGING = 0,
+            LOAD_UPLOADING,
+            LOAD_READY,
+            LOAD_FAILED
+        };
+
+        // Call on the GL thread. Resolves the file and registers the scene like Scene::loadScene,
+        // a scene that is already loaded the same way is ready right away. Assembly runs on the
+        // job itself unless a _pool is given; the shared pool serves the frame loop meanwhile.
+        static std::shared_ptr<SceneLoad> start(std::string _name, std::string _filename = std::string(),
+                                                const LoadOptions &_options = LoadOptions(),
+                                                Parallel::JobQueue &_queue = Parallel::JobQueue::shared(),
+                                                Parallel::ThreadPool *_pool = NULL) {
+            std::shared_ptr<SceneLoad> load(new SceneLoad());
+            if (_filename.empty() || _filename == "") _filename = Scene::testAllSuffix(_name);
+            if (_filename.empty()) {
+                load->state = LOAD_FAILED;
+                return load;
+            }
+
+            load->target = &Scene::reserve(_name, _filename, _options);
+            if (load->target->available) {
+                load->state = LOAD_READY;
+                return load;
+            }
+            load->staging.name = _name;
+            load->staging.filename = _filename;
+            load->staging.options = _options;
+            load->staging.pool = _pool;
+
+            Parallel::JobQueue *queue = &_queue;
+            _queue.submit([load, queue]() {
+                Scene::Staging &staging = load->staging;
+                if (!Scene::stage(staging, &load->stageProgress)) {
+                    load->state = LOAD_FAILED;
+                    return;
+                }
+                // Images decode in parallel, whichever finishes last hands over to the GL thread
+                size_t decodeNum = staging.diffusePath.size();
+                if (decodeNum == 0) {
+                    load->state = LOAD_UPLOADING;
+                    return;
+                }
+                load->pendingDecodes = decodeNum;
+                load->decodeTotal = decodeNum;
+                for (size_t i = 0; i < decodeNum; i++) {
+                    queue->submit([load, i]() {
+                        Scene::decodeDiffuse(load->staging, i);
+                        if (--load->pendingDecodes == 0) load->state = LOAD_UPLOADING;
+                    });
+                }
+            });
+            return load;
+        }
+
+        State getState() const { return (State) state.load(); }
+
+        bool isReady() const { return getState() == LOAD_READY; }
+
+        // From 0 to 1: import and assembly, image decode, then upload
+        float getProgress() const {
+            switch (getState()) {
+                case LOAD_READY:
+                    return 1.0f;
+                case LOAD_UPLOADING:
+                    return PROGRESS_STAGED +
+                           (1.0f - PROGRESS_STAGED) * (uploadTotal ? (float) uploadDone / uploadTotal : 0.0f);
+                case LOAD_FAILED:
+                    return 0.0f;
+                default: {
+                    size_t decodeNum = decodeTotal.load();
+                    float decoded = decodeNum ? 1.0f - (float) pendingDecodes.load() / decodeNum : 0.0f;
+                    return PROGRESS_IMPORTED * stageProgress.load() + (PROGRESS_STAGED - PROGRESS_IMPORTED) * decoded;
+                }
+            }
+        }
+
+        // Scene::error until the load is ready
+        Scene &getScene() const { return isReady() && target ? *target : Scene::error; }
+
+        // Call once per frame on the GL thread. Uploads until about _budgetSeconds have passed,
+        // but always at least one slice so that loading progresses at any frame rate.
+        State update(double _budgetSeconds) {
+            if (getState() != LOAD_UPLOADING) return getState();
+            Scene &scene = *target;
+            Scene::Staging &staged = staging;
+            LOAD_PROFILE_SCOPE(uploadScope, "upload " + staged.name, LoadProfiler::PHASE_UPLOAD);
+#ifdef LOAD_PROFILER
+            size_t uploadBefore = uploadDone;
+#endif
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            do {
+                if (!created) {
+                    scene.adopt(staged);
+                    scene.createBuffers(NULL, staged.vertexBytes, NULL, staged.indexBytes);
+                    uploadTotal = staged.vertexBytes + staged.indexBytes;
+                    for (size_t i = 0; i < staged.diffuseImage.size(); i++)
+                        uploadTotal += staged.diffuseBytes(i);
+                    created = true;
+                } else if (vertexUploaded < staged.vertexBytes) {
+                    vertexUploaded += uploadSlice(scene.vbo, staged.vertices, staged.vertexBytes, vertexUploaded);
+                } else if (indexUploaded < staged.indexBytes) {
+                    indexUploaded += uploadSlice(scene.ebo, staged.indices, staged.indexBytes, indexUploaded);
+                } else if (materialUploaded < staged.diffusePath.size()) {
+                    uploadDone += staged.diffuseBytes(materialUploaded);
+                    scene.uploadDiffuse(staged, materialUploaded);
+                    staged.diffuseImage[materialUploaded] = TextureImage::Image();
+                    staged.diffuseBaked[materialUploaded] = TextureBake::BakedTexture();
+                    materialUploaded++;
+                } else {
+                    // Drops the CPU copies and the cache mapping
+                    staged.vertexAssembly.clear();
+                    staged.packedAssembly.clear();
+                    staged.indexUpload.clear();
+                    staged.cache.close();
+                    scene.available = true;
+                    state = LOAD_READY;
+                    break;
+                }
+            } while (std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < _budgetSeconds);
+            LOAD_PROFILE_COUNT(uploadScope, uploadDone - uploadBefore, 0);
+            return getState();
+        }
+
+    private:
+        static constexpr float PROGRESS_IMPORTED = 0.7f;
+        static constexpr float PROGRESS_STAGED = 0.8f;
+
+        std::atomic<int> state;
+        std::atomic<float> stageProgress;
+        std::atomic<size_t> pendingDecodes;
+        std::atomic<size_t> decodeTotal;
+        Scene *target;
+        Scene::Staging staging;
+        // Upload cursors, only touched on the GL thread
+        bool created;
+        size_t vertexUploaded;
+        size_t indexUploaded;
+        size_t materialUploaded;
+        size_t uploadDone;
+        size_t uploadTotal;
+
+        SceneLoad()
+                : state(LOAD_STAGING), stageProgress(0.0f), pendingDecodes(0), decodeTotal(0), target(NULL),
+                  created(false), vertexUploaded(0), indexUploaded(0), materialUploaded(0),
+                  uploadDone(0), uploadTotal(0) {}
+
+        SceneLoad(const SceneLoad &);
+
+        SceneLoad &operator=(const SceneLoad &);
+
+        // The copy target keeps the element array binding of whatever VAO is bound out of it
+        size_t uploadSlice(GLuint _buffer, const void *_data, size_t _size, size_t _offset) {
+            size_t slice = std::min(SCENE_UPLOAD_CHUNK_BYTES, _size - _offset);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, _offset, slice, (const char *) _data + _offset);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            uploadDone += slice;
+            return slice;
+        }
+    };
+}
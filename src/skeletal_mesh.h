@@ -8,87 +8,125 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
 
 #include "gl_env.h"
 
 #include "texture_image.h"
+#include "texture_stream.h"
+#include "skeleton.h"
+#include "parametric_vertex.h"
+#include "packed_vertex.h"
+#include "dual_quat.h"
+#include "mesh_optimizer.h"
+#include "scene_cache.h"
+#include "mapped_io_system.h"
+#include "mesh_assembler.h"
+#include "animation_clip.h"
+#include "load_profiler.h"
+#include "thread_pool.h"
+#include "soft_raster.h"
+#include "instance_buffer.h"
+#include "render_queue.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/ProgressHandler.hpp>
 #include <glm/glm.hpp>
 
 #define SCENE_RESOURCE_SHADER_DIFFUSE_CHANNEL 0
 
-#define SCENE_RESOURCE_BONE_PER_VERTEX 4
-
 namespace SkeletalMesh {
-    typedef std::map<std::string, glm::fmat4> SkeletonModifier;
-
-    struct ParametricVertex {
-        float position[3];
-        float texcoord[2];
-        float normal[3];
-        unsigned int boneId[SCENE_RESOURCE_BONE_PER_VERTEX];
-        float boneWeight[SCENE_RESOURCE_BONE_PER_VERTEX];
-
-        ParametricVertex() { memset(this, 0, sizeof(ParametricVertex)); }
-
-        ParametricVertex(aiVector3D _p, aiVector2D _tc, aiVector3D _n) {
-            memcpy(position, &_p, sizeof(position));
-            memcpy(texcoord, &_tc, sizeof(texcoord));
-            memcpy(normal, &_n, sizeof(normal));
-            memset(boneId, 0, sizeof(boneId));
-            memset(boneWeight, 0, sizeof(boneWeight));
-        }
-
-        bool addBone(unsigned int _id, float _weight) {
-            if (_weight < 1e-6) return false;
-            int minWeightIndex = 0;
-            for (int i = 1; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
-                if (boneWeight[i] < boneWeight[minWeightIndex])
-                    minWeightIndex = i;
-            }
-            if (boneWeight[minWeightIndex] < _weight) {
-                boneId[minWeightIndex] = _id;
-                boneWeight[minWeightIndex] = _weight;
-                return true;
-            }
-            return false;
-        }
-    };
-
     struct MeshEntry {
         unsigned int facetCornerNum;
         unsigned int indexOffset;
         unsigned int vertexOffset;
+        unsigned int vertexNum;
         unsigned int materialIndex;
+        // Meshes of up to 65536 vertices are drawn with GL_UNSIGNED_SHORT indices, the GPU
+        // index buffer mixes both widths so entries are addressed by byte
+        GLenum indexType;
+        unsigned int indexByteOffset;
     };
 
     struct Material {
         const TextureImage::Texture *diffuse;
+        // CPU copy of the diffuse texture, kept with LoadOptions::retainGeometry for the software rasterizer
+        TextureImage::Image image;
+        SoftRaster::TextureView imageView;
 
         Material()
-                : diffuse(&TextureImage::Texture::error) {}
+                : diffuse(&TextureImage::Texture::error) {
+            memset(&imageView, 0, sizeof(imageView));
+        }
+
+        void retainImage(const TextureImage::Image &_image) {
+            image = _image;
+            imageView.width = image.width;
+            imageView.height = image.height;
+            imageView.channels = image.channels;
+            imageView.pixels = image.pixels.get();
+        }
 
         bool setDiffuse(std::string _name, std::string _filename = std::string()) {
             return (diffuse = &TextureImage::Texture::loadTexture(_name, _filename))
                    != &TextureImage::Texture::error;
         }
+
+        bool setDiffuse(std::string _name, std::string _filename, const TextureImage::Image &_decoded) {
+            return (diffuse = &TextureImage::Texture::loadTexture(_name, _filename, _decoded))
+                   != &TextureImage::Texture::error;
+        }
+
+        bool setDiffuse(std::string _name, std::string _filename, const TextureBake::BakedTexture &_baked) {
+            return (diffuse = &TextureImage::Texture::loadTexture(_name, _filename, _baked))
+                   != &TextureImage::Texture::error;
+        }
+
+        bool setDiffuse(std::string _name, std::string _filename, const TextureBake::BakedTexture &_baked,
+                        TextureImage::TextureStreamer &_streamer) {
+            return (diffuse = &_streamer.stream(_name, _filename, _baked)) != &TextureImage::Texture::error;
+        }
     };
 
-    struct Bone {
-        aiMatrix4x4 localTransf;
+    struct LoadOptions {
+        // Keep the assembled vertex and index streams on the CPU, for CPU skinning and queries
+        bool retainGeometry;
+        // Layout of the GPU vertex buffer, VERTEX_FORMAT_PACKED halves it at a small precision cost.
+        // Retained geometry is always ParametricVertex.
+        VertexFormat vertexFormat;
+        // Reorder triangles for the post-transform vertex cache and vertices for fetch locality
+        bool optimizeMeshes;
+        // Reduce and pack animation clip keys within the default ClipTolerance
+        bool compressAnimations;
+        // Directory of baked scene caches, empty to always import the source file.
+        // Only changes where a scene comes from, so it takes no part in comparisons.
+        std::string cacheDir;
+        // Streams diffuse textures through it instead of uploading them whole, NULL to upload
+        // them whole. Textures are then baked even without a cache directory. Like cacheDir it
+        // takes no part in comparisons.
+        TextureImage::TextureStreamer *textureStreamer;
 
-        //Bone() : localTransf() {}
-        Bone(const aiMatrix4x4 &_m) : localTransf(_m) {}
+        LoadOptions()
+                : retainGeometry(false), vertexFormat(VERTEX_FORMAT_FLOAT), optimizeMeshes(true),
+                  compressAnimations(false), textureStreamer(NULL) {}
+
+        bool operator==(const LoadOptions &_other) const {
+            return retainGeometry == _other.retainGeometry && vertexFormat == _other.vertexFormat &&
+                   optimizeMeshes == _other.optimizeMeshes && compressAnimations == _other.compressAnimations;
+        }
     };
 
+    class SceneLoad;
+
     class Scene {
 
     public:
         typedef std::map<std::string, Scene *> Name2Scene;
-        typedef std::vector<glm::fmat4> SkeletonTransf;
+        typedef SkeletalMesh::SkeletonTransf SkeletonTransf;
         typedef std::map<std::string, unsigned int> Name2Bone;
         static Name2Scene allScene;
         static Scene error;
@@ -97,15 +135,43 @@ namespace SkeletalMesh {
         bool available;
         std::string name;
         std::string filename;
-        Assimp::Importer importer;
-        const aiScene *scene;
+        LoadOptions options;
+        SkinningMode skinningMode;
         GLuint vao;
         GLuint vbo;
         GLuint ebo;
         std::vector<MeshEntry> meshEntry;
+        std::vector<ParametricVertex> vertexData;
+        std::vector<unsigned int> indexData;
         std::vector<Material> material;
-        std::vector<Bone> skeleton;
+        Skeleton skeleton;
         Name2Bone nameBoneMap;
+        PackedBoneLayout packedBoneLayout;
+        VertexPackReport packReport;
+        std::vector<AnimationClip> animation;
+
+        enum CacheSection {
+            CACHE_SECTION_LAYOUT = 1,
+            CACHE_SECTION_VERTICES,
+            CACHE_SECTION_INDICES,
+            CACHE_SECTION_FLOAT_VERTICES,
+            CACHE_SECTION_MESH_ENTRIES,
+            CACHE_SECTION_DIFFUSE_NAMES,
+            CACHE_SECTION_DIFFUSE_PATHS,
+            CACHE_SECTION_NODE_PARENTS,
+            CACHE_SECTION_NODE_LOCAL_BINDS,
+            CACHE_SECTION_NODE_BONE_IDS,
+            CACHE_SECTION_NODE_NAMES,
+            CACHE_SECTION_NODE_NAME_NODES,
+            CACHE_SECTION_BONE_OFFSETS,
+            CACHE_SECTION_BONE_NAMES,
+            CACHE_SECTION_BONE_NAME_BONES,
+            CACHE_SECTION_INV_ROOT,
+            CACHE_SECTION_PACK_REPORT,
+            CACHE_SECTION_ANIMATION_NUM,
+            // Clip i takes CLIP_SECTION_NUM sections from CACHE_SECTION_ANIMATIONS + i * CLIP_SECTION_NUM
+            CACHE_SECTION_ANIMATIONS = 64
+        };
 
         // Forbid calling any constructor outside
         Scene(const Scene &_copy)
@@ -113,6 +179,8 @@ namespace SkeletalMesh {
 
         Scene() {
             available = false;
+            skinningMode = SKINNING_LINEAR_BLEND;
+            packedBoneLayout = PACKED_BONE_INDEX8_WEIGHT16;
             vao = 0;
             vbo = 0;
             ebo = 0;
@@ -125,18 +193,24 @@ namespace SkeletalMesh {
             available = false;
             name = std::string();
             filename = std::string();
-            // importer..
-            scene = NULL;
-            glDeleteVertexArrays(1, &vao);
+            // Static scenes are cleared at exit, possibly before any GL entry point was loaded
+            if (vao) glDeleteVertexArrays(1, &vao);
             vao = 0;
-            glDeleteBuffers(1, &vbo);
+            if (vbo) glDeleteBuffers(1, &vbo);
             vbo = 0;
-            glDeleteBuffers(1, &ebo);
+            if (ebo) glDeleteBuffers(1, &ebo);
             ebo = 0;
+            options = LoadOptions();
+            skinningMode = SKINNING_LINEAR_BLEND;
             meshEntry.clear();
+            vertexData.clear();
+            indexData.clear();
             material.clear();
             skeleton.clear();
             nameBoneMap.clear();
+            packedBoneLayout = PACKED_BONE_INDEX8_WEIGHT16;
+            packReport = VertexPackReport();
+            animation.clear();
         }
 
         static std::string testAllSuffix(std::string no_suffix_name) {
@@ -158,81 +232,231 @@ namespace SkeletalMesh {
             return std::string();
         }
 
-        static Scene &loadScene(std::string _name, std::string _filename = std::string()) {
+        static Scene &loadScene(std::string _name, std::string _filename = std::string(),
+                                const LoadOptions &_options = LoadOptions()) {
             if (_filename.empty() || _filename == "") {
                 _filename = testAllSuffix(_name);
                 if (_filename.empty()) return error;
             }
-            FILE *fi = fopen(_filename.c_str(), "r");
-            if (fi == NULL) return error;
-            fclose(fi);
 
+            // A missing file fails in stage(), no need to probe for it first
+            Scene &target = reserve(_name, _filename, _options);
+            if (target.available) return target;
+
+            Staging staging;
+            staging.name = _name;
+            staging.filename = _filename;
+            staging.options = _options;
+            staging.pool = &Parallel::ThreadPool::shared();
+            if (!stage(staging)) return error;
+            for (size_t i = 0; i < staging.diffusePath.size(); i++)
+                decodeDiffuse(staging, i);
+
+            LOAD_PROFILE_SCOPE(uploadScope, "upload " + _name, LoadProfiler::PHASE_UPLOAD);
+            target.adopt(staging);
+            target.createBuffers(staging.vertices, staging.vertexBytes, staging.indices, staging.indexBytes);
+            LOAD_PROFILE_COUNT(uploadScope, staging.vertexBytes + staging.indexBytes, 2);
+            for (size_t i = 0; i < staging.diffusePath.size(); i++) {
+                target.uploadDiffuse(staging, i);
+                LOAD_PROFILE_COUNT(uploadScope, staging.diffuseBytes(i), 1);
+            }
+
+            target.available = true;
+            return target;
+        }
+
+    private:
+        friend class SceneLoad;
+
+        // Everything loading produces before GL gets involved, filled on any thread
+        struct Staging {
+            std::string name;
+            std::string filename;
+            LoadOptions options;
+            std::vector<MeshEntry> meshEntry;
+            // Per material, empty when it has no diffuse texture
+            std::vector<std::string> diffuseName;
+            std::vector<std::string> diffusePath;
+            std::vector<TextureImage::Image> diffuseImage;
+            // Per material, the baked copy of its diffuse texture when the cache directory has one
+            std::vector<TextureBake::BakedTexture> diffuseBaked;
+            Skeleton skeleton;
+            Name2Bone nameBoneMap;
+            PackedBoneLayout packedBoneLayout;
+            VertexPackReport packReport;
+            std::vector<AnimationClip> animation;
+            std::vector<ParametricVertex> vertexAssembly;
+            std::vector<unsigned int> indexAssembly;
+            std::vector<PackedVertex> packedAssembly;
+            std::vector<unsigned char> indexUpload;
+            // A cache hit keeps its mapping open until the upload is done
+            SceneCache::Reader cache;
+            // GPU streams, pointing into one of the vectors above or into the cache mapping
+            const void *vertices;
+            size_t vertexBytes;
+            const void *indices;
+            size_t indexBytes;
+            // Spreads the assembly over its workers, NULL keeps it on the staging thread
+            Parallel::ThreadPool *pool;
+
+            Staging()
+                    : packedBoneLayout(PACKED_BONE_INDEX8_WEIGHT16),
+                      vertices(NULL), vertexBytes(0), indices(NULL), indexBytes(0), pool(NULL) {}
+
+            // What uploading the diffuse texture of a material transfers
+            size_t diffuseBytes(size_t _material) const {
+                return diffuseBaked[_material].empty() ? diffuseImage[_material].byteNum()
+                                                       : diffuseBaked[_material].byteNum();
+            }
+        };
+
+        // Shares of the Assimp import and of the assembly in the staging progress
+        static constexpr float STAGE_IMPORT_SHARE = 0.8f;
+
+        class ImportProgress : public Assimp::ProgressHandler {
+        public:
+            explicit ImportProgress(std::atomic<float> *_progress)
+                    : progress(_progress) {}
+
+            bool Update(float _percentage) override {
+                if (_percentage >= 0.0f) progress->store(_percentage * STAGE_IMPORT_SHARE);
+                return true;
+            }
+
+        private:
+            std::atomic<float> *progress;
+        };
+
+        // The scene registered under _name, emptied unless it already holds this file with these options
+        static Scene &reserve(const std::string &_name, const std::string &_filename, const LoadOptions &_options) {
             std::pair<Name2Scene::iterator, bool> insertion =
                     allScene.insert(Name2Scene::value_type(_name, new Scene()));
             Scene &target = *(insertion.first->second);
             if (!insertion.second) {
-                if (target.filename == _filename && target.available) {
+                if (target.filename == _filename && target.available && target.options == _options) {
                     return target;
                 } else {
                     target.clear();
                 }
             }
+            return target;
+        }
 
-            target.name = _name;
-            target.filename = _filename;
+        // Import or cache lookup, assembly, optimization and packing; no GL calls, so it may run on any thread.
+        // _progress, when given, rises to 1 as staging proceeds.
+        static bool stage(Staging &staging, std::atomic<float> *_progress = NULL) {
+            const std::string &_name = staging.name;
+            const std::string &_filename = staging.filename;
+            const LoadOptions &_options = staging.options;
 
-            target.scene = target.importer.ReadFile(_filename,
-                                                    aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                                                    aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
-            if (!target.scene) return error;
+            const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                                             aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices;
+            LOAD_PROFILE_SCOPE(stageScope, "stage " + _name, LoadProfiler::PHASE_SPAN);
+            std::string cacheFile;
+            uint64_t cacheKey = 0;
+            if (!_options.cacheDir.empty() && computeCacheKey(staging, importFlags, cacheKey)) {
+                LOAD_PROFILE_SCOPE(cacheScope, "cache read " + _name, LoadProfiler::PHASE_READ);
+                cacheFile = _options.cacheDir + "/" + _name + ".scache";
+                if (stageFromCache(staging, cacheFile, cacheKey)) {
+                    LOAD_PROFILE_COUNT(cacheScope, staging.vertexBytes + staging.indexBytes, staging.meshEntry.size());
+                    if (_progress) _progress->store(1.0f);
+                    return true;
+                }
+            }
 
-            std::vector<ParametricVertex> vertexAssembly;
-            std::vector<unsigned int> indexAssembly;
+            // The importer only lives as long as loading does, everything needed later is copied out.
+            // Read, parse, conversion and post-processing are profiled by Assimp itself.
+            Assimp::Importer importer;
+            importer.SetIOHandler(new FileMapping::MappedIOSystem());
+            if (_progress) importer.SetProgressHandler(new ImportProgress(_progress));
+            const aiScene *scene = importer.ReadFile(_filename, importFlags);
+            if (!scene) return false;
 
-            int nTotalMeshes = target.scene->mNumMeshes;
-            target.meshEntry.resize(nTotalMeshes);
+            std::vector<ParametricVertex> &vertexAssembly = staging.vertexAssembly;
+            std::vector<unsigned int> &indexAssembly = staging.indexAssembly;
+            std::vector<aiMatrix4x4> boneOffset;
 
-            int nTotalVertices = 0;
-            int nTotalIndices = 0;
-            for (int i = 0; i < nTotalMeshes; i++) {
-                const aiMesh *curMesh = target.scene->mMeshes[i];
-                int nMeshVertices = curMesh->mNumVertices;
-                int nMeshBones = curMesh->mNumBones;
-                int nMeshFaces = curMesh->mNumFaces;
-
-                target.meshEntry[i].facetCornerNum = nMeshFaces * 3;
-                target.meshEntry[i].indexOffset = nTotalIndices;
-                target.meshEntry[i].vertexOffset = nTotalVertices;
-                target.meshEntry[i].materialIndex = curMesh->mMaterialIndex;
-
-                nTotalVertices += nMeshVertices;
-                nTotalIndices += nMeshFaces * 3;
-
-                for (int j = 0; j < nMeshVertices; j++) {
-                    aiVector2D curTexcoord(.0f, .0f);
-                    if (curMesh->HasTextureCoords(0))
-                        curTexcoord = aiVector2D(curMesh->mTextureCoords[0][j].x, curMesh->mTextureCoords[0][j].y);
-                    vertexAssembly.emplace_back(curMesh->mVertices[j], curTexcoord, curMesh->mNormals[j]);
+            MeshAssembler::Layout layout;
+            int nTotalMeshes = scene->mNumMeshes;
+            {
+                LOAD_PROFILE_SCOPE(assemblyScope, "assembly " + _name, LoadProfiler::PHASE_ASSEMBLY);
+                MeshAssembler::plan(scene, layout, staging.nameBoneMap, boneOffset);
+                staging.meshEntry.resize(nTotalMeshes);
+                for (int i = 0; i < nTotalMeshes; i++) {
+                    staging.meshEntry[i].facetCornerNum = layout.indexOffset[i + 1] - layout.indexOffset[i];
+                    staging.meshEntry[i].indexOffset = layout.indexOffset[i];
+                    staging.meshEntry[i].vertexOffset = layout.vertexOffset[i];
+                    staging.meshEntry[i].vertexNum = layout.vertexOffset[i + 1] - layout.vertexOffset[i];
+                    staging.meshEntry[i].materialIndex = scene->mMeshes[i]->mMaterialIndex;
                 }
-                for (int j = 0; j < nMeshBones; j++) {
-                    std::string boneName = curMesh->mBones[j]->mName.data;
-                    std::pair<std::map<std::string, unsigned int>::iterator, bool> insertResult;
-                    insertResult = target.nameBoneMap.insert(std::make_pair(boneName, target.skeleton.size()));
-                    if (insertResult.second) {
-                        target.skeleton.emplace_back(curMesh->mBones[j]->mOffsetMatrix);
-                        int nBoneVertexWeight = curMesh->mBones[j]->mNumWeights;
-                        for (int k = 0; k < nBoneVertexWeight; k++) {
-                            int vertexId = target.meshEntry[i].vertexOffset + curMesh->mBones[j]->mWeights[k].mVertexId;
-                            float weight = curMesh->mBones[j]->mWeights[k].mWeight;
-                            vertexAssembly[vertexId].addBone(insertResult.first->second, weight);
-                        }
-                    }
+                vertexAssembly.resize(layout.vertexNum());
+                indexAssembly.resize(layout.indexNum());
+                MeshAssembler::assemble(scene, layout, vertexAssembly.data(), indexAssembly.data(), staging.pool);
+                LOAD_PROFILE_COUNT(assemblyScope, sizeof(ParametricVertex) * layout.vertexNum() +
+                                                  sizeof(unsigned int) * layout.indexNum(), layout.vertexNum());
+            }
+
+            staging.skeleton.bake(scene->mRootNode, boneOffset, staging.nameBoneMap);
+            // Clips are resolved against the skeleton, channels of other nodes are dropped
+            for (unsigned int i = 0; i < scene->mNumAnimations; i++) {
+                AnimationClip clip;
+                if (!clip.import(scene->mAnimations[i], staging.skeleton)) continue;
+                ClipCompressionReport report;
+                if (_options.compressAnimations && clip.compress(ClipTolerance(), &report))
+                    std::cout << "Compressed animation " << clip.getName() << " of " << _name << ": "
+                              << report.keptKeyNum << " of " << report.keyNum << " keys, " << report.ratio()
+                              << "x; max error rotation " << glm::degrees(report.maxRotationError) << " deg, position "
+                              << report.maxPositionError << ", scale " << report.maxScaleError << std::endl;
+                staging.animation.push_back(clip);
+            }
+
+            if (_options.optimizeMeshes) {
+                LOAD_PROFILE_SCOPE(optimizeScope, "optimize " + _name, LoadProfiler::PHASE_ASSEMBLY);
+                LOAD_PROFILE_COUNT(optimizeScope, 0, layout.vertexNum());
+                // Bone weights are already attached, so vertices can be moved as a whole
+                std::vector<unsigned int> remap;
+                std::vector<ParametricVertex> reordered;
+                for (int i = 0; i < nTotalMeshes; i++) {
+                    const MeshEntry &entry = staging.meshEntry[i];
+                    unsigned int *indices = indexAssembly.data() + entry.indexOffset;
+                    MeshOptimizer::CacheStats before =
+                            MeshOptimizer::analyzeVertexCache(indices, entry.facetCornerNum, entry.vertexNum);
+                    MeshOptimizer::optimizeVertexCache(indices, entry.facetCornerNum, entry.vertexNum);
+                    remap.resize(entry.vertexNum);
+                    MeshOptimizer::optimizeVertexFetch(indices, entry.facetCornerNum, entry.vertexNum, remap.data());
+                    reordered.resize(entry.vertexNum);
+                    for (unsigned int j = 0; j < entry.vertexNum; j++)
+                        reordered[remap[j]] = vertexAssembly[entry.vertexOffset + j];
+                    std::copy(reordered.begin(), reordered.end(), vertexAssembly.begin() + entry.vertexOffset);
+                    MeshOptimizer::CacheStats after =
+                            MeshOptimizer::analyzeVertexCache(indices, entry.facetCornerNum, entry.vertexNum);
+                    std::cout << "Optimized mesh " << i << " of " << _name << ": ACMR " << before.acmr << " -> "
+                              << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
                 }
-                for (int j = 0; j < nMeshFaces; j++) {
-                    for (int k = 0; k < 3; k++)
-                        indexAssembly.push_back(curMesh->mFaces[j].mIndices[k]);
+            }
+
+            std::vector<unsigned char> &indexUpload = staging.indexUpload;
+            for (int i = 0; i < nTotalMeshes; i++) {
+                MeshEntry &entry = staging.meshEntry[i];
+                const unsigned int *indices = indexAssembly.data() + entry.indexOffset;
+                // Keeps 32 bit entries aligned after 16 bit ones
+                indexUpload.resize((indexUpload.size() + 3) & ~(size_t) 3);
+                entry.indexByteOffset = indexUpload.size();
+                if (entry.vertexNum <= 65536) {
+                    entry.indexType = GL_UNSIGNED_SHORT;
+                    indexUpload.resize(indexUpload.size() + sizeof(unsigned short) * entry.facetCornerNum);
+                    unsigned short *dst = (unsigned short *) (indexUpload.data() + entry.indexByteOffset);
+                    for (unsigned int j = 0; j < entry.facetCornerNum; j++)
+                        dst[j] = (unsigned short) indices[j];
+                } else {
+                    entry.indexType = GL_UNSIGNED_INT;
+                    indexUpload.resize(indexUpload.size() + sizeof(unsigned int) * entry.facetCornerNum);
+                    memcpy(indexUpload.data() + entry.indexByteOffset, indices,
+                           sizeof(unsigned int) * entry.facetCornerNum);
                 }
             }
+            staging.indices = indexUpload.data();
+            staging.indexBytes = indexUpload.size();
 
             std::string filepath_prefix;
             {
@@ -246,10 +470,11 @@ namespace SkeletalMesh {
                     filepath_prefix = _filename.substr(0, slashpos + 1);
                 }
             }
-            int nTotalMaterials = target.scene->mNumMaterials;
-            target.material.resize(nTotalMaterials);
+            int nTotalMaterials = scene->mNumMaterials;
+            staging.diffuseName.resize(nTotalMaterials);
+            staging.diffusePath.resize(nTotalMaterials);
             for (int i = 0; i < nTotalMaterials; i++) {
-                const aiMaterial *curMaterial = target.scene->mMaterials[i];
+                const aiMaterial *curMaterial = scene->mMaterials[i];
 
                 if (curMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
                     aiString ai_filepath;
@@ -270,31 +495,297 @@ namespace SkeletalMesh {
                             dirpath = std::string();
                             filename = filepath;
                         }
-                        if (!target.material[i].setDiffuse(filename, dirpath + filename))
-                            std::cout << "Error loading diffuse " << filepath << std::endl;
+                        staging.diffuseName[i] = filename;
+                        staging.diffusePath[i] = dirpath + filename;
                     }
                 }
             }
+            staging.diffuseImage.resize(nTotalMaterials);
+            staging.diffuseBaked.resize(nTotalMaterials);
+
+            staging.vertices = vertexAssembly.data();
+            staging.vertexBytes = sizeof(ParametricVertex) * vertexAssembly.size();
+            if (_options.vertexFormat == VERTEX_FORMAT_PACKED) {
+                staging.packedBoneLayout = boneOffset.size() > 256 ? PACKED_BONE_INDEX16_WEIGHT8
+                                                                   : PACKED_BONE_INDEX8_WEIGHT16;
+                LOAD_PROFILE_SCOPE(packScope, "pack " + _name, LoadProfiler::PHASE_ASSEMBLY);
+                LOAD_PROFILE_COUNT(packScope, sizeof(ParametricVertex) * vertexAssembly.size(), vertexAssembly.size());
+                std::vector<PackedVertex> &packedAssembly = staging.packedAssembly;
+                packedAssembly.resize(vertexAssembly.size());
+                for (size_t i = 0; i < vertexAssembly.size(); i++)
+                    VertexPacking::pack(vertexAssembly[i], staging.packedBoneLayout, packedAssembly[i],
+                                        staging.packReport);
+                staging.packReport.floatBytes = sizeof(ParametricVertex) * vertexAssembly.size();
+                staging.packReport.packedBytes = sizeof(PackedVertex) * packedAssembly.size();
+                staging.vertices = packedAssembly.data();
+                staging.vertexBytes = sizeof(PackedVertex) * packedAssembly.size();
+
+                const VertexPackReport &report = staging.packReport;
+                std::cout << "Packed vertices of " << _name << ": " << report.packedBytes << " bytes, "
+                          << report.floatBytes - report.packedBytes << " bytes saved; max error normal "
+                          << report.maxNormalErrorDegrees << " deg, texcoord " << report.maxTexcoordError
+                          << ", weight " << report.maxWeightError << std::endl;
+                if (report.clampedBoneIds)
+                    std::cout << "Error packing " << report.clampedBoneIds << " vertices of " << _name
+                              << ": bone index out of range" << std::endl;
+            }
+
+            if (!cacheFile.empty()) {
+                LOAD_PROFILE_SCOPE(cacheWriteScope, "cache write " + _name, LoadProfiler::PHASE_ASSEMBLY);
+                LOAD_PROFILE_COUNT(cacheWriteScope, staging.vertexBytes + staging.indexBytes, nTotalMeshes);
+                SceneCache::Writer writer;
+                unsigned int layout[2] = {(unsigned int) _options.vertexFormat, (unsigned int) staging.packedBoneLayout};
+                writer.add(CACHE_SECTION_LAYOUT, layout, sizeof(layout));
+                writer.add(CACHE_SECTION_VERTICES, staging.vertices, staging.vertexBytes);
+                writer.addVector(CACHE_SECTION_INDICES, indexUpload);
+                // Retained geometry is always ParametricVertex, a packed upload can not provide it
+                if (_options.vertexFormat != VERTEX_FORMAT_FLOAT)
+                    writer.addVector(CACHE_SECTION_FLOAT_VERTICES, vertexAssembly);
+                writer.addStrings(CACHE_SECTION_DIFFUSE_NAMES, staging.diffuseName);
+                writer.addStrings(CACHE_SECTION_DIFFUSE_PATHS, staging.diffusePath);
+                writeCacheHierarchy(staging, writer);
+                if (!writer.save(cacheFile, cacheKey))
+                    std::cout << "Error writing scene cache " << cacheFile << std::endl;
+            }
+
+            if (_progress) _progress->store(1.0f);
+            return true;
+        }
+
+        // With a cache directory, a baked copy of the texture replaces decoding it. Without a
+        // current one the image is decoded as before and baked for the next start. Streamed
+        // textures are baked in any case, their levels are what gets streamed.
+        static void decodeDiffuse(Staging &staging, size_t _material) {
+            const std::string &path = staging.diffusePath[_material];
+            const std::string &name = staging.diffuseName[_material];
+            if (path.empty()) return;
+            TextureBake::BakedTexture &baked = staging.diffuseBaked[_material];
+            uint64_t bakeKey = 0;
+            std::string bakedPath;
+            if (!staging.options.cacheDir.empty() && TextureBake::computeKey(path, bakeKey)) {
+                LOAD_PROFILE_SCOPE(readScope, "texture cache read " + name, LoadProfiler::PHASE_READ);
+                bakedPath = TextureBake::cachePath(staging.options.cacheDir, path);
+                if (baked.open(bakedPath, bakeKey)) {
+                    LOAD_PROFILE_COUNT(readScope, baked.byteNum(), baked.levelNum());
+                    return;
+                }
+            }
+
+            TextureImage::Image &image = staging.diffuseImage[_material];
+            {
+                LOAD_PROFILE_SCOPE(decodeScope, "decode " + name, LoadProfiler::PHASE_TEXTURE_DECODE);
+                image.decode(path);
+                LOAD_PROFILE_COUNT(decodeScope, image.byteNum(), (uint64_t) image.width * image.height);
+            }
+            if ((bakedPath.empty() && !staging.options.textureStreamer) || image.empty()) return;
+
+            LOAD_PROFILE_SCOPE(bakeScope, "bake " + name, LoadProfiler::PHASE_TEXTURE_DECODE);
+            if (!baked.bake(image.pixels.get(), image.width, image.height, image.channels)) return;
+            LOAD_PROFILE_COUNT(bakeScope, baked.byteNum(), baked.levelNum());
+            std::cout << "Baked texture " << name << ": " << (baked.getFormat() == TextureBake::BLOCK_BC1 ? "BC1" : "BC3")
+                      << ", " << baked.levelNum() << " levels, " << baked.byteNum() << " bytes" << std::endl;
+            if (!bakedPath.empty() && !baked.save(bakedPath, bakeKey))
+                std::cout << "Error writing baked texture " << bakedPath << std::endl;
+        }
+
+        // Takes over the CPU side of a staged scene, on the GL thread since it replaces what render() reads
+        void adopt(Staging &staging) {
+            name = staging.name;
+            filename = staging.filename;
+            options = staging.options;
+            meshEntry.swap(staging.meshEntry);
+            skeleton = staging.skeleton;
+            nameBoneMap.swap(staging.nameBoneMap);
+            packedBoneLayout = staging.packedBoneLayout;
+            packReport = staging.packReport;
+            animation.swap(staging.animation);
+            material.assign(staging.diffusePath.size(), Material());
+            if (options.retainGeometry) {
+                vertexData.swap(staging.vertexAssembly);
+                indexData.swap(staging.indexAssembly);
+            }
+        }
 
-            glGenVertexArrays(1, &target.vao);
-            glBindVertexArray(target.vao);
+        void uploadDiffuse(Staging &staging, size_t _material) {
+            const std::string &path = staging.diffusePath[_material];
+            const std::string &name = staging.diffuseName[_material];
+            if (path.empty()) return;
+            if (options.retainGeometry) {
+                // A baked cache hit has not decoded the image, the software rasterizer needs it
+                TextureImage::Image &image = staging.diffuseImage[_material];
+                if (image.empty()) image.decode(path);
+                material[_material].retainImage(image);
+            }
+            const TextureBake::BakedTexture &baked = staging.diffuseBaked[_material];
+            if (!baked.empty() && options.textureStreamer &&
+                material[_material].setDiffuse(name, path, baked, *options.textureStreamer))
+                return;
+            if (!baked.empty() && material[_material].setDiffuse(name, path, baked)) return;
 
-            glGenBuffers(1, &target.vbo);
-            glBindBuffer(GL_ARRAY_BUFFER, target.vbo);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(ParametricVertex) * vertexAssembly.size(), vertexAssembly.data(),
-                         GL_STATIC_DRAW);
+            // Without block compression support a cache hit still has to be decoded
+            TextureImage::Image &image = staging.diffuseImage[_material];
+            if (image.empty()) image.decode(path);
+            if (!material[_material].setDiffuse(name, path, image))
+                std::cout << "Error loading diffuse " << path << std::endl;
+        }
 
-            glGenBuffers(1, &target.ebo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, target.ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indexAssembly.size(), indexAssembly.data(),
-                         GL_STATIC_DRAW);
+        // Source content, import flags and every option that changes what is uploaded
+        static bool computeCacheKey(const Staging &staging, unsigned int _importFlags, uint64_t &_key) {
+            uint64_t config[6] = {_importFlags, (uint64_t) staging.options.vertexFormat,
+                                  (uint64_t) staging.options.optimizeMeshes,
+                                  (uint64_t) staging.options.compressAnimations,
+                                  sizeof(ParametricVertex), sizeof(MeshEntry)};
+            return SceneCache::hashFile(staging.filename, SceneCache::hashBytes(config, sizeof(config)), _key);
+        }
+
+        // Either data pointer may be NULL to only allocate the storage
+        void createBuffers(const void *_vertices, size_t _vertexBytes, const void *_indices, size_t _indexBytes) {
+            glGenVertexArrays(1, &vao);
+            glBindVertexArray(vao);
+
+            glGenBuffers(1, &vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, _vertexBytes, _vertices, GL_STATIC_DRAW);
+
+            glGenBuffers(1, &ebo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indexBytes, _indices, GL_STATIC_DRAW);
 
             glBindVertexArray(0);
+        }
 
-            target.available = true;
-            return target;
+        static void writeCacheHierarchy(const Staging &staging, SceneCache::Writer &_writer) {
+            const Skeleton &skeleton = staging.skeleton;
+            _writer.addVector(CACHE_SECTION_MESH_ENTRIES, staging.meshEntry);
+            _writer.addVector(CACHE_SECTION_NODE_PARENTS, skeleton.parent);
+            _writer.addVector(CACHE_SECTION_NODE_LOCAL_BINDS, skeleton.localBind);
+            _writer.addVector(CACHE_SECTION_NODE_BONE_IDS, skeleton.boneId);
+            _writer.addVector(CACHE_SECTION_BONE_OFFSETS, skeleton.offset);
+            _writer.add(CACHE_SECTION_INV_ROOT, &skeleton.invRoot, sizeof(skeleton.invRoot));
+            _writer.add(CACHE_SECTION_PACK_REPORT, &staging.packReport, sizeof(staging.packReport));
+            // Name maps are stored as their names and, in the same order, what the names map to
+            std::vector<std::string> nodeNames, boneNames;
+            std::vector<int> nodes;
+            std::vector<unsigned int> bones;
+            for (Skeleton::Name2Node::const_iterator it = skeleton.nameNodeMap.begin();
+                 it != skeleton.nameNodeMap.end(); ++it) {
+                nodeNames.push_back(it->first);
+                nodes.push_back(it->second);
+            }
+            for (Name2Bone::const_iterator it = staging.nameBoneMap.begin(); it != staging.nameBoneMap.end(); ++it) {
+                boneNames.push_back(it->first);
+                bones.push_back(it->second);
+            }
+            _writer.addStrings(CACHE_SECTION_NODE_NAMES, nodeNames);
+            _writer.addVector(CACHE_SECTION_NODE_NAME_NODES, nodes);
+            _writer.addStrings(CACHE_SECTION_BONE_NAMES, boneNames);
+            _writer.addVector(CACHE_SECTION_BONE_NAME_BONES, bones);
+            unsigned int animationNum = (unsigned int) staging.animation.size();
+            _writer.add(CACHE_SECTION_ANIMATION_NUM, &animationNum, sizeof(animationNum));
+            for (unsigned int i = 0; i < animationNum; i++)
+                staging.animation[i].write(_writer, CACHE_SECTION_ANIMATIONS + i * CLIP_SECTION_NUM);
         }
 
+        // Everything is read into locals first, staging is only touched once the whole cache checked out
+        static bool stageFromCache(Staging &staging, const std::string &_path, uint64_t _key) {
+            const LoadOptions &options = staging.options;
+            SceneCache::Reader &reader = staging.cache;
+            if (!reader.open(_path, _key)) return false;
+
+            const void *vertices, *indices;
+            size_t vertexBytes, indexBytes;
+            std::vector<unsigned int> layout;
+            std::vector<ParametricVertex> floatVertices;
+            std::vector<MeshEntry> entries;
+            std::vector<std::string> diffuseName, diffusePath, nodeNames, boneNames;
+            std::vector<VertexPackReport> report;
+            std::vector<Affine3x4> invRoot;
+            std::vector<int> nameNodes;
+            std::vector<unsigned int> nameBones;
+            std::vector<unsigned int> animationNum;
+            Skeleton loaded;
+            bool complete = reader.getVector(CACHE_SECTION_LAYOUT, layout) && layout.size() == 2 &&
+                            layout[0] == (unsigned int) options.vertexFormat &&
+                            reader.get(CACHE_SECTION_VERTICES, vertices, vertexBytes) &&
+                            reader.get(CACHE_SECTION_INDICES, indices, indexBytes) &&
+                            reader.getVector(CACHE_SECTION_MESH_ENTRIES, entries) &&
+                            reader.getStrings(CACHE_SECTION_DIFFUSE_NAMES, diffuseName) &&
+                            reader.getStrings(CACHE_SECTION_DIFFUSE_PATHS, diffusePath) &&
+                            diffuseName.size() == diffusePath.size() &&
+                            reader.getVector(CACHE_SECTION_NODE_PARENTS, loaded.parent) &&
+                            reader.getVector(CACHE_SECTION_NODE_LOCAL_BINDS, loaded.localBind) &&
+                            reader.getVector(CACHE_SECTION_NODE_BONE_IDS, loaded.boneId) &&
+                            reader.getVector(CACHE_SECTION_BONE_OFFSETS, loaded.offset) &&
+                            reader.getVector(CACHE_SECTION_INV_ROOT, invRoot) && invRoot.size() == 1 &&
+                            reader.getVector(CACHE_SECTION_PACK_REPORT, report) && report.size() == 1 &&
+                            reader.getStrings(CACHE_SECTION_NODE_NAMES, nodeNames) &&
+                            reader.getVector(CACHE_SECTION_NODE_NAME_NODES, nameNodes) &&
+                            nodeNames.size() == nameNodes.size() &&
+                            reader.getStrings(CACHE_SECTION_BONE_NAMES, boneNames) &&
+                            reader.getVector(CACHE_SECTION_BONE_NAME_BONES, nameBones) &&
+                            boneNames.size() == nameBones.size() &&
+                            reader.getVector(CACHE_SECTION_ANIMATION_NUM, animationNum) && animationNum.size() == 1;
+            std::vector<AnimationClip> animation(complete ? animationNum[0] : 0);
+            for (size_t i = 0; complete && i < animation.size(); i++)
+                complete = animation[i].read(reader, CACHE_SECTION_ANIMATIONS + (uint32_t) i * CLIP_SECTION_NUM);
+            if (complete && options.vertexFormat != VERTEX_FORMAT_FLOAT && options.retainGeometry)
+                complete = reader.getVector(CACHE_SECTION_FLOAT_VERTICES, floatVertices);
+            if (complete && options.vertexFormat == VERTEX_FORMAT_FLOAT && options.retainGeometry)
+                complete = vertexBytes % sizeof(ParametricVertex) == 0;
+            for (size_t i = 0; complete && i < entries.size(); i++) {
+                size_t indexSize = entries[i].indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short)
+                                                                             : sizeof(unsigned int);
+                complete = entries[i].indexByteOffset + indexSize * entries[i].facetCornerNum <= indexBytes &&
+                           entries[i].materialIndex < diffuseName.size();
+            }
+            if (!complete) {
+                reader.close();
+                return false;
+            }
+
+            loaded.invRoot = invRoot[0];
+            for (size_t i = 0; i < nodeNames.size(); i++)
+                loaded.nameNodeMap[nodeNames[i]] = nameNodes[i];
+            for (size_t i = 0; i < boneNames.size(); i++)
+                staging.nameBoneMap[boneNames[i]] = nameBones[i];
+
+            staging.meshEntry.swap(entries);
+            staging.skeleton = loaded;
+            staging.packedBoneLayout = (PackedBoneLayout) layout[1];
+            staging.packReport = report[0];
+            staging.animation.swap(animation);
+            staging.diffuseName.swap(diffuseName);
+            staging.diffusePath.swap(diffusePath);
+            staging.diffuseImage.resize(staging.diffusePath.size());
+            staging.diffuseBaked.resize(staging.diffusePath.size());
+            staging.vertices = vertices;
+            staging.vertexBytes = vertexBytes;
+            staging.indices = indices;
+            staging.indexBytes = indexBytes;
+
+            if (options.retainGeometry) {
+                if (options.vertexFormat == VERTEX_FORMAT_FLOAT) {
+                    const ParametricVertex *first = (const ParametricVertex *) vertices;
+                    staging.vertexAssembly.assign(first, first + vertexBytes / sizeof(ParametricVertex));
+                } else {
+                    staging.vertexAssembly.swap(floatVertices);
+                }
+                std::vector<unsigned int> &indexData = staging.indexAssembly;
+                for (size_t i = 0; i < staging.meshEntry.size(); i++) {
+                    const MeshEntry &entry = staging.meshEntry[i];
+                    const unsigned char *first = (const unsigned char *) indices + entry.indexByteOffset;
+                    indexData.resize(std::max<size_t>(indexData.size(), entry.indexOffset + entry.facetCornerNum));
+                    for (unsigned int j = 0; j < entry.facetCornerNum; j++) {
+                        indexData[entry.indexOffset + j] = entry.indexType == GL_UNSIGNED_SHORT
+                                                           ? ((const unsigned short *) first)[j]
+                                                           : ((const unsigned int *) first)[j];
+                    }
+                }
+            }
+            return true;
+        }
+
+    public:
         static bool unloadScene(std::string _name) {
             return allScene.erase(_name) != 0;
         }
@@ -305,41 +796,76 @@ namespace SkeletalMesh {
             return *(find_result->second);
         }
 
-        void recursivelyGetTransf(SkeletonTransf &skTransf, SkeletonModifier &modifier, aiNode *node,
-                                  aiMatrix4x4 parentTransf, const aiMatrix4x4 &invTransf) const {
-            aiMatrix4x4 globalTransf = parentTransf * node->mTransformation;
-            Name2Bone::const_iterator boneFound = nameBoneMap.find(std::string(node->mName.data));
-            if (boneFound != nameBoneMap.end()) {
-                SkeletonModifier::const_iterator boneModFound = modifier.find(std::string(node->mName.data));
-                aiMatrix4x4 boneMod;
-                if (boneModFound != modifier.end()) {
-                    auto trans = glm::transpose(boneModFound->second);
-                    memcpy(&boneMod, &trans, 16 * sizeof(float));
-                    globalTransf *= boneMod;
-                }
-                aiMatrix4x4 finalMtrx = invTransf * globalTransf * skeleton[boneFound->second].localTransf;
-                memcpy(&skTransf[boneFound->second], &finalMtrx.Transpose(), sizeof(skTransf[boneFound->second]));
-            }
-            for (int i = 0; i < node->mNumChildren; i++) {
-                recursivelyGetTransf(skTransf, modifier, node->mChildren[i], globalTransf, invTransf);
-            }
+        const Skeleton &getSkeleton() const { return skeleton; }
+
+        BoneHandle findBone(const std::string &_name) const { return skeleton.findBone(_name); }
+
+        // Keyframe clips of the file, played on modifiers of getSkeleton() through a ClipPlayer
+        const std::vector<AnimationClip> &getAnimations() const { return animation; }
+
+        // NULL if the file has no clip of that name
+        const AnimationClip *findAnimation(const std::string &_name) const {
+            for (size_t i = 0; i < animation.size(); i++)
+                if (animation[i].getName() == _name) return &animation[i];
+            return NULL;
         }
 
-        bool getSkeletonTransform(SkeletonTransf &transf, SkeletonModifier &modifier) const {
+        const std::vector<MeshEntry> &getMeshEntries() const { return meshEntry; }
+
+        // Empty unless the scene was loaded with LoadOptions::retainGeometry.
+        // Indices are relative to the vertexOffset of their MeshEntry.
+        const std::vector<ParametricVertex> &getVertices() const { return vertexData; }
+
+        const std::vector<unsigned int> &getIndices() const { return indexData; }
+
+        // Incremental: only subtrees whose modifier changed since the last call are recomputed,
+        // the resulting palette is modifier.getTransform() and [firstBone, lastBone] are the bones
+        // that need to be re-uploaded.
+        bool updateSkeletonTransform(SkeletonModifier &modifier,
+                                     int *firstBone = NULL, int *lastBone = NULL) const {
             if (!available) return false;
+            return skeleton.update(modifier, firstBone, lastBone);
+        }
 
-            transf.resize(skeleton.size());
+        bool getSkeletonTransform(SkeletonTransf &transf, SkeletonModifier &modifier) const {
+            if (!available) return false;
+            skeleton.update(modifier);
+            transf.assign(modifier.getTransform(), modifier.getTransform() + modifier.boneNum());
+            return !transf.empty();
+        }
 
-            aiMatrix4x4 identityMtrx, invTransf = scene->mRootNode->mTransformation;
-            invTransf.Inverse();
-            recursivelyGetTransf(transf, modifier, scene->mRootNode, identityMtrx, invTransf);
+        // Same pose as a dual quaternion palette, for SKINNING_DUAL_QUATERNION
+        bool getSkeletonTransform(DualQuatTransf &transf, SkeletonModifier &modifier) const {
+            if (!available) return false;
+            skeleton.update(modifier);
+            transf.resize(modifier.boneNum());
+            toDualQuat(modifier.getTransform(), modifier.boneNum(), transf.data());
             return !transf.empty();
         }
 
+        // Which palette and shader variant this scene is meant to be drawn with
+        SkinningMode getSkinningMode() const { return skinningMode; }
+
+        void setSkinningMode(SkinningMode _mode) { skinningMode = _mode; }
+
+        // Asks for enough detail in the streamed diffuse textures to draw the scene about
+        // _screenPixels across, ahead of the streamer's update() for the frame
+        void requestTextureDetail(TextureImage::TextureStreamer &streamer, float _screenPixels) const {
+            if (!available) return;
+            for (size_t i = 0; i < material.size(); i++) streamer.request(*material[i].diffuse, _screenPixels);
+        }
+
+        VertexFormat getVertexFormat() const { return options.vertexFormat; }
+
+        // Sizes and worst quantization error of the packed vertex buffer, zero for VERTEX_FORMAT_FLOAT
+        const VertexPackReport &getPackReport() const { return packReport; }
+
         bool setShaderInput(GLuint program,
                             std::string posiName, std::string texcName, std::string normName,
                             std::string bnidName, std::string bnwtName) {
             if (!available) return false;
+            if (options.vertexFormat == VERTEX_FORMAT_PACKED)
+                return setPackedShaderInput(program, posiName, texcName, normName, bnidName, bnwtName);
 
             ParametricVertex example;
 
@@ -393,6 +919,121 @@ namespace SkeletalMesh {
             return true;
         }
 
+        // Adds the per-instance attributes of an InstanceBuffer to the vertex array, next to the
+        // inputs of setShaderInput: the model matrix as four vec4 columns and the bone base as int
+        bool setInstanceInput(GLuint program, std::string modelName, std::string boneBaseName,
+                              GLuint instanceBuffer) {
+            if (!available) return false;
+            InstanceAttributes example;
+
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+            {
+                GLint modelLoc = glGetAttribLocation(program, modelName.c_str());
+                if (modelLoc >= 0) {
+                    for (int column = 0; column < 4; column++) {
+                        glEnableVertexAttribArray(modelLoc + column);
+                        glVertexAttribPointer(modelLoc + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                                              (const void *) ((char *) &example.model[column] - (char *) &example));
+                        glVertexAttribDivisor(modelLoc + column, 1);
+                    }
+                }
+            }
+            {
+                GLint boneBaseLoc = glGetAttribLocation(program, boneBaseName.c_str());
+                if (boneBaseLoc >= 0) {
+                    glEnableVertexAttribArray(boneBaseLoc);
+                    glVertexAttribIPointer(boneBaseLoc, 1, GL_INT, sizeof(InstanceAttributes),
+                                           (const void *) ((char *) &example.boneBase - (char *) &example));
+                    glVertexAttribDivisor(boneBaseLoc, 1);
+                }
+            }
+
+            glBindVertexArray(0);
+
+            return true;
+        }
+
+    private:
+        // Attributes read the same values as with the float layout, except that in_normal
+        // receives the two octahedral components, see packed_normal_decode_glsl
+        bool setPackedShaderInput(GLuint program,
+                                  std::string posiName, std::string texcName, std::string normName,
+                                  std::string bnidName, std::string bnwtName) {
+            PackedVertex example;
+            char *bone = (char *) example.bone;
+            bool index8 = packedBoneLayout == PACKED_BONE_INDEX8_WEIGHT16;
+
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+            {
+                GLint posiLoc = glGetAttribLocation(program, posiName.c_str());
+                if (posiLoc >= 0) {
+                    glEnableVertexAttribArray(posiLoc);
+                    glVertexAttribPointer(posiLoc, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                                          (const void *) ((char *) example.position - (char *) &example));
+                }
+            }
+            {
+                GLint texcLoc = glGetAttribLocation(program, texcName.c_str());
+                if (texcLoc >= 0) {
+                    glEnableVertexAttribArray(texcLoc);
+                    glVertexAttribPointer(texcLoc, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                                          (const void *) ((char *) example.texcoord - (char *) &example));
+                }
+            }
+            {
+                GLint normLoc = glGetAttribLocation(program, normName.c_str());
+                if (normLoc >= 0) {
+                    glEnableVertexAttribArray(normLoc);
+                    glVertexAttribPointer(normLoc, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                                          (const void *) ((char *) example.normal - (char *) &example));
+                }
+            }
+            {
+                GLint bnidLoc = glGetAttribLocation(program, bnidName.c_str());
+                if (bnidLoc >= 0) {
+                    glEnableVertexAttribArray(bnidLoc);
+                    glVertexAttribIPointer(bnidLoc, SCENE_RESOURCE_BONE_PER_VERTEX,
+                                           index8 ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT, sizeof(PackedVertex),
+                                           (const void *) (bone + PackedVertex::boneIdOffset(packedBoneLayout) -
+                                                           (char *) &example));
+                }
+            }
+            {
+                GLint bnwtLoc = glGetAttribLocation(program, bnwtName.c_str());
+                if (bnwtLoc >= 0) {
+                    glEnableVertexAttribArray(bnwtLoc);
+                    glVertexAttribPointer(bnwtLoc, SCENE_RESOURCE_BONE_PER_VERTEX,
+                                          index8 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, GL_TRUE,
+                                          sizeof(PackedVertex),
+                                          (const void *) (bone + PackedVertex::boneWeightOffset(packedBoneLayout) -
+                                                          (char *) &example));
+                }
+            }
+
+            glBindVertexArray(0);
+
+            return true;
+        }
+
+    public:
+        // Draws the retained geometry through the CPU rasterizer, between its begin() and end().
+        // Needs LoadOptions::retainGeometry and linear blend skinning, false otherwise.
+        bool renderSoftware(SoftRaster::Rasterizer &_raster) const {
+            if (!available || vertexData.empty() || skinningMode != SKINNING_LINEAR_BLEND) return false;
+            for (size_t i = 0; i < meshEntry.size(); i++) {
+                const MeshEntry &entry = meshEntry[i];
+                const Material &entryMaterial = material[entry.materialIndex];
+                _raster.draw(&vertexData[entry.vertexOffset], entry.vertexNum,
+                             &indexData[entry.indexOffset], entry.facetCornerNum,
+                             entryMaterial.image.empty() ? NULL : &entryMaterial.imageView);
+            }
+            return true;
+        }
+
         void render() const {
             if (!available) return;
             glBindVertexArray(vao);
@@ -403,12 +1044,31 @@ namespace SkeletalMesh {
 
                 glDrawElementsBaseVertex(GL_TRIANGLES,
                                          meshEntry[i].facetCornerNum,
-                                         GL_UNSIGNED_INT,
-                                         (void *) (sizeof(unsigned int) * meshEntry[i].indexOffset),
+                                         meshEntry[i].indexType,
+                                         (void *) (size_t) meshEntry[i].indexByteOffset,
                                          meshEntry[i].vertexOffset);
             }
             glBindVertexArray(0);
         }
+
+        // Queues the draws of render() with _program, each drawn _instanceNum times when that is
+        // above 0 for the instances set up by setInstanceInput
+        void submit(RenderQueue &_queue, GLuint _program, GLsizei _instanceNum = 0) const {
+            if (!available) return;
+            for (size_t i = 0; i < meshEntry.size(); i++) {
+                RenderQueue::DrawItem item;
+                item.program = _program;
+                item.vao = vao;
+                item.diffuse = material[meshEntry[i].materialIndex].diffuse;
+                item.diffuseChannel = SCENE_RESOURCE_SHADER_DIFFUSE_CHANNEL;
+                item.indexType = meshEntry[i].indexType;
+                item.indexNum = meshEntry[i].facetCornerNum;
+                item.indexByteOffset = meshEntry[i].indexByteOffset;
+                item.baseVertex = meshEntry[i].vertexOffset;
+                item.instanceNum = _instanceNum;
+                _queue.submit(item);
+            }
+        }
     };
 
     Scene::Name2Scene Scene::allScene;
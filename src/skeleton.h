@@ -0,0 +1,275 @@
+// Flattened Skeleton Hierarchy
+// Baked once from the aiNode tree so that per-frame pose evaluation is a
+// single linear pass over contiguous arrays.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "affine_math.h"
+
+namespace SkeletalMesh {
+    typedef std::vector<glm::fmat4> SkeletonTransf;
+    typedef AffineMath::Affine3x4 Affine3x4;
+
+    inline glm::fmat4 toGlm(const aiMatrix4x4 &_m) {
+        // aiMatrix4x4 is row-major, glm is column-major
+        return glm::transpose(glm::make_mat4(&_m.a1));
+    }
+
+    // Index of a bone node in a Skeleton, resolved once from its name
+    typedef int BoneHandle;
+    const BoneHandle INVALID_BONE = -1;
+
+    class SkeletonModifier;
+
+    struct Skeleton {
+        typedef std::map<std::string, int> Name2Node;
+
+        // Per node, in topological order (a parent always precedes its children),
+        // so that every subtree is a contiguous range of nodes
+        std::vector<int> parent;
+        std::vector<Affine3x4> localBind;
+        std::vector<int> boneId;
+        // Per bone, indexed by bone id
+        std::vector<Affine3x4> offset;
+        // Inverse of the root node transformation, folded into the start of every parent chain
+        Affine3x4 invRoot;
+        // Only consulted when resolving names, never while evaluating a pose
+        Name2Node nameNodeMap;
+
+        Skeleton() : invRoot(AffineMath::identity()) {}
+
+        void clear() {
+            parent.clear();
+            localBind.clear();
+            boneId.clear();
+            offset.clear();
+            invRoot = AffineMath::identity();
+            nameNodeMap.clear();
+        }
+
+        size_t nodeNum() const { return parent.size(); }
+
+        size_t boneNum() const { return offset.size(); }
+
+        int findNode(const std::string &_name) const {
+            Name2Node::const_iterator found = nameNodeMap.find(_name);
+            return found == nameNodeMap.end() ? -1 : found->second;
+        }
+
+        // Modifiers only apply to bone nodes, so only those get a handle
+        BoneHandle findBone(const std::string &_name) const {
+            int node = findNode(_name);
+            return (node >= 0 && boneId[node] >= 0) ? node : INVALID_BONE;
+        }
+
+        // _offset[i] is the offset matrix of bone i, _nameBoneMap maps node names to bone ids
+        void bake(const aiNode *root, const std::vector<aiMatrix4x4> &_offset,
+                  const std::map<std::string, unsigned int> &_nameBoneMap) {
+            clear();
+            if (!root) return;
+
+            offset.reserve(_offset.size());
+            for (size_t i = 0; i < _offset.size(); i++)
+                offset.push_back(AffineMath::fromMat4(toGlm(_offset[i])));
+            invRoot = AffineMath::fromMat4(glm::inverse(toGlm(root->mTransformation)));
+
+            // Depth-first with an explicit stack, children pushed in reverse to keep file order
+            std::vector<std::pair<const aiNode *, int> > stack;
+            stack.push_back(std::make_pair(root, -1));
+            while (!stack.empty()) {
+                const aiNode *node = stack.back().first;
+                int parentIndex = stack.back().second;
+                stack.pop_back();
+
+                int index = (int) parent.size();
+                std::string nodeName(node->mName.data);
+                std::map<std::string, unsigned int>::const_iterator boneFound = _nameBoneMap.find(nodeName);
+                parent.push_back(parentIndex);
+                localBind.push_back(AffineMath::fromMat4(toGlm(node->mTransformation)));
+                boneId.push_back(boneFound == _nameBoneMap.end() ? -1 : (int) boneFound->second);
+                nameNodeMap.insert(std::make_pair(nodeName, index));
+
+                for (int i = (int) node->mNumChildren - 1; i >= 0; i--)
+                    stack.push_back(std::make_pair((const aiNode *) node->mChildren[i], index));
+            }
+        }
+
+        // Brings the cached pose of _modifier up to date, recomputing only the subtrees below nodes
+        // whose local modifier changed since the last call. Returns whether any bone changed,
+        // the changed bone ids are reported as a closed range in firstBone/lastBone.
+        bool update(SkeletonModifier &_modifier, int *firstBone = NULL, int *lastBone = NULL) const;
+    };
+
+    // Where the pose state of one instance lives, nodeNum() entries per node array and
+    // boneNum() entries in transf
+    struct PoseView {
+        glm::fmat4 *local;
+        // localBind * local, premultiplied whenever a modifier is set
+        Affine3x4 *pose;
+        unsigned char *dirty;
+        // Includes the folded inverse root transformation
+        Affine3x4 *global;
+        glm::fmat4 *transf;
+    };
+
+    // Per-instance pose state of a Skeleton: local modifiers addressed by BoneHandle,
+    // per-node dirty bits and the cached global transforms and bone palette.
+    // The state is either owned by the modifier or a view into arrays shared by many
+    // instances, copies always own their state.
+    // Modifiers are expected to be affine, their projective row is ignored.
+    class SkeletonModifier {
+        friend struct Skeleton;
+
+    private:
+        const Skeleton *skeleton;
+        PoseView view;
+        bool anyDirty;
+        std::vector<glm::fmat4> ownedLocal;
+        std::vector<Affine3x4> ownedPose;
+        std::vector<unsigned char> ownedDirty;
+        std::vector<Affine3x4> ownedGlobal;
+        SkeletonTransf ownedTransf;
+
+        void allocate(const Skeleton &_skeleton) {
+            skeleton = &_skeleton;
+            ownedLocal.resize(_skeleton.nodeNum());
+            ownedPose.resize(_skeleton.nodeNum());
+            ownedDirty.resize(_skeleton.nodeNum());
+            ownedGlobal.resize(_skeleton.nodeNum());
+            ownedTransf.resize(_skeleton.boneNum());
+            view.local = ownedLocal.data();
+            view.pose = ownedPose.data();
+            view.dirty = ownedDirty.data();
+            view.global = ownedGlobal.data();
+            view.transf = ownedTransf.data();
+        }
+
+        void copyFrom(const SkeletonModifier &_other) {
+            anyDirty = _other.anyDirty;
+            if (!_other.skeleton) {
+                skeleton = NULL;
+                memset(&view, 0, sizeof(view));
+                return;
+            }
+            allocate(*_other.skeleton);
+            size_t n = skeleton->nodeNum();
+            std::copy(_other.view.local, _other.view.local + n, view.local);
+            std::copy(_other.view.pose, _other.view.pose + n, view.pose);
+            std::copy(_other.view.dirty, _other.view.dirty + n, view.dirty);
+            std::copy(_other.view.global, _other.view.global + n, view.global);
+            std::copy(_other.view.transf, _other.view.transf + skeleton->boneNum(), view.transf);
+        }
+
+        void reset() {
+            size_t n = skeleton->nodeNum();
+            std::fill(view.local, view.local + n, glm::fmat4(1.0f));
+            std::copy(skeleton->localBind.begin(), skeleton->localBind.end(), view.pose);
+            std::fill(view.dirty, view.dirty + n, (unsigned char) 1);
+            std::fill(view.global, view.global + n, AffineMath::identity());
+            std::fill(view.transf, view.transf + skeleton->boneNum(), glm::fmat4(1.0f));
+            anyDirty = true;
+        }
+
+    public:
+        SkeletonModifier() : skeleton(NULL), anyDirty(false) { memset(&view, 0, sizeof(view)); }
+
+        explicit SkeletonModifier(const Skeleton &_skeleton) : skeleton(NULL), anyDirty(false) { bind(_skeleton); }
+
+        SkeletonModifier(const SkeletonModifier &_other) : skeleton(NULL), anyDirty(false) { copyFrom(_other); }
+
+        SkeletonModifier &operator=(const SkeletonModifier &_other) {
+            if (this != &_other) copyFrom(_other);
+            return *this;
+        }
+
+        // Resets every modifier to identity and forces a full recompute on the next update
+        void bind(const Skeleton &_skeleton) {
+            allocate(_skeleton);
+            reset();
+        }
+
+        // Same as above, but the state lives in _view, which must outlive the binding
+        void bind(const Skeleton &_skeleton, const PoseView &_view) {
+            skeleton = &_skeleton;
+            view = _view;
+            reset();
+        }
+
+        const Skeleton *getSkeleton() const { return skeleton; }
+
+        BoneHandle find(const std::string &_name) const {
+            return skeleton ? skeleton->findBone(_name) : INVALID_BONE;
+        }
+
+        const glm::fmat4 &get(BoneHandle _bone) const { return view.local[_bone]; }
+
+        // Writing the value a bone already holds does not mark it dirty
+        void set(BoneHandle _bone, const glm::fmat4 &_m) {
+            if (!skeleton || _bone < 0 || _bone >= (BoneHandle) skeleton->nodeNum() || view.local[_bone] == _m)
+                return;
+            view.local[_bone] = _m;
+            AffineMath::multiply(skeleton->localBind[_bone], AffineMath::fromMat4(_m), view.pose[_bone]);
+            view.dirty[_bone] = 1;
+            anyDirty = true;
+        }
+
+        bool isDirty() const { return anyDirty; }
+
+        size_t boneNum() const { return skeleton ? skeleton->boneNum() : 0; }
+
+        // Bone palette as of the last Skeleton::update, boneNum() matrices
+        const glm::fmat4 *getTransform() const { return view.transf; }
+    };
+
+    inline bool Skeleton::update(SkeletonModifier &_modifier, int *firstBone, int *lastBone) const {
+        if (_modifier.skeleton != this) _modifier.bind(*this);
+
+        int first = (int) offset.size(), last = -1;
+        if (_modifier.anyDirty) {
+            unsigned char *dirty = _modifier.view.dirty;
+            const Affine3x4 *pose = _modifier.view.pose;
+            Affine3x4 *global = _modifier.view.global;
+            size_t n = parent.size();
+            // Dirty subtrees are contiguous ranges, each one goes through the batched kernels at once
+            size_t runBegin = n;
+            for (size_t i = 0; i <= n; i++) {
+                if (i < n) {
+                    // Parents precede children, so dirtiness propagates down in the same pass
+                    int p = parent[i];
+                    if (p >= 0 && dirty[p]) dirty[i] = 1;
+                    if (dirty[i]) {
+                        if (runBegin == n) runBegin = i;
+                        int bone = boneId[i];
+                        if (bone >= 0) {
+                            if (bone < first) first = bone;
+                            if (bone > last) last = bone;
+                        }
+                        continue;
+                    }
+                }
+                if (runBegin < i) {
+                    AffineMath::multiplyParentChain(parent.data(), pose, invRoot, global, runBegin, i);
+                    AffineMath::composePalette(boneId.data(), global, offset.data(), _modifier.view.transf,
+                                               runBegin, i);
+                }
+                runBegin = n;
+            }
+            std::fill(dirty, dirty + n, (unsigned char) 0);
+            _modifier.anyDirty = false;
+        }
+
+        if (firstBone) *firstBone = first;
+        if (lastBone) *lastBone = last;
+        return last >= 0;
+    }
+}
@@ -0,0 +1,171 @@
+#include "skinning.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "affine_math.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SKINNING_X86
+#include <immintrin.h>
+#endif
+
+#if defined(SKINNING_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SKINNING_TARGET_AVX __attribute__((target("avx")))
+#else
+#define SKINNING_TARGET_AVX
+#endif
+
+namespace SkeletalMesh {
+    namespace {
+        typedef void (*Kernel)(const ParametricVertex *, size_t, size_t, const glm::fmat4 *, size_t, float *, float *);
+
+        // Summed in the same order as the shader loop
+        inline float adjustFactor(const ParametricVertex &v) {
+            float adjust = 0.0f;
+            for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++)
+                adjust += v.boneWeight[i] * 0.25f;
+            return adjust;
+        }
+
+        void skinScalar(const ParametricVertex *vertices, size_t begin, size_t end,
+                        const glm::fmat4 *palette, size_t boneNum, float *outPosition, float *outNormal) {
+            for (size_t v = begin; v < end; v++) {
+                const ParametricVertex &vertex = vertices[v];
+                float adjust = adjustFactor(vertex);
+                glm::fmat4 blend(1.0f);
+                if (adjust > 1e-3f) {
+                    blend = glm::fmat4(0.0f);
+                    for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
+                        if (vertex.boneId[i] < boneNum)
+                            blend += palette[vertex.boneId[i]] * (vertex.boneWeight[i] / adjust);
+                    }
+                }
+                glm::fvec4 p = blend * glm::fvec4(vertex.position[0], vertex.position[1], vertex.position[2], 1.0f);
+                outPosition[v * 3 + 0] = p.x / p.w;
+                outPosition[v * 3 + 1] = p.y / p.w;
+                outPosition[v * 3 + 2] = p.z / p.w;
+                if (outNormal) {
+                    glm::fvec3 n = glm::fmat3(blend) * glm::fvec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+                    float length = glm::length(n);
+                    if (length > 0.0f) n /= length;
+                    outNormal[v * 3 + 0] = n.x;
+                    outNormal[v * 3 + 1] = n.y;
+                    outNormal[v * 3 + 2] = n.z;
+                }
+            }
+        }
+
+#ifdef SKINNING_X86
+        inline void store3(float *dst, __m128 v) {
+            float tmp[4];
+            _mm_storeu_ps(tmp, v);
+            dst[0] = tmp[0];
+            dst[1] = tmp[1];
+            dst[2] = tmp[2];
+        }
+
+        // Position divided by w and renormalized normal from the four blended columns
+        inline void finishVertex(const ParametricVertex &vertex, __m128 c0, __m128 c1, __m128 c2, __m128 c3,
+                                 float *position, float *normal) {
+            __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.position[0])),
+                                             _mm_mul_ps(c1, _mm_set1_ps(vertex.position[1]))),
+                                  _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(vertex.position[2])), c3));
+            store3(position, _mm_div_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3))));
+            if (normal) {
+                __m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.normal[0])),
+                                                 _mm_mul_ps(c1, _mm_set1_ps(vertex.normal[1]))),
+                                      _mm_mul_ps(c2, _mm_set1_ps(vertex.normal[2])));
+                // w of the columns is not part of the 3x3
+                n = _mm_and_ps(n, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+                __m128 sq = _mm_mul_ps(n, n);
+                sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+                sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 0, 3, 2)));
+                __m128 length = _mm_sqrt_ps(sq);
+                if (_mm_cvtss_f32(length) > 0.0f) n = _mm_div_ps(n, length);
+                store3(normal, n);
+            }
+        }
+
+        void skinSSE(const ParametricVertex *vertices, size_t begin, size_t end,
+                     const glm::fmat4 *palette, size_t boneNum, float *outPosition, float *outNormal) {
+            for (size_t v = begin; v < end; v++) {
+                const ParametricVertex &vertex = vertices[v];
+                float adjust = adjustFactor(vertex);
+                __m128 c0, c1, c2, c3;
+                if (adjust > 1e-3f) {
+                    c0 = c1 = c2 = c3 = _mm_setzero_ps();
+                    for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
+                        if (vertex.boneId[i] >= boneNum) continue;
+                        const float *m = &palette[vertex.boneId[i]][0][0];
+                        __m128 s = _mm_set1_ps(vertex.boneWeight[i] / adjust);
+                        c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m), s));
+                        c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 4), s));
+                        c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 8), s));
+                        c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(m + 12), s));
+                    }
+                } else {
+                    c0 = _mm_set_ps(0.0f, 0.0f, 0.0f, 1.0f);
+                    c1 = _mm_set_ps(0.0f, 0.0f, 1.0f, 0.0f);
+                    c2 = _mm_set_ps(0.0f, 1.0f, 0.0f, 0.0f);
+                    c3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+                }
+                finishVertex(vertex, c0, c1, c2, c3, outPosition + v * 3, outNormal ? outNormal + v * 3 : NULL);
+            }
+        }
+
+        // Two columns per 256-bit register halves the blend instructions
+        SKINNING_TARGET_AVX
+        void skinAVX(const ParametricVertex *vertices, size_t begin, size_t end,
+                     const glm::fmat4 *palette, size_t boneNum, float *outPosition, float *outNormal) {
+            for (size_t v = begin; v < end; v++) {
+                const ParametricVertex &vertex = vertices[v];
+                float adjust = adjustFactor(vertex);
+                __m256 c01, c23;
+                if (adjust > 1e-3f) {
+                    c01 = c23 = _mm256_setzero_ps();
+                    for (int i = 0; i < SCENE_RESOURCE_BONE_PER_VERTEX; i++) {
+                        if (vertex.boneId[i] >= boneNum) continue;
+                        const float *m = &palette[vertex.boneId[i]][0][0];
+                        __m256 s = _mm256_set1_ps(vertex.boneWeight[i] / adjust);
+                        c01 = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_loadu_ps(m), s));
+                        c23 = _mm256_add_ps(c23, _mm256_mul_ps(_mm256_loadu_ps(m + 8), s));
+                    }
+                } else {
+                    c01 = _mm256_set_ps(0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+                    c23 = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
+                }
+                finishVertex(vertex,
+                             _mm256_castps256_ps128(c01), _mm256_extractf128_ps(c01, 1),
+                             _mm256_castps256_ps128(c23), _mm256_extractf128_ps(c23, 1),
+                             outPosition + v * 3, outNormal ? outNormal + v * 3 : NULL);
+            }
+        }
+#endif
+
+        Kernel kernelFor(AffineMath::Isa _isa) {
+#ifdef SKINNING_X86
+            if (_isa == AffineMath::ISA_AVX) return skinAVX;
+            if (_isa == AffineMath::ISA_SSE) return skinSSE;
+#endif
+            return skinScalar;
+        }
+    }
+
+    void skinVertices(const ParametricVertex *vertices, size_t vertexNum,
+                      const glm::fmat4 *palette, size_t boneNum,
+                      float *outPosition, float *outNormal,
+                      Parallel::ThreadPool *pool) {
+        Kernel kernel = kernelFor(AffineMath::getIsa());
+        size_t chunkNum = (vertexNum + SKINNING_CHUNK_VERTEX_NUM - 1) / SKINNING_CHUNK_VERTEX_NUM;
+        if (!pool || chunkNum <= 1) {
+            kernel(vertices, 0, vertexNum, palette, boneNum, outPosition, outNormal);
+            return;
+        }
+        pool->run(chunkNum, [&](size_t chunk) {
+            size_t begin = chunk * SKINNING_CHUNK_VERTEX_NUM;
+            size_t end = std::min(vertexNum, begin + SKINNING_CHUNK_VERTEX_NUM);
+            kernel(vertices, begin, end, palette, boneNum, outPosition, outNormal);
+        });
+    }
+}
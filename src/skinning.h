@@ -0,0 +1,33 @@
+// CPU Linear Blend Skinning
+// Applies a bone palette to a ParametricVertex stream the same way
+// vertex_shader_330 does, for headless checks, physics queries and as a
+// fallback when there is no GPU.
+
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "parametric_vertex.h"
+#include "thread_pool.h"
+
+namespace SkeletalMesh {
+    // Vertices are handed to the pool in chunks of this size
+    const size_t SKINNING_CHUNK_VERTEX_NUM = 4096;
+
+    // Writes 3 floats per vertex to outPosition and, when it is not NULL, to outNormal.
+    //
+    // Weights are normalized like the shader does, the blended matrix is
+    //     sum(palette[boneId[i]] * boneWeight[i] / adjust_factor), adjust_factor = sum(boneWeight[i] * 0.25)
+    // or identity when adjust_factor <= 1e-3. The shader leaves the resulting scale of 4 in w
+    // and lets the perspective divide cancel it, here positions are divided by w right away.
+    // Normals go through the upper 3x3 of the blended matrix and are renormalized.
+    // Bone ids outside the palette contribute nothing.
+    //
+    // The kernel follows AffineMath::getIsa(), pool may be NULL to skin on the calling thread.
+    void skinVertices(const ParametricVertex *vertices, size_t vertexNum,
+                      const glm::fmat4 *palette, size_t boneNum,
+                      float *outPosition, float *outNormal,
+                      Parallel::ThreadPool *pool = NULL);
+}
@@ -0,0 +1,360 @@
+#include "soft_raster.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "skinning.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFT_RASTER_SSE
+#include <immintrin.h>
+#endif
+
+namespace SoftRaster {
+    namespace {
+        // Vertices closer to the eye plane than this are clipped away
+        const float CLIP_MIN_W = 1e-5f;
+
+        // Window coordinates are snapped to 1/256 pixel, like GL's subpixel precision, so edges
+        // shared by two triangles give both the exact same edge function
+        const float SUBPIXEL_SCALE = 256.0f;
+
+        inline float snap(float _value) {
+            return std::floor(_value * SUBPIXEL_SCALE + 0.5f) / SUBPIXEL_SCALE;
+        }
+
+        inline uint32_t packColor(float _r, float _g, float _b) {
+            uint32_t r = (uint32_t) (std::min(std::max(_r, 0.0f), 1.0f) * 255.0f + 0.5f);
+            uint32_t g = (uint32_t) (std::min(std::max(_g, 0.0f), 1.0f) * 255.0f + 0.5f);
+            uint32_t b = (uint32_t) (std::min(std::max(_b, 0.0f), 1.0f) * 255.0f + 0.5f);
+            return r | (g << 8) | (b << 16) | 0xff000000u;
+        }
+
+        inline float texel(const TextureView &_texture, int _x, int _y, int _channel) {
+            if (_channel >= _texture.channels) return 0.0f;
+            return _texture.pixels[((size_t) _y * _texture.width + _x) * _texture.channels + _channel] / 255.0f;
+        }
+
+        inline int wrap(int _value, int _size) {
+            int wrapped = _value % _size;
+            return wrapped < 0 ? wrapped + _size : wrapped;
+        }
+
+        // GL_LINEAR with GL_REPEAT on the base level
+        uint32_t sampleDiffuse(const TextureView *_texture, float _u, float _v) {
+            if (!_texture || !_texture->pixels || _texture->width <= 0 || _texture->height <= 0)
+                return packColor(0.0f, 0.0f, 0.0f);
+            float s = _u * _texture->width - 0.5f, t = _v * _texture->height - 0.5f;
+            float s0 = std::floor(s), t0 = std::floor(t);
+            float fs = s - s0, ft = t - t0;
+            int x0 = wrap((int) s0, _texture->width), x1 = wrap((int) s0 + 1, _texture->width);
+            int y0 = wrap((int) t0, _texture->height), y1 = wrap((int) t0 + 1, _texture->height);
+            float rgb[3];
+            for (int c = 0; c < 3; c++) {
+                float bottom = texel(*_texture, x0, y0, c) * (1.0f - fs) + texel(*_texture, x1, y0, c) * fs;
+                float top = texel(*_texture, x0, y1, c) * (1.0f - fs) + texel(*_texture, x1, y1, c) * fs;
+                rgb[c] = bottom * (1.0f - ft) + top * ft;
+            }
+            return packColor(rgb[0], rgb[1], rgb[2]);
+        }
+
+        inline bool inside(float _e, bool _topLeft) {
+            return _e > 0.0f || (_e == 0.0f && _topLeft);
+        }
+    }
+
+    void Target::resize(int _width, int _height) {
+        width = std::max(_width, 0);
+        height = std::max(_height, 0);
+        color.assign((size_t) width * height, 0);
+        depth.assign((size_t) width * height, 1.0f);
+    }
+
+    void Target::clear(const glm::fvec4 &_color, float _depth) {
+        uint32_t packed = packColor(_color.r, _color.g, _color.b) & 0x00ffffffu;
+        packed |= (uint32_t) (std::min(std::max(_color.a, 0.0f), 1.0f) * 255.0f + 0.5f) << 24;
+        std::fill(color.begin(), color.end(), packed);
+        std::fill(depth.begin(), depth.end(), _depth);
+    }
+
+    Rasterizer::Rasterizer(Parallel::ThreadPool *_pool)
+            : pool(_pool), target(NULL), palette(NULL), boneNum(0), shading(SHADE_TEXCOORD),
+              tileColumns(0), tileRows(0) {
+        stats = Stats();
+    }
+
+    void Rasterizer::begin(Target &_target, const glm::fmat4 &_mvp, const glm::fmat4 *_palette, size_t _boneNum,
+                           Shading _shading) {
+        target = &_target;
+        mvp = _mvp;
+        palette = _palette;
+        boneNum = _boneNum;
+        shading = _shading;
+        tileColumns = (target->width + TILE_SIZE - 1) / TILE_SIZE;
+        tileRows = (target->height + TILE_SIZE - 1) / TILE_SIZE;
+        bins.resize((size_t) tileColumns * tileRows);
+        for (size_t i = 0; i < bins.size(); i++) bins[i].clear();
+        triangles.clear();
+        stats = Stats();
+    }
+
+    void Rasterizer::draw(const SkeletalMesh::ParametricVertex *_vertices, size_t _vertexNum,
+                          const unsigned int *_indices, size_t _indexNum, const TextureView *_diffuse) {
+        if (!target || !_vertexNum) return;
+
+        // The vertex stage of vertex_shader_330, positions come back divided by the weight scale
+        skinned.resize(_vertexNum * 3);
+        SkeletalMesh::skinVertices(_vertices, _vertexNum, palette, boneNum, skinned.data(), NULL, pool);
+        clipped.resize(_vertexNum);
+        for (size_t i = 0; i < _vertexNum; i++) {
+            clipped[i].position = mvp * glm::fvec4(skinned[i * 3], skinned[i * 3 + 1], skinned[i * 3 + 2], 1.0f);
+            clipped[i].texcoord = glm::fvec2(_vertices[i].texcoord[0], _vertices[i].texcoord[1]);
+        }
+        stats.vertexNum += _vertexNum;
+
+        for (size_t i = 0; i + 2 < _indexNum; i += 3) {
+            unsigned int i0 = _indices[i], i1 = _indices[i + 1], i2 = _indices[i + 2];
+            if (i0 >= _vertexNum || i1 >= _vertexNum || i2 >= _vertexNum) continue;
+            clipAndSetup(clipped[i0], clipped[i1], clipped[i2], _diffuse);
+            stats.triangleNum++;
+        }
+    }
+
+    void Rasterizer::clipAndSetup(const ClipVertex &_v0, const ClipVertex &_v1, const ClipVertex &_v2,
+                                  const TextureView *_diffuse) {
+        const ClipVertex *v[3] = {&_v0, &_v1, &_v2};
+        // Entirely outside one plane of the view volume
+        for (int axis = 0; axis < 3; axis++) {
+            bool below = true, above = true;
+            for (int i = 0; i < 3; i++) {
+                below = below && v[i]->position[axis] < -v[i]->position.w;
+                above = above && v[i]->position[axis] > v[i]->position.w;
+            }
+            if (below || above) return;
+        }
+
+        if (_v0.position.w >= CLIP_MIN_W && _v1.position.w >= CLIP_MIN_W && _v2.position.w >= CLIP_MIN_W) {
+            ClipVertex corners[3] = {_v0, _v1, _v2};
+            setup(corners, _diffuse);
+            return;
+        }
+
+        // Against the near plane, a triangle becomes a polygon of up to four corners
+        ClipVertex polygon[4];
+        int cornerNum = 0;
+        for (int i = 0; i < 3; i++) {
+            const ClipVertex &from = *v[i], &to = *v[(i + 1) % 3];
+            bool fromInside = from.position.w >= CLIP_MIN_W, toInside = to.position.w >= CLIP_MIN_W;
+            if (fromInside) polygon[cornerNum++] = from;
+            if (fromInside != toInside) {
+                float t = (CLIP_MIN_W - from.position.w) / (to.position.w - from.position.w);
+                polygon[cornerNum].position = glm::mix(from.position, to.position, t);
+                polygon[cornerNum].texcoord = glm::mix(from.texcoord, to.texcoord, t);
+                cornerNum++;
+            }
+        }
+        for (int i = 1; i + 1 < cornerNum; i++) {
+            ClipVertex corners[3] = {polygon[0], polygon[i], polygon[i + 1]};
+            setup(corners, _diffuse);
+        }
+    }
+
+    void Rasterizer::setup(const ClipVertex *_v, const TextureView *_diffuse) {
+        float x[3], y[3];
+        Triangle triangle;
+        for (int i = 0; i < 3; i++) {
+            float invW = 1.0f / _v[i].position.w;
+            x[i] = snap((_v[i].position.x * invW * 0.5f + 0.5f) * target->width);
+            y[i] = snap((_v[i].position.y * invW * 0.5f + 0.5f) * target->height);
+            triangle.z[i] = _v[i].position.z * invW * 0.5f + 0.5f;
+            triangle.invW[i] = invW;
+            triangle.u[i] = _v[i].texcoord.x * invW;
+            triangle.v[i] = _v[i].texcoord.y * invW;
+        }
+
+        // No face is culled, clockwise triangles are turned around
+        double area = ((double) x[1] - x[0]) * ((double) y[2] - y[0]) - ((double) x[2] - x[0]) * ((double) y[1] - y[0]);
+        if (area == 0.0 || !std::isfinite(area)) return;
+        if (area < 0.0) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(triangle.z[1], triangle.z[2]);
+            std::swap(triangle.invW[1], triangle.invW[2]);
+            std::swap(triangle.u[1], triangle.u[2]);
+            std::swap(triangle.v[1], triangle.v[2]);
+            area = -area;
+        }
+        for (int i = 0; i < 3; i++) {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            triangle.a[i] = y[j] - y[k];
+            triangle.b[i] = x[k] - x[j];
+            triangle.c[i] = (double) x[j] * y[k] - (double) x[k] * y[j];
+            triangle.topLeft[i] = triangle.a[i] > 0.0f || (triangle.a[i] == 0.0f && triangle.b[i] < 0.0f);
+        }
+        triangle.invArea = (float) (1.0 / area);
+
+        // Pixels whose centers may be covered
+        float minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+        float minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+        triangle.minX = (int) std::max(std::ceil(minX - 0.5f), 0.0f);
+        triangle.minY = (int) std::max(std::ceil(minY - 0.5f), 0.0f);
+        triangle.maxX = (int) std::min(std::floor(maxX - 0.5f), (float) target->width - 1);
+        triangle.maxY = (int) std::min(std::floor(maxY - 0.5f), (float) target->height - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) return;
+        triangle.diffuse = _diffuse;
+
+        uint32_t index = (uint32_t) triangles.size();
+        triangles.push_back(triangle);
+        stats.setupTriangleNum++;
+        for (int row = triangle.minY / TILE_SIZE; row <= triangle.maxY / TILE_SIZE; row++) {
+            for (int column = triangle.minX / TILE_SIZE; column <= triangle.maxX / TILE_SIZE; column++) {
+                bins[(size_t) row * tileColumns + column].push_back(index);
+                stats.binnedTriangleNum++;
+            }
+        }
+    }
+
+    void Rasterizer::end() {
+        if (!target) return;
+        std::vector<int> order;
+        for (size_t i = 0; i < bins.size(); i++)
+            if (!bins[i].empty()) order.push_back((int) i);
+        // The pool deals tasks round-robin, the fullest tiles go first
+        std::stable_sort(order.begin(), order.end(), [this](int _a, int _b) {
+            return bins[_a].size() > bins[_b].size();
+        });
+
+        std::vector<size_t> shaded(order.size(), 0);
+        Parallel::ThreadPool::Task task = [this, &order, &shaded](size_t _i) {
+            shaded[_i] = rasterizeTile(order[_i]);
+        };
+        if (pool) {
+            pool->run(order.size(), task);
+        } else {
+            for (size_t i = 0; i < order.size(); i++) task(i);
+        }
+        for (size_t i = 0; i < shaded.size(); i++) stats.shadedPixelNum += shaded[i];
+        target = NULL;
+    }
+
+    size_t Rasterizer::rasterizeTile(int _tile) const {
+        const int tileX = (_tile % tileColumns) * TILE_SIZE, tileY = (_tile / tileColumns) * TILE_SIZE;
+        const int width = target->width;
+        const int lastX = std::min(tileX + TILE_SIZE, width) - 1;
+        const int lastY = std::min(tileY + TILE_SIZE, target->height) - 1;
+        uint32_t *color = target->color.data();
+        float *depth = target->depth.data();
+        size_t shadedNum = 0;
+
+        const std::vector<uint32_t> &bin = bins[_tile];
+        for (size_t n = 0; n < bin.size(); n++) {
+            const Triangle &t = triangles[bin[n]];
+            int x0 = std::max(t.minX, tileX) & ~3, x1 = std::min(t.maxX, lastX);
+            int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, lastY);
+            // Edge functions at the tile origin, in double so that they stay exact negations of
+            // the ones a neighbour computes for the same edge
+            float tileC[3];
+            for (int i = 0; i < 3; i++)
+                tileC[i] = (float) (t.c[i] + (double) t.a[i] * tileX + (double) t.b[i] * tileY);
+
+            // One pixel, for the scalar build and groups that cross the right end of the target
+            auto shadePixel = [&](int _x, int _y, float _e0, float _e1, float _e2) {
+                if (!inside(_e0, t.topLeft[0]) || !inside(_e1, t.topLeft[1]) || !inside(_e2, t.topLeft[2]))
+                    return;
+                float l0 = _e0 * t.invArea, l1 = _e1 * t.invArea, l2 = _e2 * t.invArea;
+                float z = l0 * t.z[0] + l1 * t.z[1] + l2 * t.z[2];
+                size_t pixel = (size_t) _y * width + _x;
+                if (!(z >= 0.0f && z <= 1.0f && z < depth[pixel])) return;
+                float w = 1.0f / (l0 * t.invW[0] + l1 * t.invW[1] + l2 * t.invW[2]);
+                float u = (l0 * t.u[0] + l1 * t.u[1] + l2 * t.u[2]) * w;
+                float v = (l0 * t.v[0] + l1 * t.v[1] + l2 * t.v[2]) * w;
+                depth[pixel] = z;
+                color[pixel] = shading == SHADE_DIFFUSE ? sampleDiffuse(t.diffuse, u, v) : packColor(u, v, 0.0f);
+                shadedNum++;
+            };
+
+            for (int y = y0; y <= y1; y++) {
+                float dy = (float) (y - tileY) + 0.5f;
+                float rowE[3];
+                for (int i = 0; i < 3; i++) rowE[i] = tileC[i] + t.b[i] * dy;
+#ifdef SOFT_RASTER_SSE
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 laneOffset = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+                __m128 a[3], e0[3], topLeft[3];
+                for (int i = 0; i < 3; i++) {
+                    a[i] = _mm_set1_ps(t.a[i]);
+                    e0[i] = _mm_set1_ps(rowE[i]);
+                    topLeft[i] = t.topLeft[i] ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+                }
+                int x = x0;
+                for (; x + 3 < width && x <= x1; x += 4) {
+                    __m128 dx = _mm_add_ps(_mm_set1_ps((float) (x - tileX)), laneOffset);
+                    __m128 e[3], mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int i = 0; i < 3; i++) {
+                        e[i] = _mm_add_ps(e0[i], _mm_mul_ps(a[i], dx));
+                        __m128 covered = _mm_or_ps(_mm_cmpgt_ps(e[i], zero),
+                                                   _mm_and_ps(_mm_cmpeq_ps(e[i], zero), topLeft[i]));
+                        mask = _mm_and_ps(mask, covered);
+                    }
+                    if (!_mm_movemask_ps(mask)) continue;
+
+                    __m128 invArea = _mm_set1_ps(t.invArea);
+                    __m128 l0 = _mm_mul_ps(e[0], invArea), l1 = _mm_mul_ps(e[1], invArea),
+                            l2 = _mm_mul_ps(e[2], invArea);
+                    __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(t.z[0])),
+                                                     _mm_mul_ps(l1, _mm_set1_ps(t.z[1]))),
+                                          _mm_mul_ps(l2, _mm_set1_ps(t.z[2])));
+                    size_t pixel = (size_t) y * width + x;
+                    __m128 oldDepth = _mm_loadu_ps(depth + pixel);
+                    mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, _mm_set1_ps(1.0f))));
+                    mask = _mm_and_ps(mask, _mm_cmplt_ps(z, oldDepth));
+                    int lanes = _mm_movemask_ps(mask);
+                    if (!lanes) continue;
+
+                    __m128 w = _mm_div_ps(_mm_set1_ps(1.0f),
+                                          _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(t.invW[0])),
+                                                                _mm_mul_ps(l1, _mm_set1_ps(t.invW[1]))),
+                                                     _mm_mul_ps(l2, _mm_set1_ps(t.invW[2]))));
+                    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(t.u[0])),
+                                                                _mm_mul_ps(l1, _mm_set1_ps(t.u[1]))),
+                                                     _mm_mul_ps(l2, _mm_set1_ps(t.u[2]))), w);
+                    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(t.v[0])),
+                                                                _mm_mul_ps(l1, _mm_set1_ps(t.v[1]))),
+                                                     _mm_mul_ps(l2, _mm_set1_ps(t.v[2]))), w);
+                    __m128i shadedColor;
+                    if (shading == SHADE_DIFFUSE) {
+                        alignas(16) float us[4], vs[4];
+                        alignas(16) uint32_t colors[4] = {0, 0, 0, 0};
+                        _mm_store_ps(us, u);
+                        _mm_store_ps(vs, v);
+                        for (int lane = 0; lane < 4; lane++)
+                            if (lanes & (1 << lane)) colors[lane] = sampleDiffuse(t.diffuse, us[lane], vs[lane]);
+                        shadedColor = _mm_load_si128((const __m128i *) colors);
+                    } else {
+                        const __m128 one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+                        __m128i r = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(u, zero), one), scale), half));
+                        __m128i g = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(v, zero), one), scale), half));
+                        shadedColor = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                                                   _mm_set1_epi32((int) 0xff000000u));
+                    }
+
+                    __m128i laneMask = _mm_castps_si128(mask);
+                    __m128i oldColor = _mm_loadu_si128((const __m128i *) (color + pixel));
+                    _mm_storeu_si128((__m128i *) (color + pixel),
+                                     _mm_or_si128(_mm_and_si128(laneMask, shadedColor),
+                                                  _mm_andnot_si128(laneMask, oldColor)));
+                    _mm_storeu_ps(depth + pixel, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, oldDepth)));
+                    shadedNum += (lanes & 1) + ((lanes >> 1) & 1) + ((lanes >> 2) & 1) + ((lanes >> 3) & 1);
+                }
+#else
+                int x = x0;
+#endif
+                for (; x <= x1; x++) {
+                    float dx = (float) (x - tileX) + 0.5f;
+                    shadePixel(x, y, rowE[0] + t.a[0] * dx, rowE[1] + t.a[1] * dx, rowE[2] + t.a[2] * dx);
+                }
+            }
+        }
+        return shadedNum;
+    }
+}
@@ -0,0 +1,155 @@
+// Tile-Based Software Rasterizer
+// A CPU backend for skinned meshes, for render nodes without a GPU. Vertices are
+// skinned like vertex_shader_330 and transformed to clip space, triangles are
+// clipped against the near plane, set up and binned into screen tiles in draw
+// order. end() then rasterizes the tiles in parallel on a ThreadPool: every tile
+// walks its triangles with edge functions, four pixels at a time, interpolates
+// depth linearly and texcoords perspective-correct, depth tests with GL_LESS and
+// shades like fragment_shader_330.
+//
+// Coverage follows the top-left rule on a shared edge, so meshes are watertight.
+// Results match the GL path up to rasterization details GL leaves open, a few
+// pixels along edges and a unit of color rounding.
+//
+//     SoftRaster::Target target;   target.resize(800, 800);   target.clear(background);
+//     SoftRaster::Rasterizer raster;
+//     raster.begin(target, mvp, palette, boneNum, SoftRaster::SHADE_TEXCOORD);
+//     raster.draw(vertices, vertexNum, indices, indexNum);   ...
+//     raster.end();   target.getPixels() ...
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "parametric_vertex.h"
+#include "thread_pool.h"
+
+namespace SoftRaster {
+    // Pixels across and up a tile, a multiple of 4
+    const int TILE_SIZE = 64;
+
+    // What fragment_shader_330 writes: the texcoord as red and green, or the diffuse texture
+    // when it is built with DIFFUSE_TEXTURE_MAPPING
+    enum Shading {
+        SHADE_TEXCOORD = 0,
+        SHADE_DIFFUSE
+    };
+
+    // Color and depth of a frame. Pixels are laid out like glReadPixels returns them,
+    // RGBA8 rows from the bottom up.
+    class Target {
+    public:
+        Target() : width(0), height(0) {}
+
+        void resize(int _width, int _height);
+
+        void clear(const glm::fvec4 &_color, float _depth = 1.0f);
+
+        int getWidth() const { return width; }
+
+        int getHeight() const { return height; }
+
+        const unsigned char *getPixels() const { return (const unsigned char *) color.data(); }
+
+    private:
+        friend class Rasterizer;
+
+        int width;
+        int height;
+        std::vector<uint32_t> color;
+        std::vector<float> depth;
+    };
+
+    // A diffuse texture as decoded by TextureImage::Image, bottom row first. Sampled bilinearly
+    // with repeat on both axes, like the GL textures of the scene.
+    struct TextureView {
+        int width;
+        int height;
+        int channels;
+        const unsigned char *pixels;
+    };
+
+    class Rasterizer {
+    public:
+        struct Stats {
+            size_t vertexNum;
+            // Triangles drawn, triangles left after culling and clipping, and their tile bins
+            size_t triangleNum;
+            size_t setupTriangleNum;
+            size_t binnedTriangleNum;
+            // Fragments that passed the depth test
+            size_t shadedPixelNum;
+        };
+
+        // _pool may be NULL to do everything on the calling thread
+        explicit Rasterizer(Parallel::ThreadPool *_pool = &Parallel::ThreadPool::shared());
+
+        // Starts a frame into _target, which must stay alive until end(). _palette holds
+        // the bone transforms as uploaded to u_bone_transf.
+        void begin(Target &_target, const glm::fmat4 &_mvp, const glm::fmat4 *_palette, size_t _boneNum,
+                   Shading _shading = SHADE_TEXCOORD);
+
+        // Skins, sets up and bins one indexed triangle list, the arrays may go right after.
+        // _diffuse must stay alive until end(), NULL samples black as an unbound GL texture does.
+        void draw(const SkeletalMesh::ParametricVertex *_vertices, size_t _vertexNum,
+                  const unsigned int *_indices, size_t _indexNum, const TextureView *_diffuse = NULL);
+
+        // Rasterizes every tile
+        void end();
+
+        const Stats &getStats() const { return stats; }
+
+    private:
+        // In window coordinates, already normalized to counter-clockwise
+        struct Triangle {
+            // Edge i, opposite vertex i, is a * x + b * y + c, positive inside
+            float a[3];
+            float b[3];
+            double c[3];
+            bool topLeft[3];
+            float invArea;
+            // Per vertex: window depth, 1 / w, and the texcoord divided by w
+            float z[3];
+            float invW[3];
+            float u[3];
+            float v[3];
+            // Covered pixels lie in [minX, maxX] x [minY, maxY]
+            int minX;
+            int minY;
+            int maxX;
+            int maxY;
+            const TextureView *diffuse;
+        };
+
+        struct ClipVertex {
+            glm::fvec4 position;
+            glm::fvec2 texcoord;
+        };
+
+        Parallel::ThreadPool *pool;
+        Target *target;
+        glm::fmat4 mvp;
+        const glm::fmat4 *palette;
+        size_t boneNum;
+        Shading shading;
+        int tileColumns;
+        int tileRows;
+        std::vector<Triangle> triangles;
+        // Per tile, indices into triangles in draw order
+        std::vector<std::vector<uint32_t> > bins;
+        std::vector<float> skinned;
+        std::vector<ClipVertex> clipped;
+        Stats stats;
+
+        void setup(const ClipVertex *_v, const TextureView *_diffuse);
+
+        void clipAndSetup(const ClipVertex &_v0, const ClipVertex &_v1, const ClipVertex &_v2,
+                          const TextureView *_diffuse);
+
+        size_t rasterizeTile(int _tile) const;
+    };
+}
@@ -0,0 +1,398 @@
+#include "texture_bake.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace TextureBake {
+    namespace {
+        struct Info {
+            uint32_t format;
+            uint32_t width;
+            uint32_t height;
+            uint32_t levelNum;
+        };
+
+        uint16_t packRGB565(const float _color[3]) {
+            int r = std::min(31, std::max(0, (int) std::lround(_color[0] * 31.0f / 255.0f)));
+            int g = std::min(63, std::max(0, (int) std::lround(_color[1] * 63.0f / 255.0f)));
+            int b = std::min(31, std::max(0, (int) std::lround(_color[2] * 31.0f / 255.0f)));
+            return (uint16_t) ((r << 11) | (g << 5) | b);
+        }
+
+        void unpackRGB565(uint16_t _packed, int _color[3]) {
+            int r = (_packed >> 11) & 31, g = (_packed >> 5) & 63, b = _packed & 31;
+            _color[0] = (r << 3) | (r >> 2);
+            _color[1] = (g << 2) | (g >> 4);
+            _color[2] = (b << 3) | (b >> 2);
+        }
+
+        // Four colours of a block whose first endpoint is the greater one
+        void colorPalette(uint16_t _c0, uint16_t _c1, int _palette[4][3]) {
+            unpackRGB565(_c0, _palette[0]);
+            unpackRGB565(_c1, _palette[1]);
+            for (int c = 0; c < 3; c++) {
+                _palette[2][c] = (2 * _palette[0][c] + _palette[1][c]) / 3;
+                _palette[3][c] = (_palette[0][c] + 2 * _palette[1][c]) / 3;
+            }
+        }
+
+        // Nearest palette entry per pixel, returns the summed squared error
+        int assignColorIndices(const unsigned char _rgba[64], const int _palette[4][3], unsigned char _indices[16]) {
+            int total = 0;
+            for (int p = 0; p < 16; p++) {
+                int best = 0, bestError = 1 << 30;
+                for (int i = 0; i < 4; i++) {
+                    int error = 0;
+                    for (int c = 0; c < 3; c++) {
+                        int d = _rgba[p * 4 + c] - _palette[i][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        best = i;
+                    }
+                }
+                _indices[p] = (unsigned char) best;
+                total += bestError;
+            }
+            return total;
+        }
+
+        int fitColorEndpoints(const unsigned char _rgba[64], const float _max[3], const float _min[3],
+                              uint16_t &_c0, uint16_t &_c1, unsigned char _indices[16]) {
+            _c0 = packRGB565(_max);
+            _c1 = packRGB565(_min);
+            if (_c0 < _c1) std::swap(_c0, _c1);
+            int palette[4][3];
+            colorPalette(_c0, _c1, palette);
+            return assignColorIndices(_rgba, palette, _indices);
+        }
+
+        // Endpoints along the principal axis of the block's colours, then one least squares
+        // refinement of both endpoints given the chosen indices
+        void encodeColor(const unsigned char _rgba[64], unsigned char _out[8]) {
+            float mean[3] = {0.0f, 0.0f, 0.0f};
+            for (int p = 0; p < 16; p++)
+                for (int c = 0; c < 3; c++) mean[c] += _rgba[p * 4 + c] / 16.0f;
+            float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+            for (int p = 0; p < 16; p++) {
+                float d[3] = {_rgba[p * 4] - mean[0], _rgba[p * 4 + 1] - mean[1], _rgba[p * 4 + 2] - mean[2]};
+                cov[0] += d[0] * d[0];
+                cov[1] += d[0] * d[1];
+                cov[2] += d[0] * d[2];
+                cov[3] += d[1] * d[1];
+                cov[4] += d[1] * d[2];
+                cov[5] += d[2] * d[2];
+            }
+            float axis[3] = {1.0f, 1.0f, 1.0f};
+            for (int iteration = 0; iteration < 8; iteration++) {
+                float next[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                                 cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                                 cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+                float length = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::fabs(next[2]));
+                if (length < 1e-6f) break;
+                for (int c = 0; c < 3; c++) axis[c] = next[c] / length;
+            }
+            float lowest = 1e30f, highest = -1e30f;
+            for (int p = 0; p < 16; p++) {
+                float t = 0.0f;
+                for (int c = 0; c < 3; c++) t += (_rgba[p * 4 + c] - mean[c]) * axis[c];
+                lowest = std::min(lowest, t);
+                highest = std::max(highest, t);
+            }
+            float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+            float inset = (highest - lowest) / 16.0f;
+            float maxColor[3], minColor[3];
+            for (int c = 0; c < 3; c++) {
+                maxColor[c] = mean[c] + axis[c] * (highest - inset) / axisLength2;
+                minColor[c] = mean[c] + axis[c] * (lowest + inset) / axisLength2;
+            }
+
+            uint16_t c0, c1;
+            unsigned char indices[16];
+            int error = fitColorEndpoints(_rgba, maxColor, minColor, c0, c1, indices);
+
+            if (error > 0 && c0 != c1) {
+                // Solves for the endpoints that reproduce the pixels best with these indices
+                const float weight[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+                float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+                for (int p = 0; p < 16; p++) {
+                    float a = weight[indices[p]], b = 1.0f - a;
+                    aa += a * a;
+                    ab += a * b;
+                    bb += b * b;
+                    for (int c = 0; c < 3; c++) {
+                        ax[c] += a * _rgba[p * 4 + c];
+                        bx[c] += b * _rgba[p * 4 + c];
+                    }
+                }
+                float det = aa * bb - ab * ab;
+                if (std::fabs(det) > 1e-6f) {
+                    float refinedMax[3], refinedMin[3];
+                    for (int c = 0; c < 3; c++) {
+                        refinedMax[c] = (ax[c] * bb - bx[c] * ab) / det;
+                        refinedMin[c] = (bx[c] * aa - ax[c] * ab) / det;
+                    }
+                    uint16_t r0, r1;
+                    unsigned char refinedIndices[16];
+                    int refinedError = fitColorEndpoints(_rgba, refinedMax, refinedMin, r0, r1, refinedIndices);
+                    if (refinedError < error) {
+                        c0 = r0;
+                        c1 = r1;
+                        memcpy(indices, refinedIndices, sizeof(indices));
+                    }
+                }
+            }
+
+            uint32_t bits = 0;
+            for (int p = 0; p < 16; p++) bits |= (uint32_t) (c0 == c1 ? 0 : indices[p]) << (2 * p);
+            _out[0] = (unsigned char) (c0 & 0xff);
+            _out[1] = (unsigned char) (c0 >> 8);
+            _out[2] = (unsigned char) (c1 & 0xff);
+            _out[3] = (unsigned char) (c1 >> 8);
+            for (int i = 0; i < 4; i++) _out[4 + i] = (unsigned char) (bits >> (8 * i));
+        }
+
+        void alphaPalette(int _a0, int _a1, int _palette[8]) {
+            _palette[0] = _a0;
+            _palette[1] = _a1;
+            if (_a0 > _a1) {
+                for (int i = 1; i < 7; i++) _palette[i + 1] = ((7 - i) * _a0 + i * _a1) / 7;
+            } else {
+                for (int i = 1; i < 5; i++) _palette[i + 1] = ((5 - i) * _a0 + i * _a1) / 5;
+                _palette[6] = 0;
+                _palette[7] = 255;
+            }
+        }
+
+        // Pixels of block (_bx, _by), blocks past the edge repeat its last row and column
+        void readBlock(const std::vector<unsigned char> &_rgba, unsigned int _width, unsigned int _height,
+                       unsigned int _bx, unsigned int _by, unsigned char _block[64]) {
+            for (unsigned int y = 0; y < 4; y++) {
+                unsigned int sy = std::min(_by * 4 + y, _height - 1);
+                for (unsigned int x = 0; x < 4; x++) {
+                    unsigned int sx = std::min(_bx * 4 + x, _width - 1);
+                    memcpy(_block + (y * 4 + x) * 4, &_rgba[((size_t) sy * _width + sx) * 4], 4);
+                }
+            }
+        }
+
+        // Half size, averaging 2x2 pixels; an odd edge repeats its last pixel
+        void downsample(const std::vector<unsigned char> &_src, unsigned int _width, unsigned int _height,
+                        std::vector<unsigned char> &_dst, unsigned int &_dstWidth, unsigned int &_dstHeight) {
+            _dstWidth = std::max(1u, _width / 2);
+            _dstHeight = std::max(1u, _height / 2);
+            _dst.resize((size_t) _dstWidth * _dstHeight * 4);
+            for (unsigned int y = 0; y < _dstHeight; y++) {
+                unsigned int y0 = std::min(2 * y, _height - 1), y1 = std::min(2 * y + 1, _height - 1);
+                for (unsigned int x = 0; x < _dstWidth; x++) {
+                    unsigned int x0 = std::min(2 * x, _width - 1), x1 = std::min(2 * x + 1, _width - 1);
+                    for (int c = 0; c < 4; c++) {
+                        unsigned int sum = _src[((size_t) y0 * _width + x0) * 4 + c] +
+                                           _src[((size_t) y0 * _width + x1) * 4 + c] +
+                                           _src[((size_t) y1 * _width + x0) * 4 + c] +
+                                           _src[((size_t) y1 * _width + x1) * 4 + c];
+                        _dst[((size_t) y * _dstWidth + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        size_t levelBytes(BlockFormat _format, unsigned int _width, unsigned int _height) {
+            return (size_t) ((_width + 3) / 4) * ((_height + 3) / 4) * blockBytes(_format);
+        }
+    }
+
+    void encodeBlockBC1(const unsigned char _rgba[64], unsigned char _out[8]) {
+        encodeColor(_rgba, _out);
+    }
+
+    void encodeBlockBC3(const unsigned char _rgba[64], unsigned char _out[16]) {
+        int a0 = 0, a1 = 255;
+        for (int p = 0; p < 16; p++) {
+            a0 = std::max(a0, (int) _rgba[p * 4 + 3]);
+            a1 = std::min(a1, (int) _rgba[p * 4 + 3]);
+        }
+        int palette[8];
+        alphaPalette(a0, a1, palette);
+        uint64_t bits = 0;
+        if (a0 != a1) {
+            for (int p = 0; p < 16; p++) {
+                int best = 0, bestError = 1 << 30;
+                for (int i = 0; i < 8; i++) {
+                    int error = std::abs(_rgba[p * 4 + 3] - palette[i]);
+                    if (error < bestError) {
+                        bestError = error;
+                        best = i;
+                    }
+                }
+                bits |= (uint64_t) best << (3 * p);
+            }
+        }
+        _out[0] = (unsigned char) a0;
+        _out[1] = (unsigned char) a1;
+        for (int i = 0; i < 6; i++) _out[2 + i] = (unsigned char) (bits >> (8 * i));
+        encodeColor(_rgba, _out + 8);
+    }
+
+    void decodeBlockBC1(const unsigned char _block[8], unsigned char _rgba[64]) {
+        uint16_t c0 = (uint16_t) (_block[0] | (_block[1] << 8)), c1 = (uint16_t) (_block[2] | (_block[3] << 8));
+        int palette[4][3];
+        colorPalette(c0, c1, palette);
+        bool transparent = c0 <= c1;
+        if (transparent) {
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        uint32_t bits = _block[4] | (_block[5] << 8) | (_block[6] << 16) | ((uint32_t) _block[7] << 24);
+        for (int p = 0; p < 16; p++) {
+            int index = (bits >> (2 * p)) & 3;
+            for (int c = 0; c < 3; c++) _rgba[p * 4 + c] = (unsigned char) palette[index][c];
+            _rgba[p * 4 + 3] = transparent && index == 3 ? 0 : 255;
+        }
+    }
+
+    void decodeBlockBC3(const unsigned char _block[16], unsigned char _rgba[64]) {
+        // The colour half of BC3 always has four colours
+        uint16_t c0 = (uint16_t) (_block[8] | (_block[9] << 8)), c1 = (uint16_t) (_block[10] | (_block[11] << 8));
+        int palette[4][3];
+        colorPalette(c0, c1, palette);
+        uint32_t colorBits = _block[12] | (_block[13] << 8) | (_block[14] << 16) | ((uint32_t) _block[15] << 24);
+        int alpha[8];
+        alphaPalette(_block[0], _block[1], alpha);
+        uint64_t alphaBits = 0;
+        for (int i = 0; i < 6; i++) alphaBits |= (uint64_t) _block[2 + i] << (8 * i);
+        for (int p = 0; p < 16; p++) {
+            int index = (colorBits >> (2 * p)) & 3;
+            for (int c = 0; c < 3; c++) _rgba[p * 4 + c] = (unsigned char) palette[index][c];
+            _rgba[p * 4 + 3] = (unsigned char) alpha[(alphaBits >> (3 * p)) & 7];
+        }
+    }
+
+    bool BakedTexture::bake(const unsigned char *_pixels, int _width, int _height, int _channels) {
+        if (!_pixels || _width <= 0 || _height <= 0 || _channels < 1 || _channels > 4) return false;
+
+        // What GL makes of a GL_RED/GL_RG/GL_RGB upload: missing colours are 0, missing alpha is 1
+        size_t pixelNum = (size_t) _width * _height;
+        std::vector<unsigned char> rgba(pixelNum * 4, 0);
+        bool translucent = false;
+        for (size_t i = 0; i < pixelNum; i++) {
+            for (int c = 0; c < std::min(_channels, 3); c++) rgba[i * 4 + c] = _pixels[i * _channels + c];
+            rgba[i * 4 + 3] = _channels == 4 ? _pixels[i * 4 + 3] : 255;
+            translucent |= rgba[i * 4 + 3] != 255;
+        }
+
+        BlockFormat bakedFormat = translucent ? BLOCK_BC3 : BLOCK_BC1;
+        std::vector<Level> bakedLevels;
+        std::shared_ptr<std::vector<unsigned char> > bytes(new std::vector<unsigned char>());
+        unsigned int levelWidth = (unsigned int) _width, levelHeight = (unsigned int) _height;
+        size_t total = 0;
+        for (unsigned int w = levelWidth, h = levelHeight;; w = std::max(1u, w / 2), h = std::max(1u, h / 2)) {
+            total += levelBytes(bakedFormat, w, h);
+            if (w == 1 && h == 1) break;
+        }
+        bytes->resize(total);
+
+        std::vector<unsigned char> next;
+        size_t offset = 0;
+        unsigned char block[64];
+        while (true) {
+            Level level;
+            level.width = levelWidth;
+            level.height = levelHeight;
+            level.size = levelBytes(bakedFormat, levelWidth, levelHeight);
+            unsigned char *out = bytes->data() + offset;
+            for (unsigned int by = 0; by < (levelHeight + 3) / 4; by++) {
+                for (unsigned int bx = 0; bx < (levelWidth + 3) / 4; bx++) {
+                    readBlock(rgba, levelWidth, levelHeight, bx, by, block);
+                    if (bakedFormat == BLOCK_BC1) encodeBlockBC1(block, out);
+                    else encodeBlockBC3(block, out);
+                    out += blockBytes(bakedFormat);
+                }
+            }
+            level.blocks = bytes->data() + offset;
+            offset += level.size;
+            bakedLevels.push_back(level);
+            if (levelWidth == 1 && levelHeight == 1) break;
+            downsample(rgba, levelWidth, levelHeight, next, levelWidth, levelHeight);
+            rgba.swap(next);
+        }
+
+        format = bakedFormat;
+        width = (unsigned int) _width;
+        height = (unsigned int) _height;
+        levels.swap(bakedLevels);
+        storage = bytes;
+        cache.reset();
+        return true;
+    }
+
+    bool BakedTexture::open(const std::string &_path, uint64_t _key) {
+        std::shared_ptr<SceneCache::Reader> reader(new SceneCache::Reader());
+        if (!reader->open(_path, _key)) return false;
+
+        const void *data;
+        size_t size;
+        if (!reader->get(TEXTURE_SECTION_INFO, data, size) || size != sizeof(Info)) return false;
+        Info info;
+        memcpy(&info, data, sizeof(info));
+        if (info.format > BLOCK_BC3 || info.width == 0 || info.height == 0 || info.levelNum == 0) return false;
+
+        std::vector<Level> mappedLevels(info.levelNum);
+        unsigned int w = info.width, h = info.height;
+        for (uint32_t i = 0; i < info.levelNum; i++) {
+            Level &level = mappedLevels[i];
+            level.width = w;
+            level.height = h;
+            if (!reader->get(TEXTURE_SECTION_LEVEL + i, data, size) ||
+                size != levelBytes((BlockFormat) info.format, w, h))
+                return false;
+            level.blocks = (const unsigned char *) data;
+            level.size = size;
+            w = std::max(1u, w / 2);
+            h = std::max(1u, h / 2);
+        }
+
+        format = (BlockFormat) info.format;
+        width = info.width;
+        height = info.height;
+        levels.swap(mappedLevels);
+        storage.reset();
+        cache = reader;
+        return true;
+    }
+
+    bool BakedTexture::save(const std::string &_path, uint64_t _key) const {
+        if (empty()) return false;
+        SceneCache::Writer writer;
+        Info info = {(uint32_t) format, width, height, (uint32_t) levels.size()};
+        writer.add(TEXTURE_SECTION_INFO, &info, sizeof(info));
+        for (size_t i = 0; i < levels.size(); i++)
+            writer.add(TEXTURE_SECTION_LEVEL + (uint32_t) i, levels[i].blocks, levels[i].size);
+        return writer.save(_path, _key);
+    }
+
+    size_t BakedTexture::byteNum() const {
+        size_t total = 0;
+        for (size_t i = 0; i < levels.size(); i++) total += levels[i].size;
+        return total;
+    }
+
+    bool computeKey(const std::string &_sourcePath, uint64_t &_key) {
+        return SceneCache::hashFile(_sourcePath, SceneCache::hashBytes(&BAKE_VERSION, sizeof(BAKE_VERSION)), _key);
+    }
+
+    std::string cachePath(const std::string &_cacheDir, const std::string &_sourcePath) {
+        // Named after the image, with a hash of its path so that equally named images do not collide
+        size_t slash = _sourcePath.find_last_of("/\\");
+        std::string name = slash == std::string::npos ? _sourcePath : _sourcePath.substr(slash + 1);
+        char suffix[24];
+        snprintf(suffix, sizeof(suffix), "-%016llx.btex",
+                 (unsigned long long) SceneCache::hashBytes(_sourcePath.data(), _sourcePath.size()));
+        return _cacheDir + "/" + name + suffix;
+    }
+}
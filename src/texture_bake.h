@@ -0,0 +1,98 @@
+// Baked Texture Cache
+// Textures are baked once into a SceneCache container: a box-filtered mip chain
+// with every level block-compressed, BC1 when opaque and BC3 when it has alpha.
+// Loading maps the file and hands each level straight to glCompressedTexImage2D,
+// no image is decoded. BC1 takes an eighth and BC3 a quarter of RGBA8's memory.
+//
+// Sections:
+//     TEXTURE_SECTION_INFO                 format, size and level count
+//     TEXTURE_SECTION_LEVEL + i            4x4 blocks of mip level i, row by row
+//
+//     TextureBake::BakedTexture baked;
+//     if (!baked.open(path, key) && baked.bake(pixels, width, height, channels))
+//         baked.save(path, key);
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "scene_cache.h"
+
+namespace TextureBake {
+    // Bump whenever the mip filter or the encoders change what they produce
+    const uint32_t BAKE_VERSION = 1;
+
+    const uint32_t TEXTURE_SECTION_INFO = 1;
+    const uint32_t TEXTURE_SECTION_LEVEL = 16;
+
+    enum BlockFormat {
+        BLOCK_BC1 = 0,
+        BLOCK_BC3
+    };
+
+    inline size_t blockBytes(BlockFormat _format) { return _format == BLOCK_BC1 ? 8 : 16; }
+
+    struct Level {
+        unsigned int width;
+        unsigned int height;
+        const unsigned char *blocks;
+        size_t size;
+    };
+
+    class BakedTexture {
+    public:
+        BakedTexture() : format(BLOCK_BC1), width(0), height(0) {}
+
+        // Compresses 8-bit pixels of 1 to 4 channels down to 1x1, read the way GL reads them
+        // as GL_RED, GL_RG, GL_RGB or GL_RGBA. The result stays in memory until saved.
+        bool bake(const unsigned char *_pixels, int _width, int _height, int _channels);
+
+        // Maps a baked file, false if it is missing, baked from another source or damaged
+        bool open(const std::string &_path, uint64_t _key);
+
+        bool save(const std::string &_path, uint64_t _key) const;
+
+        bool empty() const { return levels.empty(); }
+
+        BlockFormat getFormat() const { return format; }
+
+        unsigned int getWidth() const { return width; }
+
+        unsigned int getHeight() const { return height; }
+
+        size_t levelNum() const { return levels.size(); }
+
+        const Level &level(size_t _index) const { return levels[_index]; }
+
+        // Compressed bytes of all levels
+        size_t byteNum() const;
+
+    private:
+        BlockFormat format;
+        unsigned int width;
+        unsigned int height;
+        std::vector<Level> levels;
+        // Levels point into one of these; copies share them
+        std::shared_ptr<const std::vector<unsigned char> > storage;
+        std::shared_ptr<const SceneCache::Reader> cache;
+    };
+
+    // Ties a baked file to the content of its source image and to the baker version
+    bool computeKey(const std::string &_sourcePath, uint64_t &_key);
+
+    // Baked file for a source image inside _cacheDir
+    std::string cachePath(const std::string &_cacheDir, const std::string &_sourcePath);
+
+    // One 4x4 block of RGBA pixels, row by row
+    void encodeBlockBC1(const unsigned char _rgba[64], unsigned char _out[8]);
+
+    void encodeBlockBC3(const unsigned char _rgba[64], unsigned char _out[16]);
+
+    void decodeBlockBC1(const unsigned char _block[8], unsigned char _rgba[64]);
+
+    void decodeBlockBC3(const unsigned char _block[16], unsigned char _rgba[64]);
+}
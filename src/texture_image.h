@@ -11,12 +11,39 @@
 #include <stdexcept>
 #include <string>
 #include <map>
+#include <memory>
 
 #include "gl_env.h"
+#include "texture_bake.h"
 
 #include <stb_image.h>
 
 namespace TextureImage {
+    class TextureStreamer;
+
+    // Decoded pixels, produced without a GL context so that decoding can run on any thread
+    struct Image {
+        int width;
+        int height;
+        int channels;
+        std::shared_ptr<unsigned char> pixels;
+
+        Image()
+                : width(0), height(0), channels(0), pixels() {}
+
+        bool decode(const std::string &_filename) {
+            // The flag is global in this stb_image, every decoder sets the same value
+            stbi_set_flip_vertically_on_load(true);
+            unsigned char *data = stbi_load(_filename.c_str(), &width, &height, &channels, 0);
+            pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+            return data != NULL;
+        }
+
+        bool empty() const { return !pixels; }
+
+        size_t byteNum() const { return (size_t) width * height * channels; }
+    };
+
     class Texture {
     public:
         typedef std::map<std::string, Texture *> Name2Texture;
@@ -24,6 +51,8 @@ namespace TextureImage {
         static Texture error;
 
     private:
+        friend class TextureStreamer;
+
         bool available;
         std::string name;
         std::string filename;
@@ -45,7 +74,7 @@ namespace TextureImage {
             available = false;
             name = std::string();
             filename = std::string();
-            glDeleteTextures(1, &tex);
+            if (tex) glDeleteTextures(1, &tex);
             tex = 0;
         }
 
@@ -70,6 +99,29 @@ namespace TextureImage {
         }
 
         static Texture &loadTexture(std::string _name, std::string _filename = std::string()) {
+            return loadTexture(_name, _filename, NULL, NULL);
+        }
+
+        // Uploads an image decoded in advance, _decoded must come from _filename
+        static Texture &loadTexture(std::string _name, std::string _filename, const Image &_decoded) {
+            return loadTexture(_name, _filename, &_decoded, NULL);
+        }
+
+        // Uploads the baked levels of _filename as they are. Fails without BC1/BC3 support,
+        // the caller then falls back to the decoded image.
+        static Texture &loadTexture(std::string _name, std::string _filename, const TextureBake::BakedTexture &_baked) {
+            if (_baked.empty() || !GLEW_EXT_texture_compression_s3tc) return error;
+            return loadTexture(_name, _filename, NULL, &_baked);
+        }
+
+    private:
+        static GLenum compressedFormat(TextureBake::BlockFormat _format) {
+            return _format == TextureBake::BLOCK_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                                     : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        }
+
+        static Texture &loadTexture(std::string _name, std::string _filename, const Image *_decoded,
+                                    const TextureBake::BakedTexture *_baked) {
             GLenum gl_error_code = GL_NO_ERROR;
             if ((gl_error_code = glGetError()) != GL_NO_ERROR) {
                 const GLubyte *errString = glewGetErrorString(gl_error_code);
@@ -81,9 +133,6 @@ namespace TextureImage {
                 _filename = testAllSuffix(_name);
                 if (_filename.empty()) return error;
             }
-            FILE *fi = fopen(_filename.c_str(), "r");
-            if (fi == NULL) return error;
-            fclose(fi);
 
             std::pair<Name2Texture::iterator, bool> insertion =
                     allTexture.insert(Name2Texture::value_type(_name, new Texture()));
@@ -99,13 +148,45 @@ namespace TextureImage {
             target.name = _name;
             target.filename = _filename;
 
-            stbi_set_flip_vertically_on_load(true);
-            int width, height, channels;
-            unsigned char *data =
-                    stbi_load(_filename.c_str(), &width, &height, &channels, 0);
-            if (!data) {
+            if (_baked) {
+                target.width = (int) _baked->getWidth();
+                target.height = (int) _baked->getHeight();
+                glGenTextures(1, &target.tex);
+                glBindTexture(GL_TEXTURE_2D, target.tex);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) _baked->levelNum() - 1);
+                for (size_t i = 0; i < _baked->levelNum(); i++) {
+                    const TextureBake::Level &level = _baked->level(i);
+                    glCompressedTexImage2D(GL_TEXTURE_2D, (GLint) i, compressedFormat(_baked->getFormat()),
+                                           level.width, level.height, 0, (GLsizei) level.size, level.blocks);
+                }
+                glBindTexture(GL_TEXTURE_2D, 0);
+
+                if ((gl_error_code = glGetError()) != GL_NO_ERROR) {
+                    const GLubyte *errString = glewGetErrorString(gl_error_code);
+                    std::cout << "ERROR in loadTexture():" << std::endl;
+                    std::cout << errString << std::endl;
+                    return error;
+                }
+                target.available = true;
+                return target;
+            }
+
+            Image decoded;
+            if (_decoded) {
+                decoded = *_decoded;
+            } else {
+                decoded.decode(_filename);
+            }
+            if (decoded.empty()) {
                 return error;
             }
+            int channels = decoded.channels;
+            target.width = decoded.width;
+            target.height = decoded.height;
 
             GLenum format = GL_RGBA;
             if (channels == 1) {
@@ -125,12 +206,10 @@ namespace TextureImage {
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, target.width, target.height,
-                         0, format, GL_UNSIGNED_BYTE, data);
+                         0, format, GL_UNSIGNED_BYTE, decoded.pixels.get());
             glGenerateMipmap(GL_TEXTURE_2D);
             glBindTexture(GL_TEXTURE_2D, 0);
 
-            stbi_image_free(data);
-
             if ((gl_error_code = glGetError()) != GL_NO_ERROR) {
                 const GLubyte *errString = glewGetErrorString(gl_error_code);
                 std::cout << "ERROR in loadTexture():" << std::endl;
@@ -142,6 +221,7 @@ namespace TextureImage {
             return target;
         }
 
+    public:
         static bool unloadTexture(std::string _name) {
             return allTexture.erase(_name) != 0;
         }
@@ -0,0 +1,270 @@
+// Mip Streaming for Baked Textures
+// Streamed textures start with only their coarse levels on the GPU. Finer levels
+// are read from the baked mip chain on a background JobQueue thread, one level at
+// a time, as long as draws ask for more detail than is resident. When the total
+// would exceed the video memory budget, the finest levels of the least recently
+// requested textures are evicted first.
+//
+//     TextureImage::TextureStreamer streamer(64 * 1024 * 1024);
+//     Texture &texture = streamer.stream("diffuse", path, baked);
+//     per frame: streamer.request(texture, pixelsAcross); ... streamer.update();
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gl_env.h"
+#include "texture_image.h"
+#include "texture_bake.h"
+#include "job_queue.h"
+
+namespace TextureImage {
+    // Levels no larger than this are uploaded with the texture and never evicted
+    const unsigned int STREAM_RESIDENT_SIZE = 64;
+
+    class TextureStreamer {
+    public:
+        struct Stats {
+            unsigned int levelNum;
+            // Finest level on the GPU, finest level the last request asked for, 0 is full size
+            unsigned int residentLevel;
+            unsigned int wantedLevel;
+            size_t residentBytes;
+            size_t fullBytes;
+            unsigned int streamedLevels;
+            unsigned int evictedLevels;
+            // Frame of the last request, frames are counted by update()
+            unsigned long long lastRequestFrame;
+        };
+
+        explicit TextureStreamer(size_t _budgetBytes, Parallel::JobQueue &_queue = Parallel::JobQueue::shared())
+                : queue(_queue), budget(_budgetBytes), committedBytes(0), frame(1) {}
+
+        // Registers _baked as texture _name and uploads its coarse levels. Texture::error without
+        // BC1/BC3 support, the caller then loads the texture whole.
+        Texture &stream(const std::string &_name, const std::string &_filename,
+                        const TextureBake::BakedTexture &_baked) {
+            if (_baked.empty() || !GLEW_EXT_texture_compression_s3tc) return Texture::error;
+
+            std::pair<Texture::Name2Texture::iterator, bool> insertion =
+                    Texture::allTexture.insert(Texture::Name2Texture::value_type(_name, new Texture()));
+            Texture &target = *(insertion.first->second);
+            std::map<const Texture *, size_t>::const_iterator streamed = entryIndex.find(&target);
+            if (streamed != entryIndex.end()) {
+                if (target.filename == _filename && target.available) return target;
+                forget(streamed->second);
+            }
+            if (!insertion.second) target.clear();
+
+            Entry entry;
+            entry.texture = &target;
+            entry.source = _baked;
+            entry.floorLevel = (unsigned int) _baked.levelNum() - 1;
+            for (unsigned int i = 0; i < _baked.levelNum(); i++) {
+                const TextureBake::Level &level = _baked.level(i);
+                if (std::max(level.width, level.height) <= STREAM_RESIDENT_SIZE) {
+                    entry.floorLevel = i;
+                    break;
+                }
+            }
+            entry.residentLevel = entry.floorLevel;
+            entry.wantedLevel = entry.floorLevel;
+            entry.streamedLevels = 0;
+            entry.evictedLevels = 0;
+            entry.lastRequest = 0;
+
+            target.name = _name;
+            target.filename = _filename;
+            target.width = (int) _baked.getWidth();
+            target.height = (int) _baked.getHeight();
+            createTexture(entry, entry.residentLevel);
+            committedBytes += levelBytes(entry, entry.residentLevel);
+            target.available = true;
+
+            entryIndex[&target] = entries.size();
+            entries.push_back(entry);
+            return target;
+        }
+
+        // The texture is drawn about _screenPixels across its larger side this frame
+        void request(const Texture &_texture, float _screenPixels) {
+            std::map<const Texture *, size_t>::const_iterator found = entryIndex.find(&_texture);
+            if (found == entryIndex.end()) return;
+            Entry &entry = entries[found->second];
+            float texels = (float) std::max(_texture.width, _texture.height);
+            float ratio = texels / std::max(1.0f, _screenPixels);
+            unsigned int wanted = ratio <= 1.0f ? 0 : (unsigned int) std::floor(std::log2(ratio));
+            wanted = std::min(wanted, entry.floorLevel);
+            // The most detailed request of the frame wins
+            entry.wantedLevel = entry.lastRequest == frame ? std::min(entry.wantedLevel, wanted) : wanted;
+            entry.lastRequest = frame;
+        }
+
+        // Call once per frame on the GL thread, after the frame's requests. Uploads fetched levels,
+        // evicts down to the budget and starts fetching the next level of textures that want more.
+        void update() {
+            for (size_t i = 0; i < entries.size(); i++) {
+                Entry &entry = entries[i];
+                if (!entry.fetch || !entry.fetch->done.load()) continue;
+                const TextureBake::Level &level = entry.source.level(entry.fetch->level);
+                glBindTexture(GL_TEXTURE_2D, entry.texture->tex);
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint) entry.fetch->level,
+                                       Texture::compressedFormat(entry.source.getFormat()), level.width,
+                                       level.height, 0, (GLsizei) level.size, entry.fetch->bytes.data());
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint) entry.fetch->level);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                entry.residentLevel = entry.fetch->level;
+                entry.streamedLevels++;
+                entry.fetch.reset();
+            }
+
+            while (committedBytes > budget && evictOne(NULL)) {}
+
+            // Most recently requested first, they are the ones on screen
+            std::vector<size_t> order;
+            for (size_t i = 0; i < entries.size(); i++)
+                if (entries[i].wantedLevel < entries[i].residentLevel && !entries[i].fetch) order.push_back(i);
+            std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+                return entries[a].lastRequest > entries[b].lastRequest;
+            });
+            for (size_t i = 0; i < order.size(); i++) {
+                Entry &entry = entries[order[i]];
+                unsigned int next = entry.residentLevel - 1;
+                size_t size = entry.source.level(next).size;
+                while (committedBytes + size > budget && evictOne(&entry)) {}
+                if (committedBytes + size > budget) continue;
+                committedBytes += size;
+
+                // Reading the level pages it in from the baked file, away from the GL thread
+                std::shared_ptr<Fetch> fetch(new Fetch());
+                fetch->level = next;
+                fetch->done = false;
+                entry.fetch = fetch;
+                TextureBake::BakedTexture source = entry.source;
+                queue.submit([fetch, source]() {
+                    const TextureBake::Level &level = source.level(fetch->level);
+                    fetch->bytes.assign(level.blocks, level.blocks + level.size);
+                    fetch->done = true;
+                });
+            }
+            frame++;
+        }
+
+        bool getStats(const Texture &_texture, Stats &_stats) const {
+            std::map<const Texture *, size_t>::const_iterator found = entryIndex.find(&_texture);
+            if (found == entryIndex.end()) return false;
+            const Entry &entry = entries[found->second];
+            _stats.levelNum = (unsigned int) entry.source.levelNum();
+            _stats.residentLevel = entry.residentLevel;
+            _stats.wantedLevel = entry.wantedLevel;
+            _stats.residentBytes = levelBytes(entry, entry.residentLevel);
+            _stats.fullBytes = entry.source.byteNum();
+            _stats.streamedLevels = entry.streamedLevels;
+            _stats.evictedLevels = entry.evictedLevels;
+            _stats.lastRequestFrame = entry.lastRequest;
+            return true;
+        }
+
+        // Resident levels of all textures plus the levels being fetched
+        size_t getCommittedBytes() const { return committedBytes; }
+
+        size_t getBudget() const { return budget; }
+
+        void setBudget(size_t _budgetBytes) { budget = _budgetBytes; }
+
+    private:
+        struct Fetch {
+            std::atomic<bool> done;
+            unsigned int level;
+            std::vector<unsigned char> bytes;
+        };
+
+        struct Entry {
+            Texture *texture;
+            TextureBake::BakedTexture source;
+            // Coarsest level that is always resident
+            unsigned int floorLevel;
+            unsigned int residentLevel;
+            unsigned int wantedLevel;
+            unsigned int streamedLevels;
+            unsigned int evictedLevels;
+            unsigned long long lastRequest;
+            std::shared_ptr<Fetch> fetch;
+        };
+
+        Parallel::JobQueue &queue;
+        size_t budget;
+        size_t committedBytes;
+        unsigned long long frame;
+        std::vector<Entry> entries;
+        std::map<const Texture *, size_t> entryIndex;
+
+        TextureStreamer(const TextureStreamer &);
+
+        TextureStreamer &operator=(const TextureStreamer &);
+
+        // Bytes of the levels from _finest down to 1x1
+        static size_t levelBytes(const Entry &_entry, unsigned int _finest) {
+            size_t total = 0;
+            for (size_t i = _finest; i < _entry.source.levelNum(); i++) total += _entry.source.level(i).size;
+            return total;
+        }
+
+        // A new texture object holding levels _finest and coarser, the old one and its memory go away
+        void createTexture(Entry &_entry, unsigned int _finest) {
+            Texture &target = *_entry.texture;
+            if (target.tex) glDeleteTextures(1, &target.tex);
+            glGenTextures(1, &target.tex);
+            glBindTexture(GL_TEXTURE_2D, target.tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint) _finest);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) _entry.source.levelNum() - 1);
+            for (size_t i = _finest; i < _entry.source.levelNum(); i++) {
+                const TextureBake::Level &level = _entry.source.level(i);
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint) i, Texture::compressedFormat(_entry.source.getFormat()),
+                                       level.width, level.height, 0, (GLsizei) level.size, level.blocks);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+            _entry.residentLevel = _finest;
+        }
+
+        // Drops the finest level of the least recently requested texture that has one to spare.
+        // _growing is never picked, nor is a texture requested as recently that needs all it has.
+        bool evictOne(const Entry *_growing) {
+            Entry *victim = NULL;
+            for (size_t i = 0; i < entries.size(); i++) {
+                Entry &entry = entries[i];
+                if (&entry == _growing || entry.fetch || entry.residentLevel >= entry.floorLevel) continue;
+                if (_growing && entry.lastRequest >= _growing->lastRequest && entry.residentLevel >= entry.wantedLevel)
+                    continue;
+                if (!victim || entry.lastRequest < victim->lastRequest ||
+                    (entry.lastRequest == victim->lastRequest && entry.residentLevel < victim->residentLevel))
+                    victim = &entry;
+            }
+            if (!victim) return false;
+            committedBytes -= victim->source.level(victim->residentLevel).size;
+            createTexture(*victim, victim->residentLevel + 1);
+            victim->evictedLevels++;
+            return true;
+        }
+
+        void forget(size_t _index) {
+            Entry &entry = entries[_index];
+            committedBytes -= levelBytes(entry, entry.residentLevel);
+            if (entry.fetch) committedBytes -= entry.source.level(entry.fetch->level).size;
+            entryIndex.erase(entry.texture);
+            entries.erase(entries.begin() + _index);
+            for (std::map<const Texture *, size_t>::iterator it = entryIndex.begin(); it != entryIndex.end(); ++it)
+                if (it->second > _index) it->second--;
+        }
+    };
+}
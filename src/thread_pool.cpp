@@ -0,0 +1,115 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace Parallel {
+    namespace {
+        // Set on pool threads and while a thread is inside run(), nested runs execute inline
+        thread_local bool insidePool = false;
+    }
+
+    ThreadPool::ThreadPool(unsigned _threadNum)
+            : generation(0), stopping(false), job(NULL), remaining(0) {
+        if (_threadNum == 0) _threadNum = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < _threadNum; i++)
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        // Queue 0 belongs to whichever thread calls run()
+        for (unsigned i = 1; i < _threadNum; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    ThreadPool &ThreadPool::shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void ThreadPool::run(size_t taskNum, const Task &task) {
+        if (taskNum == 0) return;
+        if (insidePool || queues.size() == 1 || taskNum == 1) {
+            for (size_t i = 0; i < taskNum; i++) task(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> runLock(runMutex);
+        // Published before any task becomes visible, the queue mutexes order the two
+        job = &task;
+        remaining = taskNum;
+        unsigned threadNum = getThreadNum();
+        for (unsigned q = 0; q < threadNum; q++) {
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            for (size_t i = q; i < taskNum; i += threadNum)
+                queues[q]->tasks.push_front(i);
+        }
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            generation++;
+        }
+        wake.notify_all();
+
+        insidePool = true;
+        work(0);
+        insidePool = false;
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        done.wait(lock, [this] { return remaining == 0; });
+        job = NULL;
+    }
+
+    void ThreadPool::workerLoop(unsigned self) {
+        insidePool = true;
+        unsigned seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(stateMutex);
+                wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            work(self);
+        }
+    }
+
+    void ThreadPool::work(unsigned self) {
+        size_t task;
+        while (pop(self, task) || steal(self, task)) {
+            (*job)(task);
+            if (--remaining == 0) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    bool ThreadPool::pop(unsigned self, size_t &task) {
+        Queue &queue = *queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool ThreadPool::steal(unsigned self, size_t &task) {
+        unsigned threadNum = getThreadNum();
+        for (unsigned i = 1; i < threadNum; i++) {
+            Queue &victim = *queues[(self + i) % threadNum];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            // The front holds the tasks the owner would run last
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+}
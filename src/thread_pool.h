@@ -0,0 +1,67 @@
+// Work-Stealing Thread Pool
+// Every thread owns a task deque, it pops work from the back of its own deque
+// and steals from the front of the others once it runs dry.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+    class ThreadPool {
+    public:
+        typedef std::function<void(size_t)> Task;
+
+        // _threadNum counts the thread calling run(), which always takes part in the work.
+        // 0 picks one thread per hardware thread.
+        explicit ThreadPool(unsigned _threadNum = 0);
+
+        ~ThreadPool();
+
+        unsigned getThreadNum() const { return (unsigned) queues.size(); }
+
+        // Runs task(i) for every i in [0, taskNum) and returns once all of them finished.
+        // Tasks are dealt round-robin to the threads in index order, so putting the most
+        // expensive ones first gives the best balance. Nested calls from inside a task run inline.
+        void run(size_t taskNum, const Task &task);
+
+        // Process-wide pool sized to the hardware
+        static ThreadPool &shared();
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue> > queues;
+        std::vector<std::thread> workers;
+
+        std::mutex runMutex;
+        std::mutex stateMutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        unsigned generation;
+        bool stopping;
+        const Task *job;
+        std::atomic<size_t> remaining;
+
+        ThreadPool(const ThreadPool &);
+
+        ThreadPool &operator=(const ThreadPool &);
+
+        void workerLoop(unsigned self);
+
+        void work(unsigned self);
+
+        bool pop(unsigned self, size_t &task);
+
+        bool steal(unsigned self, size_t &task);
+    };
+}
@@ -0,0 +1,173 @@
+// Uniform Streaming
+// Per-frame shader data, the MVP and the bone palette, written into a uniform
+// buffer split into regions, one per frame in flight. A frame maps its region
+// without synchronization, fills it, binds it to the block's binding point and
+// fences it after the draws. The region comes round again FRAME_RING_SIZE frames
+// later and by then the fence has nearly always signaled, so the CPU does not
+// wait for the GPU and the driver never copies uniform data aside. Where
+// ARB_buffer_storage is available the buffer is mapped once, persistently and
+// coherently, instead of once per frame.
+//
+//     size_t blockBytes = UniformStream::bindBlock(program, "FrameData", FRAME_DATA_BINDING);
+//     UniformStream::FrameRing ring;   ring.create(blockBytes);
+//     per frame: char *data = ring.map(); write ...; ring.bind(FRAME_DATA_BINDING, writtenBytes);
+//                draw ...; ring.fence();
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gl_env.h"
+
+namespace UniformStream {
+    // Frames whose uniform data may still be read by the GPU
+    const unsigned int FRAME_RING_SIZE = 3;
+
+    // Points the named uniform block of _program at _binding and returns the block's size,
+    // 0 if there is no such block
+    inline size_t bindBlock(GLuint _program, const char *_blockName, GLuint _binding) {
+        GLuint index = glGetUniformBlockIndex(_program, _blockName);
+        if (index == GL_INVALID_INDEX) return 0;
+        glUniformBlockBinding(_program, index, _binding);
+        GLint bytes = 0;
+        glGetActiveUniformBlockiv(_program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &bytes);
+        return (size_t) bytes;
+    }
+
+    class FrameRing {
+    public:
+        struct Stats {
+            uint64_t frames;
+            // Written in the last frame, and over all frames
+            size_t frameBytes;
+            uint64_t totalBytes;
+            // Regions whose fence had not signaled when the ring came round to them
+            uint64_t fenceWaits;
+            double fenceWaitSeconds;
+            bool persistent;
+        };
+
+        FrameRing() : buffer(0), blockBytes(0), regionBytes(0), current(0), mapped(NULL), persistentBase(NULL) {
+            resetStats();
+        }
+
+        ~FrameRing() { destroy(); }
+
+        // _blockBytes is the size of the uniform block, every frame binds that much. Regions are
+        // padded to the offset alignment of glBindBufferRange.
+        void create(size_t _blockBytes, unsigned int _ringSize = FRAME_RING_SIZE) {
+            destroy();
+            GLint alignment = 256;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            blockBytes = _blockBytes;
+            regionBytes = (_blockBytes + alignment - 1) / alignment * alignment;
+            fences.assign(_ringSize ? _ringSize : 1, (GLsync) 0);
+            size_t bytes = regionBytes * fences.size();
+
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            if (GLEW_ARB_buffer_storage) {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_UNIFORM_BUFFER, bytes, NULL, flags);
+                persistentBase = (char *) glMapBufferRange(GL_UNIFORM_BUFFER, 0, bytes, flags);
+            }
+            if (!persistentBase) glBufferData(GL_UNIFORM_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            current = 0;
+            resetStats();
+            stats.persistent = persistentBase != NULL;
+        }
+
+        void destroy() {
+            for (size_t i = 0; i < fences.size(); i++)
+                if (fences[i]) glDeleteSync(fences[i]);
+            fences.clear();
+            if (buffer) {
+                if (persistentBase) {
+                    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                    glUnmapBuffer(GL_UNIFORM_BUFFER);
+                    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                }
+                glDeleteBuffers(1, &buffer);
+            }
+            buffer = 0;
+            mapped = persistentBase = NULL;
+        }
+
+        // The region of the next frame, writable for the block's size until bind(). Waits only if
+        // the GPU is still reading the frame that last used it. NULL without a block or on failure.
+        char *map() {
+            if (!buffer || !blockBytes) return NULL;
+            current = (current + 1) % fences.size();
+            GLsync &fence = fences[current];
+            if (fence) {
+                if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                    stats.fenceWaits++;
+                    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+                    stats.fenceWaitSeconds +=
+                            std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                }
+                glDeleteSync(fence);
+                fence = 0;
+            }
+            if (persistentBase) {
+                mapped = persistentBase + current * regionBytes;
+            } else {
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                mapped = (char *) glMapBufferRange(GL_UNIFORM_BUFFER, current * regionBytes, regionBytes,
+                                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                                   GL_MAP_UNSYNCHRONIZED_BIT);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+            return mapped;
+        }
+
+        // Publishes the region to the uniform block at _binding. _writtenBytes only counts towards
+        // the stats, a frame need not write the unused tail of the block.
+        void bind(GLuint _binding, size_t _writtenBytes) {
+            if (!persistentBase && mapped) {
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+            mapped = NULL;
+            glBindBufferRange(GL_UNIFORM_BUFFER, _binding, buffer, current * regionBytes, blockBytes);
+            stats.frames++;
+            stats.frameBytes = _writtenBytes;
+            stats.totalBytes += _writtenBytes;
+        }
+
+        // Call after the last draw reading the frame's region
+        void fence() {
+            if (fences[current]) glDeleteSync(fences[current]);
+            fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        const Stats &getStats() const { return stats; }
+
+    private:
+        GLuint buffer;
+        size_t blockBytes;
+        size_t regionBytes;
+        std::vector<GLsync> fences;
+        size_t current;
+        char *mapped;
+        char *persistentBase;
+        Stats stats;
+
+        void resetStats() {
+            stats.frames = stats.totalBytes = stats.fenceWaits = 0;
+            stats.frameBytes = 0;
+            stats.fenceWaitSeconds = 0.0;
+            stats.persistent = false;
+        }
+
+        FrameRing(const FrameRing &);
+
+        FrameRing &operator=(const FrameRing &);
+    };
+}
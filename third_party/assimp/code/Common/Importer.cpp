@@ -81,6 +81,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <set>
 #include <memory>
 #include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
 
 #include <assimp/DefaultIOStream.h>
 #include <assimp/DefaultIOSystem.h>
@@ -104,6 +107,46 @@ namespace Assimp {
 using namespace Assimp;
 using namespace Assimp::Intern;
 
+namespace {
+
+// ------------------------------------------------------------------------------------------------
+// Class name of a post-processing step for profiler regions, e.g. "TriangulateProcess"
+std::string PostProcessStepName(const BaseProcess* process) {
+    const std::string name = typeid(*process).name();
+
+    // MSVC spells out the scope, the Itanium ABI mangles it as N<length><name>...E
+    const std::string::size_type scope = name.rfind("::");
+    if (scope != std::string::npos) {
+        return name.substr(scope + 2);
+    }
+    std::string last;
+    const char* cursor = name.c_str() + (name[0] == 'N' ? 1 : 0);
+    while (isdigit(static_cast<unsigned char>(*cursor))) {
+        char* end;
+        const unsigned long length = strtoul(cursor, &end, 10);
+        if (length > strlen(end)) {
+            break;
+        }
+        last.assign(end, length);
+        cursor = end + length;
+    }
+    return last.empty() ? name : last;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Items a profiler region reports for steps that work on the whole scene
+uint64_t CountVertices(const aiScene* scene) {
+    uint64_t count = 0;
+    if (scene) {
+        for (unsigned int i = 0; i < scene->mNumMeshes; ++i) {
+            count += scene->mMeshes[i]->mNumVertices;
+        }
+    }
+    return count;
+}
+
+}
+
 // ------------------------------------------------------------------------------------------------
 // Intern::AllocateFromAssimpHeap serves as abstract base class. It overrides
 // new and delete (and their array counterparts) of public API classes (e.g. Logger) to
@@ -583,7 +626,8 @@ const aiScene* Importer::ReadFile( const char* _pFile, unsigned int pFlags)
             return NULL;
         }
 
-        std::unique_ptr<Profiler> profiler(GetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME,0)?new Profiler():NULL);
+        std::unique_ptr<Profiler> profiler(GetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME,0) || Profiler::GetListener()
+                                           ? new Profiler() : NULL);
         if (profiler) {
             profiler->BeginRegion("total");
         }
@@ -647,7 +691,7 @@ const aiScene* Importer::ReadFile( const char* _pFile, unsigned int pFlags)
         pimpl->mProgressHandler->UpdateFileRead( fileSize, fileSize );
 
         if (profiler) {
-            profiler->EndRegion("import");
+            profiler->EndRegion("import", fileSize, pimpl->mScene ? pimpl->mScene->mNumMeshes : 0);
         }
 
         SetPropertyString("sourceFilePath", pFile);
@@ -676,7 +720,7 @@ const aiScene* Importer::ReadFile( const char* _pFile, unsigned int pFlags)
             pre.ProcessScene();
 
             if (profiler) {
-                profiler->EndRegion("preprocess");
+                profiler->EndRegion("preprocess", 0, CountVertices(pimpl->mScene));
             }
 
             // Ensure that the validation process won't be called twice
@@ -691,7 +735,7 @@ const aiScene* Importer::ReadFile( const char* _pFile, unsigned int pFlags)
         pimpl->mPPShared->Clean();
 
         if (profiler) {
-            profiler->EndRegion("total");
+            profiler->EndRegion("total", fileSize, CountVertices(pimpl->mScene));
         }
     }
 #ifdef ASSIMP_CATCH_GLOBAL_EXCEPTIONS
@@ -760,21 +804,24 @@ const aiScene* Importer::ApplyPostProcessing(unsigned int pFlags)
     }
 #endif // ! DEBUG
 
-    std::unique_ptr<Profiler> profiler(GetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME,0)?new Profiler():NULL);
+    std::unique_ptr<Profiler> profiler(GetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME,0) || Profiler::GetListener()
+                                       ? new Profiler() : NULL);
     for( unsigned int a = 0; a < pimpl->mPostProcessingSteps.size(); a++)   {
 
         BaseProcess* process = pimpl->mPostProcessingSteps[a];
         pimpl->mProgressHandler->UpdatePostProcess(static_cast<int>(a), static_cast<int>(pimpl->mPostProcessingSteps.size()) );
         if( process->IsActive( pFlags)) {
 
+            std::string region;
             if (profiler) {
-                profiler->BeginRegion("postprocess");
+                region = "postprocess " + PostProcessStepName(process);
+                profiler->BeginRegion(region);
             }
 
             process->ExecuteOnScene ( this );
 
             if (profiler) {
-                profiler->EndRegion("postprocess");
+                profiler->EndRegion(region, 0, CountVertices(pimpl->mScene));
             }
         }
         if( !pimpl->mScene) {
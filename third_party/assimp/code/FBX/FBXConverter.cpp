@@ -62,6 +62,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <assimp/CreateAnimMesh.h>
 
 #include <tuple>
+#include <exception>
 #include <memory>
 #include <iterator>
 #include <vector>
@@ -97,6 +98,7 @@ namespace Assimp {
             // to determine which nodes need to be generated.
             ConvertAnimations();
             ConvertRootNode();
+            ConvertPendingMeshes();
 
             if (doc.Settings().readAllMaterials) {
                 // unfortunately this means we have to evaluate all objects
@@ -1048,6 +1050,22 @@ namespace Assimp {
             const MatIndexArray& mindices = mesh.GetMaterialIndices();
             aiMesh* const out_mesh = SetupEmptyMesh(mesh, nd);
 
+            if (!doc.Settings().readMaterials || mindices.empty()) {
+                FBXImporter::LogError("no material assigned to mesh, setting default material");
+                out_mesh->mMaterialIndex = GetDefaultMaterial();
+            }
+            else {
+                ConvertMaterialForMesh(out_mesh, model, mesh, mindices[0]);
+            }
+
+            const PendingMesh pending = { out_mesh, &mesh, &model, node_global_transform, false, 0 };
+            pending_meshes.push_back(pending);
+            return static_cast<unsigned int>(meshes.size() - 1);
+        }
+
+        void FBXConverter::FillMeshSingleMaterial(aiMesh* out_mesh, const MeshGeometry& mesh, const Model& model,
+            const aiMatrix4x4& node_global_transform)
+        {
             const std::vector<aiVector3D>& vertices = mesh.GetVertices();
             const std::vector<unsigned int>& faces = mesh.GetFaceIndexCounts();
 
@@ -1155,14 +1173,6 @@ namespace Assimp {
                 std::copy(colors.begin(), colors.end(), out_mesh->mColors[i]);
             }
 
-            if (!doc.Settings().readMaterials || mindices.empty()) {
-                FBXImporter::LogError("no material assigned to mesh, setting default material");
-                out_mesh->mMaterialIndex = GetDefaultMaterial();
-            }
-            else {
-                ConvertMaterialForMesh(out_mesh, model, mesh, mindices[0]);
-            }
-
             if (doc.Settings().readWeights && mesh.DeformerSkin() != NULL) {
                 ConvertWeights(out_mesh, model, mesh, node_global_transform, NO_MATERIAL_SEPARATION);
             }
@@ -1206,7 +1216,6 @@ namespace Assimp {
                     out_mesh->mAnimMeshes[i] = animMeshes.at(i);
                 }
             }
-            return static_cast<unsigned int>(meshes.size() - 1);
         }
 
         std::vector<unsigned int> FBXConverter::ConvertMeshMultiMaterial(const MeshGeometry& mesh, const Model& model,
@@ -1236,6 +1245,17 @@ namespace Assimp {
         {
             aiMesh* const out_mesh = SetupEmptyMesh(mesh, nd);
 
+            ConvertMaterialForMesh(out_mesh, model, mesh, index);
+
+            const PendingMesh pending = { out_mesh, &mesh, &model, node_global_transform, true, index };
+            pending_meshes.push_back(pending);
+            return static_cast<unsigned int>(meshes.size() - 1);
+        }
+
+        void FBXConverter::FillMeshMultiMaterial(aiMesh* out_mesh, const MeshGeometry& mesh, const Model& model,
+            MatIndexArray::value_type index,
+            const aiMatrix4x4& node_global_transform)
+        {
             const MatIndexArray& mindices = mesh.GetMaterialIndices();
             const std::vector<aiVector3D>& vertices = mesh.GetVertices();
             const std::vector<unsigned int>& faces = mesh.GetFaceIndexCounts();
@@ -1396,8 +1416,6 @@ namespace Assimp {
                 }
             }
 
-            ConvertMaterialForMesh(out_mesh, model, mesh, index);
-
             if (process_weights) {
                 ConvertWeights(out_mesh, model, mesh, node_global_transform, index, &reverseMapping);
             }
@@ -1445,8 +1463,47 @@ namespace Assimp {
                     out_mesh->mAnimMeshes[i] = animMeshes.at(i);
                 }
             }
+        }
 
-            return static_cast<unsigned int>(meshes.size() - 1);
+        void FBXConverter::ConvertPendingMeshes()
+        {
+            // one job per source geometry
+            std::vector<size_t> job_begin;
+            for (size_t i = 0; i < pending_meshes.size(); ++i) {
+                if (!i || pending_meshes[i].mesh != pending_meshes[i - 1].mesh) {
+                    job_begin.push_back(i);
+                }
+            }
+            job_begin.push_back(pending_meshes.size());
+
+            const size_t job_count = job_begin.size() - 1;
+            std::vector<std::exception_ptr> errors(job_count);
+            Util::ParallelFor(job_count, doc.Settings().convertThreads, [&](size_t job) {
+                try {
+                    for (size_t i = job_begin[job]; i < job_begin[job + 1]; ++i) {
+                        const PendingMesh& pending = pending_meshes[i];
+                        if (pending.split) {
+                            FillMeshMultiMaterial(pending.out, *pending.mesh, *pending.model,
+                                pending.material_index, pending.node_global_transform);
+                        }
+                        else {
+                            FillMeshSingleMaterial(pending.out, *pending.mesh, *pending.model,
+                                pending.node_global_transform);
+                        }
+                    }
+                }
+                catch (...) {
+                    errors[job] = std::current_exception();
+                }
+            });
+            pending_meshes.clear();
+
+            // report the same error a serial conversion would have hit first
+            for (const std::exception_ptr& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
         }
 
         void FBXConverter::ConvertWeights(aiMesh* out, const Model& model, const MeshGeometry& geo,
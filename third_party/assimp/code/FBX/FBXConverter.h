@@ -210,6 +210,32 @@ private:
     static const unsigned int NO_MATERIAL_SEPARATION = /* std::numeric_limits<unsigned int>::max() */
         static_cast<unsigned int>(-1);
 
+    // ------------------------------------------------------------------------------------------------
+    // An aiMesh that has its name and material but still waits for its geometry
+    struct PendingMesh {
+        aiMesh* out;
+        const MeshGeometry* mesh;
+        const Model* model;
+        aiMatrix4x4 node_global_transform;
+        // false: the whole geometry, true: only the faces of material_index
+        bool split;
+        MatIndexArray::value_type material_index;
+    };
+
+    // ------------------------------------------------------------------------------------------------
+    // fill vertices, faces, weights and blend shapes of all pending meshes, concurrently
+    // per source geometry since meshes split from the same geometry share its lazy caches
+    void ConvertPendingMeshes();
+
+    // ------------------------------------------------------------------------------------------------
+    void FillMeshSingleMaterial(aiMesh* out_mesh, const MeshGeometry& mesh, const Model& model,
+        const aiMatrix4x4& node_global_transform);
+
+    // ------------------------------------------------------------------------------------------------
+    void FillMeshMultiMaterial(aiMesh* out_mesh, const MeshGeometry& mesh, const Model& model,
+        MatIndexArray::value_type index,
+        const aiMatrix4x4& node_global_transform);
+
     // ------------------------------------------------------------------------------------------------
     /**
     *  - if materialIndex == NO_MATERIAL_SEPARATION, materials are not taken into
@@ -444,6 +470,9 @@ private:
     using MeshMap = std::map<const Geometry*, std::vector<unsigned int> >;
     MeshMap meshes_converted;
 
+    // in mesh index order, meshes of the same geometry are adjacent
+    std::vector<PendingMesh> pending_meshes;
+
     // fixed node name -> which trafo chain components have animations?
     using NodeAnimBitMap = std::map<std::string, unsigned int> ;
     NodeAnimBitMap node_anim_chain_bits;
@@ -66,7 +66,9 @@ struct ImportSettings
     , optimizeEmptyAnimationCurves(true)
     , useLegacyEmbeddedTextureNaming(false)
     , removeEmptyBones( true )
-    , convertToMeters( false ) {
+    , convertToMeters( false )
+    , inflateThreads( 0 )
+    , convertThreads( 0 ) {
         // empty
     }
 
@@ -154,6 +156,14 @@ struct ImportSettings
     /** Set to true to perform a conversion from cm to meter after the import
     */
     bool convertToMeters;
+
+    /** number of threads inflating compressed arrays of binary files,
+     *  0 means one per hardware thread. The default value is 0. */
+    unsigned int inflateThreads;
+
+    /** number of threads converting mesh geometry, 0 means one per
+     *  hardware thread. The default value is 0. */
+    unsigned int convertThreads;
 };
 
 
@@ -58,6 +58,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <assimp/MemoryIOWrapper.h>
 #include <assimp/Importer.hpp>
 #include <assimp/importerdesc.h>
+#include <assimp/Profiler.h>
+#include <assimp/scene.h>
+
+#include <algorithm>
 
 namespace Assimp {
 
@@ -142,6 +146,8 @@ void FBXImporter::SetupProperties(const Importer* pImp)
     settings.useLegacyEmbeddedTextureNaming = pImp->GetPropertyBool(AI_CONFIG_IMPORT_FBX_EMBEDDED_TEXTURES_LEGACY_NAMING, false);
     settings.removeEmptyBones = pImp->GetPropertyBool(AI_CONFIG_IMPORT_REMOVE_EMPTY_BONES, true);
     settings.convertToMeters = pImp->GetPropertyBool(AI_CONFIG_FBX_CONVERT_TO_M, false);
+    settings.inflateThreads = static_cast<unsigned int>(std::max(0, pImp->GetPropertyInteger(AI_CONFIG_IMPORT_FBX_INFLATE_THREADS, 0)));
+    settings.convertThreads = static_cast<unsigned int>(std::max(0, pImp->GetPropertyInteger(AI_CONFIG_IMPORT_FBX_CONVERT_THREADS, 0)));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -153,40 +159,76 @@ void FBXImporter::InternReadFile( const std::string& pFile, aiScene* pScene, IOS
         ThrowException("Could not open file for reading");
     }
 
-    // read entire file into memory - no streaming for this, fbx
+    // binary files are tokenized in place if the stream already holds
+    // the whole file in memory, e.g. as a memory mapping. Binary tokens
+    // carry their extent, so no terminator is needed.
+    const size_t file_size = stream->FileSize();
+    const char* mapped = static_cast<const char*>(stream->MappedData());
+    const bool in_place = mapped && file_size >= 18 && !strncmp(mapped,"Kaydara FBX Binary",18);
+
+    // otherwise read entire file into memory - no streaming for this, fbx
     // files can grow large, but the assimp output data structure
     // then becomes very large, too. Assimp doesn't support
     // streaming for its output data structures so the net win with
     // streaming input data would be very low.
+    std::unique_ptr<Profiling::Profiler> profiler(Profiling::Profiler::GetListener() ? new Profiling::Profiler() : NULL);
     std::vector<char> contents;
-    contents.resize(stream->FileSize()+1);
-    stream->Read( &*contents.begin(), 1, contents.size()-1 );
-    contents[ contents.size() - 1 ] = 0;
-    const char* const begin = &*contents.begin();
+    if (!in_place) {
+        if (profiler) {
+            profiler->BeginRegion("fbx read");
+        }
+        contents.resize(file_size+1);
+        stream->Read( &*contents.begin(), 1, contents.size()-1 );
+        contents[ contents.size() - 1 ] = 0;
+        if (profiler) {
+            profiler->EndRegion("fbx read", file_size, 1);
+        }
+    }
+    const char* const begin = in_place ? mapped : &*contents.begin();
+    const size_t length = in_place ? file_size : contents.size();
 
     // broadphase tokenizing pass in which we identify the core
-    // syntax elements of FBX (brackets, commas, key:value mappings)
+    // syntax elements of FBX (brackets, commas, key:value mappings).
+    // A mapped file is only paged in here.
     TokenList tokens;
     try {
 
+        if (profiler) {
+            profiler->BeginRegion("fbx tokenize");
+        }
         bool is_binary = false;
         if (!strncmp(begin,"Kaydara FBX Binary",18)) {
             is_binary = true;
-            TokenizeBinary(tokens,begin,contents.size());
+            TokenizeBinary(tokens,begin,length);
         }
         else {
             Tokenize(tokens,begin);
         }
+        if (profiler) {
+            profiler->EndRegion("fbx tokenize", file_size, tokens.size());
+            profiler->BeginRegion("fbx parse");
+        }
 
         // use this information to construct a very rudimentary
         // parse-tree representing the FBX scope structure
-        Parser parser(tokens, is_binary);
+        Parser parser(tokens, is_binary, settings.inflateThreads);
 
         // take the raw parse-tree and convert it to a FBX DOM
         Document doc(parser,settings);
+        if (profiler) {
+            profiler->EndRegion("fbx parse", file_size, doc.Objects().size());
+            profiler->BeginRegion("fbx convert");
+        }
 
         // convert the FBX DOM to aiScene
         ConvertToAssimpScene(pScene, doc, settings.removeEmptyBones);
+        if (profiler) {
+            uint64_t vertices = 0;
+            for (unsigned int i = 0; i < pScene->mNumMeshes; ++i) {
+                vertices += pScene->mMeshes[i]->mNumVertices;
+            }
+            profiler->EndRegion("fbx convert", 0, vertices);
+        }
 
         // size relative to cm
         float size_relative_to_cm = doc.GlobalSettings().UnitScaleFactor();
@@ -61,6 +61,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <assimp/ByteSwapper.h>
 
 #include <iostream>
+#include <algorithm>
 
 using namespace Assimp;
 using namespace Assimp::FBX;
@@ -108,6 +109,53 @@ namespace {
         ::memcpy(&result, data, sizeof(T));
         return result;
     }
+
+    // ------------------------------------------------------------------------------------------------
+    // size of one element of a binary array, 0 for type codes that are not read as arrays
+    uint32_t BinaryArrayStride(char type)
+    {
+        switch(type)
+        {
+            case 'f':
+            case 'i':
+                return 4;
+
+            case 'd':
+            case 'l':
+                return 8;
+
+            default:
+                return 0;
+        };
+    }
+
+    // ------------------------------------------------------------------------------------------------
+    // zlib/deflate, input starts with the ZIP head (0x78 0x01), see http://www.ietf.org/rfc/rfc1950.txt
+    // Never throws so that it can run on worker threads.
+    bool InflateBinaryArray(const char* data, uint32_t comp_len, char* out, size_t full_length)
+    {
+        z_stream zstream;
+        zstream.opaque = Z_NULL;
+        zstream.zalloc = Z_NULL;
+        zstream.zfree  = Z_NULL;
+        zstream.data_type = Z_BINARY;
+
+        // http://hewgill.com/journal/entries/349-how-to-decompress-gzip-stream-with-zlib
+        if(Z_OK != inflateInit(&zstream)) {
+            return false;
+        }
+
+        zstream.next_in   = reinterpret_cast<Bytef*>( const_cast<char*>(data) );
+        zstream.avail_in  = comp_len;
+
+        zstream.avail_out = static_cast<uInt>(full_length);
+        zstream.next_out = reinterpret_cast<Bytef*>(out);
+        const int ret = inflate(&zstream, Z_FINISH);
+
+        // terminate zlib
+        inflateEnd(&zstream);
+        return ret == Z_STREAM_END || ret == Z_OK;
+    }
 }
 
 namespace Assimp {
@@ -116,6 +164,7 @@ namespace FBX {
 // ------------------------------------------------------------------------------------------------
 Element::Element(const Token& key_token, Parser& parser)
 : key_token(key_token)
+, parser(parser)
 {
     TokenPtr n = nullptr;
     do {
@@ -213,13 +262,16 @@ Scope::~Scope()
 }
 
 // ------------------------------------------------------------------------------------------------
-Parser::Parser (const TokenList& tokens, bool is_binary)
+Parser::Parser (const TokenList& tokens, bool is_binary, unsigned int inflate_threads)
 : tokens(tokens)
 , last()
 , current()
 , cursor(tokens.begin())
 , is_binary(is_binary)
 {
+    if (is_binary) {
+        InflateArrays(inflate_threads);
+    }
     root.reset(new Scope(*this,true));
 }
 
@@ -229,6 +281,82 @@ Parser::~Parser()
     // empty
 }
 
+// ------------------------------------------------------------------------------------------------
+// Compressed arrays make up most of a binary file and inflating them dominated parsing,
+// so all of them are inflated here at once, side by side, into one arena.
+void Parser::InflateArrays(unsigned int threads)
+{
+    struct Job {
+        TokenPtr token;
+        const char* data;
+        uint32_t comp_len;
+        size_t offset;
+        size_t full_length;
+    };
+
+    std::vector<Job> jobs;
+    size_t arena_size = 0;
+    for(TokenPtr t : tokens) {
+        if (!t->IsBinary() || t->Type() != TokenType_DATA) {
+            continue;
+        }
+
+        // type code, element count, encoding and compressed length, as validated by the tokenizer
+        const char* data = t->begin(), *end = t->end();
+        if (static_cast<size_t>(end-data) < 13) {
+            continue;
+        }
+        const uint32_t stride = BinaryArrayStride(*data);
+        if (!stride) {
+            continue;
+        }
+        BE_NCONST uint32_t count = SafeParse<uint32_t>(data+1, end);
+        AI_SWAP4(count);
+        BE_NCONST uint32_t encmode = SafeParse<uint32_t>(data+5, end);
+        AI_SWAP4(encmode);
+        BE_NCONST uint32_t comp_len = SafeParse<uint32_t>(data+9, end);
+        AI_SWAP4(comp_len);
+        if (encmode != 1 || !count) {
+            continue;
+        }
+
+        Job job;
+        job.token = t;
+        job.data = data+13;
+        job.comp_len = comp_len;
+        job.offset = arena_size;
+        job.full_length = static_cast<size_t>(stride) * count;
+        arena_size += (job.full_length + 7) & ~static_cast<size_t>(7);
+        jobs.push_back(job);
+    }
+
+    if (jobs.empty()) {
+        return;
+    }
+
+    inflated_arena.resize(arena_size / 8);
+    char* const arena = reinterpret_cast<char*>(inflated_arena.data());
+
+    // largest first, so that no thread picks up a big array when the others are done
+    std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) {
+        return a.comp_len > b.comp_len;
+    });
+
+    std::vector<char> failed(jobs.size(), 0);
+    Util::ParallelFor(jobs.size(), threads, [&](size_t i) {
+        const Job& job = jobs[i];
+        failed[i] = !InflateBinaryArray(job.data, job.comp_len, arena + job.offset, job.full_length);
+    });
+
+    inflated.reserve(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (failed[i]) {
+            ParseError("failure decompressing compressed data section", jobs[i].token);
+        }
+        inflated[jobs[i].token] = arena + jobs[i].offset;
+    }
+}
+
 // ------------------------------------------------------------------------------------------------
 TokenPtr Parser::AdvanceToNextToken()
 {
@@ -515,10 +643,11 @@ void ReadBinaryDataArrayHead(const char*& data, const char* end, char& type, uin
 
 
 // ------------------------------------------------------------------------------------------------
-// read binary data array, assume cursor points to the 'compression mode' field (i.e. behind the header)
-void ReadBinaryDataArray(char type, uint32_t count, const char*& data, const char* end,
+// read binary data array, assume cursor points to the 'compression mode' field (i.e. behind the header).
+// Returns the decoded elements, either inflated by the parser up front or copied to buff.
+const char* ReadBinaryDataArray(char type, uint32_t count, const char*& data, const char* end,
     std::vector<char>& buff,
-    const Element& /*el*/)
+    const Element& el)
 {
     BE_NCONST uint32_t encmode = SafeParse<uint32_t>(data, end);
     AI_SWAP4(encmode);
@@ -532,60 +661,30 @@ void ReadBinaryDataArray(char type, uint32_t count, const char*& data, const cha
     ai_assert(data + comp_len == end);
 
     // determine the length of the uncompressed data by looking at the type signature
-    uint32_t stride = 0;
-    switch(type)
-    {
-        case 'f':
-        case 'i':
-            stride = 4;
-            break;
-
-        case 'd':
-        case 'l':
-            stride = 8;
-            break;
-
-        default:
-            ai_assert(false);
-    };
+    const uint32_t stride = BinaryArrayStride(type);
+    ai_assert(stride > 0);
 
     const uint32_t full_length = stride * count;
-    buff.resize(full_length);
+    const char* decoded = NULL;
 
     if(encmode == 0) {
         ai_assert(full_length == comp_len);
 
         // plain data, no compression
+        buff.resize(full_length);
         std::copy(data, end, buff.begin());
+        decoded = &buff[0];
     }
     else if(encmode == 1) {
-        // zlib/deflate, next comes ZIP head (0x78 0x01)
-        // see http://www.ietf.org/rfc/rfc1950.txt
-
-        z_stream zstream;
-        zstream.opaque = Z_NULL;
-        zstream.zalloc = Z_NULL;
-        zstream.zfree  = Z_NULL;
-        zstream.data_type = Z_BINARY;
-
-        // http://hewgill.com/journal/entries/349-how-to-decompress-gzip-stream-with-zlib
-        if(Z_OK != inflateInit(&zstream)) {
-            ParseError("failure initializing zlib");
-        }
-
-        zstream.next_in   = reinterpret_cast<Bytef*>( const_cast<char*>(data) );
-        zstream.avail_in  = comp_len;
-
-        zstream.avail_out = static_cast<uInt>(buff.size());
-        zstream.next_out = reinterpret_cast<Bytef*>(&*buff.begin());
-        const int ret = inflate(&zstream, Z_FINISH);
-
-        if (ret != Z_STREAM_END && ret != Z_OK) {
-            ParseError("failure decompressing compressed data section");
+        // the array token is always the first of its element
+        decoded = el.Owner().InflatedArray(*el.Tokens()[0]);
+        if (!decoded) {
+            buff.resize(full_length);
+            if (!InflateBinaryArray(data, comp_len, &buff[0], full_length)) {
+                ParseError("failure decompressing compressed data section");
+            }
+            decoded = &buff[0];
         }
-
-        // terminate zlib
-        inflateEnd(&zstream);
     }
 #ifdef ASSIMP_BUILD_DEBUG
     else {
@@ -596,6 +695,7 @@ void ReadBinaryDataArray(char type, uint32_t count, const char*& data, const cha
 
     data += comp_len;
     ai_assert(data == end);
+    return decoded;
 }
 
 } // !anon
@@ -632,16 +732,15 @@ void ParseVectorDataArray(std::vector<aiVector3D>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * (type == 'd' ? 8 : 4));
 
         const uint32_t count3 = count / 3;
         out.reserve(count3);
 
         if (type == 'd') {
-            const double* d = reinterpret_cast<const double*>(&buff[0]);
+            const double* d = reinterpret_cast<const double*>(decoded);
             for (unsigned int i = 0; i < count3; ++i, d += 3) {
                 out.push_back(aiVector3D(static_cast<ai_real>(d[0]),
                     static_cast<ai_real>(d[1]),
@@ -656,7 +755,7 @@ void ParseVectorDataArray(std::vector<aiVector3D>& out, const Element& el)
             }*/
         }
         else if (type == 'f') {
-            const float* f = reinterpret_cast<const float*>(&buff[0]);
+            const float* f = reinterpret_cast<const float*>(decoded);
             for (unsigned int i = 0; i < count3; ++i, f += 3) {
                 out.push_back(aiVector3D(f[0],f[1],f[2]));
             }
@@ -719,16 +818,15 @@ void ParseVectorDataArray(std::vector<aiColor4D>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * (type == 'd' ? 8 : 4));
 
         const uint32_t count4 = count / 4;
         out.reserve(count4);
 
         if (type == 'd') {
-            const double* d = reinterpret_cast<const double*>(&buff[0]);
+            const double* d = reinterpret_cast<const double*>(decoded);
             for (unsigned int i = 0; i < count4; ++i, d += 4) {
                 out.push_back(aiColor4D(static_cast<float>(d[0]),
                     static_cast<float>(d[1]),
@@ -737,7 +835,7 @@ void ParseVectorDataArray(std::vector<aiColor4D>& out, const Element& el)
             }
         }
         else if (type == 'f') {
-            const float* f = reinterpret_cast<const float*>(&buff[0]);
+            const float* f = reinterpret_cast<const float*>(decoded);
             for (unsigned int i = 0; i < count4; ++i, f += 4) {
                 out.push_back(aiColor4D(f[0],f[1],f[2],f[3]));
             }
@@ -798,23 +896,22 @@ void ParseVectorDataArray(std::vector<aiVector2D>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * (type == 'd' ? 8 : 4));
 
         const uint32_t count2 = count / 2;
         out.reserve(count2);
 
         if (type == 'd') {
-            const double* d = reinterpret_cast<const double*>(&buff[0]);
+            const double* d = reinterpret_cast<const double*>(decoded);
             for (unsigned int i = 0; i < count2; ++i, d += 2) {
                 out.push_back(aiVector2D(static_cast<float>(d[0]),
                     static_cast<float>(d[1])));
             }
         }
         else if (type == 'f') {
-            const float* f = reinterpret_cast<const float*>(&buff[0]);
+            const float* f = reinterpret_cast<const float*>(decoded);
             for (unsigned int i = 0; i < count2; ++i, f += 2) {
                 out.push_back(aiVector2D(f[0],f[1]));
             }
@@ -870,14 +967,13 @@ void ParseVectorDataArray(std::vector<int>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * 4);
 
         out.reserve(count);
 
-        const int32_t* ip = reinterpret_cast<const int32_t*>(&buff[0]);
+        const int32_t* ip = reinterpret_cast<const int32_t*>(decoded);
         for (unsigned int i = 0; i < count; ++i, ++ip) {
             BE_NCONST int32_t val = *ip;
             AI_SWAP4(val);
@@ -928,19 +1024,18 @@ void ParseVectorDataArray(std::vector<float>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * (type == 'd' ? 8 : 4));
 
         if (type == 'd') {
-            const double* d = reinterpret_cast<const double*>(&buff[0]);
+            const double* d = reinterpret_cast<const double*>(decoded);
             for (unsigned int i = 0; i < count; ++i, ++d) {
                 out.push_back(static_cast<float>(*d));
             }
         }
         else if (type == 'f') {
-            const float* f = reinterpret_cast<const float*>(&buff[0]);
+            const float* f = reinterpret_cast<const float*>(decoded);
             for (unsigned int i = 0; i < count; ++i, ++f) {
                 out.push_back(*f);
             }
@@ -989,14 +1084,13 @@ void ParseVectorDataArray(std::vector<unsigned int>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * 4);
 
         out.reserve(count);
 
-        const int32_t* ip = reinterpret_cast<const int32_t*>(&buff[0]);
+        const int32_t* ip = reinterpret_cast<const int32_t*>(decoded);
         for (unsigned int i = 0; i < count; ++i, ++ip) {
             BE_NCONST int32_t val = *ip;
             if(val < 0) {
@@ -1054,14 +1148,13 @@ void ParseVectorDataArray(std::vector<uint64_t>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * 8);
 
         out.reserve(count);
 
-        const uint64_t* ip = reinterpret_cast<const uint64_t*>(&buff[0]);
+        const uint64_t* ip = reinterpret_cast<const uint64_t*>(decoded);
         for (unsigned int i = 0; i < count; ++i, ++ip) {
             BE_NCONST uint64_t val = *ip;
             AI_SWAP8(val);
@@ -1112,14 +1205,13 @@ void ParseVectorDataArray(std::vector<int64_t>& out, const Element& el)
         }
 
         std::vector<char> buff;
-        ReadBinaryDataArray(type, count, data, end, buff, el);
+        const char* decoded = ReadBinaryDataArray(type, count, data, end, buff, el);
 
         ai_assert(data == end);
-        ai_assert(buff.size() == count * 8);
 
         out.reserve(count);
 
-        const int64_t* ip = reinterpret_cast<const int64_t*>(&buff[0]);
+        const int64_t* ip = reinterpret_cast<const int64_t*>(decoded);
         for (unsigned int i = 0; i < count; ++i, ++ip) {
             BE_NCONST int64_t val = *ip;
             AI_SWAP8(val);
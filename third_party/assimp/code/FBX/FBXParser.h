@@ -49,6 +49,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 #include <assimp/LogAux.h>
 #include <assimp/fast_atof.h>
 
@@ -101,8 +103,13 @@ public:
         return tokens;
     }
 
+    const Parser& Owner() const {
+        return parser;
+    }
+
 private:
     const Token& key_token;
+    const Parser& parser;
     TokenList tokens;
     std::unique_ptr<Scope> compound;
 };
@@ -158,8 +165,10 @@ class Parser
 {
 public:
     /** Parse given a token list. Does not take ownership of the tokens -
-     *  the objects must persist during the entire parser lifetime */
-    Parser (const TokenList& tokens,bool is_binary);
+     *  the objects must persist during the entire parser lifetime.
+     *  Binary files have their compressed arrays inflated first, on up to
+     *  inflate_threads threads (0 = one per hardware thread). */
+    Parser (const TokenList& tokens,bool is_binary,unsigned int inflate_threads = 0);
     ~Parser();
 
     const Scope& GetRootScope() const {
@@ -170,6 +179,13 @@ public:
         return is_binary;
     }
 
+    /** Get the inflated contents of a compressed binary array token,
+     *  NULL if the token was not compressed. */
+    const char* InflatedArray(const Token& token) const {
+        InflatedMap::const_iterator it = inflated.find(&token);
+        return it == inflated.end() ? NULL : (*it).second;
+    }
+
 private:
     friend class Scope;
     friend class Element;
@@ -178,7 +194,11 @@ private:
     TokenPtr LastToken() const;
     TokenPtr CurrentToken() const;
 
+    void InflateArrays(unsigned int threads);
+
 private:
+    typedef std::unordered_map< TokenPtr, const char* > InflatedMap;
+
     const TokenList& tokens;
 
     TokenPtr last, current;
@@ -186,6 +206,10 @@ private:
     std::unique_ptr<Scope> root;
 
     const bool is_binary;
+
+    // 8-byte aligned storage for every inflated array, indexed by token
+    std::vector<uint64_t> inflated_arena;
+    InflatedMap inflated;
 };
 
 
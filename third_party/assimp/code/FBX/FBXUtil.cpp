@@ -50,6 +50,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <assimp/TinyFormatter.h>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #ifndef ASSIMP_BUILD_NO_FBX_IMPORTER
 
@@ -236,6 +240,30 @@ std::string EncodeBase64(const char* data, size_t length)
     return encoded_string;
 }
 
+void ParallelFor(size_t count, unsigned int threads, const std::function<void(size_t)>& job)
+{
+    if (!threads) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, count));
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            job(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i) {
+        workers.push_back(std::thread(work));
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
 } // !Util
 } // !FBX
 } // !Assimp
@@ -49,6 +49,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "FBXCompileConfig.h"
 #include "FBXTokenizer.h"
 #include <stdint.h>
+#include <functional>
 
 namespace Assimp {
 namespace FBX {
@@ -130,6 +131,14 @@ char EncodeBase64(char byte);
 *  @return base64-encoded string*/
 std::string EncodeBase64(const char* data, size_t length);
 
+/** Run job(0) .. job(count-1) on up to the given number of threads, the
+*  calling thread included, and return when all of them are done.
+*
+*  @param count Number of jobs, handed out in ascending order.
+*  @param threads Thread limit, 0 for one per hardware thread.
+*  @param job Job body, must not throw.*/
+void ParallelFor(size_t count, unsigned int threads, const std::function<void(size_t)>& job);
+
 }
 }
 }
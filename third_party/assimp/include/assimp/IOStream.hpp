@@ -122,6 +122,15 @@ public:
      *  See fflush() for more details.
      */
     virtual void Flush() = 0;
+
+    // -------------------------------------------------------------------
+    /** @brief Get the whole file contents if they are already in memory
+     *
+     *  Streams backed by a memory buffer or a memory-mapped file may return
+     *  it here, so that importers can parse the file in place instead of
+     *  reading a copy. The memory stays valid while the stream is open.
+     *  @return FileSize() bytes, NULL if the stream has to be Read(). */
+    virtual const void* MappedData() const;
 }; //! class IOStream
 
 // ----------------------------------------------------------------------------------
@@ -135,6 +144,12 @@ inline
 IOStream::~IOStream() {
     // empty
 }
+
+// ----------------------------------------------------------------------------------
+inline
+const void* IOStream::MappedData() const {
+    return NULL;
+}
 // ----------------------------------------------------------------------------------
 
 } //!namespace Assimp
@@ -136,6 +136,12 @@ public:
         ai_assert(false); // won't be needed
     }
 
+    // -------------------------------------------------------------------
+    // The buffer is the file
+    const void* MappedData() const {
+        return buffer;
+    }
+
 private:
     const uint8_t* buffer;
     size_t length,pos;
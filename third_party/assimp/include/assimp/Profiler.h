@@ -51,15 +51,33 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "TinyFormatter.h"
 
 #include <map>
+#include <stdint.h>
 
 namespace Assimp {
 namespace Profiling {
 
 using namespace Formatter;
 
+// ------------------------------------------------------------------------------------------------
+/** Receives the regions of every Profiler, e.g. to build a timeline of a whole application
+ *  load. Regions may begin and end on any thread that imports.
+ */
+class ProfilerListener {
+public:
+    virtual ~ProfilerListener() {
+        // empty
+    }
+
+    /** A named region starts on the calling thread */
+    virtual void BeginRegion(const std::string& region) = 0;
+
+    /** The region ends, having processed the given number of bytes and items (0 if unknown) */
+    virtual void EndRegion(const std::string& region, uint64_t bytes, uint64_t items) = 0;
+};
+
 // ------------------------------------------------------------------------------------------------
 /** Simple wrapper around boost::timer to simplify reporting. Timings are automatically
- *  dumped to the log file.
+ *  dumped to the log file, and forwarded to the listener if one is installed.
  */
 class Profiler {
 public:
@@ -69,15 +87,29 @@ public:
 
 public:
 
+    /** Install a listener for all profilers, or NULL to remove it. Importers create
+     *  a profiler whenever a listener is installed, even without AI_CONFIG_GLOB_MEASURE_TIME.
+     */
+    static void SetListener(ProfilerListener* listener) {
+        ListenerSlot() = listener;
+    }
+
+    static ProfilerListener* GetListener() {
+        return ListenerSlot();
+    }
+
     /** Start a named timer */
     void BeginRegion(const std::string& region) {
         regions[region] = std::chrono::system_clock::now();
         ASSIMP_LOG_DEBUG((format("START `"),region,"`"));
+        if (ProfilerListener* listener = GetListener()) {
+            listener->BeginRegion(region);
+        }
     }
 
 
     /** End a specific named timer and write its end time to the log */
-    void EndRegion(const std::string& region) {
+    void EndRegion(const std::string& region, uint64_t bytes = 0, uint64_t items = 0) {
         RegionMap::const_iterator it = regions.find(region);
         if (it == regions.end()) {
             return;
@@ -85,9 +117,17 @@ public:
 
         std::chrono::duration<double> elapsedSeconds = std::chrono::system_clock::now() - regions[region];
         ASSIMP_LOG_DEBUG((format("END   `"),region,"`, dt= ", elapsedSeconds.count()," s"));
+        if (ProfilerListener* listener = GetListener()) {
+            listener->EndRegion(region, bytes, items);
+        }
     }
 
 private:
+    static ProfilerListener*& ListenerSlot() {
+        static ProfilerListener* listener = NULL;
+        return listener;
+    }
+
     typedef std::map<std::string,std::chrono::time_point<std::chrono::system_clock>> RegionMap;
     RegionMap regions;
 };